@@ -12,6 +12,15 @@ SOURCES += \
 	src/mtbusb/mtbusb-common.cpp \
 	src/mtbusb/mtbusb-win-com-discover.cpp \
 	src/server.cpp \
+	src/subscriptions.cpp \
+	src/journal.cpp \
+	src/dccindex.cpp \
+	src/rules.cpp \
+	src/virtualinputs.cpp \
+	src/healthmonitor.cpp \
+	src/speedtuner.cpp \
+	src/activation.cpp \
+	src/tokenbucket.cpp \
 	src/logging.cpp \
 	src/qjsonsafe.cpp \
 	src/modules/module.cpp \
@@ -27,6 +36,16 @@ HEADERS += \
 	src/mtbusb/mtbusb-commands.h \
 	src/mtbusb/mtbusb-common.h \
 	src/server.h \
+	src/subscriptions.h \
+	src/journal.h \
+	src/dccindex.h \
+	src/rules.h \
+	src/virtualinputs.h \
+	src/healthmonitor.h \
+	src/speedtuner.h \
+	src/activation.h \
+	src/tokenbucket.h \
+	src/dispatch.h \
 	src/logging.h \
 	src/qjsonsafe.h \
 	src/modules/module.h \
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include "activation.h"
+#include "main.h"
+#include "logging.h"
+
+void ActivationScheduler::schedule(uint8_t addr) {
+	this->schedule(std::vector<uint8_t>{addr});
+}
+
+void ActivationScheduler::schedule(const std::vector<uint8_t> &addrs, bool measure) {
+	for (const uint8_t addr : addrs) {
+		if ((this->m_queued[addr]) || (this->m_inProgress.count(addr) > 0))
+			continue;
+		if ((measure) && (!this->m_measureStart.has_value())) {
+			this->m_measureStart = Clock::now();
+			this->m_measureModules = 0;
+		}
+
+		this->m_queue.push_back(addr);
+		this->m_queued[addr] = true;
+		if (this->m_measureStart.has_value())
+			this->m_measureModules++;
+	}
+	this->next();
+}
+
+void ActivationScheduler::next() {
+	while ((this->m_inProgress.size() < ACTIVATION_WINDOW) && (!this->m_queue.empty())) {
+		// Modules subscribed by any client first, otherwise FIFO
+		auto it = std::find_if(this->m_queue.begin(), this->m_queue.end(), [](uint8_t addr) {
+			return !subscriptions.moduleSubscribers(addr).empty();
+		});
+		if (it == this->m_queue.end())
+			it = this->m_queue.begin();
+
+		const uint8_t addr = *it;
+		this->m_queue.erase(it);
+		this->m_queued[addr] = false;
+		this->m_inProgress.insert(addr);
+		if (this->onActivate)
+			this->onActivate(addr); // could call done() synchronously
+	}
+
+	if ((!this->running()) && (this->m_measureStart.has_value()))
+		this->finished();
+}
+
+void ActivationScheduler::done(uint8_t addr) {
+	if (this->m_inProgress.erase(addr) > 0)
+		this->next();
+}
+
+void ActivationScheduler::finished() {
+	this->m_lastTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+		Clock::now() - this->m_measureStart.value());
+	this->m_lastModules = this->m_measureModules;
+	this->m_measureStart.reset();
+
+	size_t active = 0;
+	for (const auto &module : modules)
+		if ((module != nullptr) && (module->isActive()))
+			active++;
+	log("Activation of "+QString::number(this->m_lastModules)+" modules finished in "+
+	    QString::number(this->m_lastTime->count())+" ms, "+QString::number(active)+" modules active",
+	    Mtb::LogLevel::Info);
+}
+
+void ActivationScheduler::clear() {
+	this->m_queue.clear();
+	this->m_queued.fill(false);
+	this->m_inProgress.clear();
+	this->m_measureStart.reset();
+}
+
+QJsonObject ActivationScheduler::json() const {
+	QJsonObject json{
+		{"pending", static_cast<int>(this->m_queue.size() + this->m_inProgress.size())},
+	};
+	if (this->m_lastTime.has_value()) {
+		json["time_ms"] = static_cast<qint64>(this->m_lastTime->count());
+		json["modules"] = static_cast<int>(this->m_lastModules);
+	}
+	return json;
+}
@@ -0,0 +1,57 @@
+#ifndef _ACTIVATION_H_
+#define _ACTIVATION_H_
+
+/* Scheduler of modules activation.
+ * Activation of a module is a chain of MTBbus commands (info, config, inputs,
+ * outputs reset), each step is sent after the previous one finishes. Instead
+ * of starting activation of all modules at once (all info requests first,
+ * then all configs etc.), at most ACTIVATION_WINDOW modules are activated at
+ * the same time. Steps of these modules interleave on MTBbus, so the bus is
+ * kept busy and modules become active one by one as fast as possible.
+ * Modules subscribed by any client are activated first.
+ * Time from start of activation of modules reported by MTB-USB to finish of
+ * the last one is measured.
+ */
+
+#include <QJsonObject>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <set>
+#include <vector>
+#include "mtbusb.h"
+
+constexpr size_t ACTIVATION_WINDOW = 8; // modules being activated at the same time
+
+class ActivationScheduler {
+public:
+	// Sends the first activation command of the module
+	std::function<void(uint8_t addr)> onActivate;
+
+	void schedule(uint8_t addr);
+	// 'measure' = start measurement of time-to-all-active (e.g. after MTB-USB connect)
+	void schedule(const std::vector<uint8_t> &addrs, bool measure = false);
+	// Activation of the module finished (successfully or not), could be called multiple times
+	void done(uint8_t addr);
+	void clear(); // e.g. MTB-USB disconnected
+	bool running() const { return (!this->m_queue.empty()) || (!this->m_inProgress.empty()); }
+	QJsonObject json() const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	std::deque<uint8_t> m_queue;
+	std::array<bool, Mtb::_MAX_MODULES> m_queued{};
+	std::set<uint8_t> m_inProgress;
+	std::optional<Clock::time_point> m_measureStart;
+	size_t m_measureModules = 0;
+	std::optional<std::chrono::milliseconds> m_lastTime;
+	size_t m_lastModules = 0;
+
+	void next();
+	void finished();
+};
+
+#endif
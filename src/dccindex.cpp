@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <QJsonObject>
+#include "dccindex.h"
+#include "main.h"
+
+void DccIndex::update(uint8_t module, const RcAddrs &added, const RcAddrs &removed) {
+	std::vector<DccAddr> changed;
+
+	for (size_t port = 0; port < RC_IN_CNT; port++) {
+		const DccLocation location{module, static_cast<uint8_t>(port)};
+		for (const DccAddr addr : removed[port]) {
+			if (!DccIndex::isValidAddr(addr))
+				continue;
+			std::vector<DccLocation> &locations = this->m_locations[addr];
+			locations.erase(std::remove(locations.begin(), locations.end(), location), locations.end());
+			changed.push_back(addr);
+		}
+		for (const DccAddr addr : added[port]) {
+			if (!DccIndex::isValidAddr(addr))
+				continue;
+			this->m_locations[addr].push_back(location);
+			changed.push_back(addr);
+		}
+	}
+
+	// Single event per address even if it moved between ports of the module
+	std::sort(changed.begin(), changed.end());
+	changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+	for (const DccAddr addr : changed)
+		this->notify(addr);
+}
+
+void DccIndex::moduleRemoved(uint8_t module) {
+	for (size_t addr = 0; addr < DCC_ADDR_CNT; addr++) {
+		std::vector<DccLocation> &locations = this->m_locations[addr];
+		const auto it = std::remove_if(locations.begin(), locations.end(),
+		                               [module](const DccLocation &location) { return location.module == module; });
+		if (it == locations.end())
+			continue;
+		locations.erase(it, locations.end());
+		this->notify(static_cast<DccAddr>(addr));
+	}
+}
+
+void DccIndex::notify(DccAddr addr) const {
+	// Recorded even without subscribers: reconnecting client could replay it by 'resume'
+	QJsonObject json{
+		{"command", "dcc_address_changed"},
+		{"type", "event"},
+		{"dcc_address_changed", QJsonObject{
+			{"address", addr},
+			{"locations", this->locationsJson(addr)},
+		}},
+	};
+	journal.record(json, EventScope::DccAddress, addr);
+	auto it = this->m_subscribers.find(addr);
+	if (it == this->m_subscribers.end())
+		return;
+	for (QIODevice *socket : it->second)
+		server.send(socket, json);
+}
+
+QJsonArray DccIndex::locationsJson(DccAddr addr) const {
+	QJsonArray result;
+	for (const DccLocation &location : this->m_locations[addr])
+		result.push_back(QJsonObject{{"module", location.module}, {"port", location.port}});
+	return result;
+}
+
+void DccIndex::subscribe(QIODevice *socket, DccAddr addr) {
+	if (!this->m_clients[socket].insert(addr).second)
+		return;
+	this->m_subscribers[addr].push_back(socket);
+}
+
+void DccIndex::unsubscribe(QIODevice *socket, DccAddr addr) {
+	auto it = this->m_clients.find(socket);
+	if ((it == this->m_clients.end()) || (it->second.erase(addr) == 0))
+		return;
+	if (it->second.empty())
+		this->m_clients.erase(it);
+
+	std::vector<QIODevice*> &subscribers = this->m_subscribers[addr];
+	subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), socket), subscribers.end());
+	if (subscribers.empty())
+		this->m_subscribers.erase(addr);
+}
+
+void DccIndex::clientDisconnected(QIODevice *socket) {
+	const std::set<DccAddr> addrs = this->subscribed(socket);
+	for (const DccAddr addr : addrs)
+		this->unsubscribe(socket, addr);
+}
+
+std::set<DccAddr> DccIndex::subscribed(const QIODevice *socket) const {
+	auto it = this->m_clients.find(socket);
+	return (it != this->m_clients.end()) ? it->second : std::set<DccAddr>();
+}
@@ -0,0 +1,55 @@
+#ifndef _DCC_INDEX_H_
+#define _DCC_INDEX_H_
+
+/* Reverse index of DCC addresses detected by all MTB-RC modules.
+ * Each DCC address holds a (small) vector of its locations (module, port),
+ * lookup is O(1) regardless of number of MTB-RC modules. The index is updated
+ * incrementally by MTB-RC modules (only added/removed addresses).
+ * Clients could subscribe specific DCC addresses, they get 'dcc_address_changed'
+ * event when the address appears/disappears at any location.
+ */
+
+#include <QIODevice>
+#include <QJsonArray>
+#include <array>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include "rc.h"
+
+constexpr size_t DCC_ADDR_CNT = 1 << 13; // MTB-RC reports 13-bit addresses
+
+struct DccLocation {
+	uint8_t module;
+	uint8_t port;
+
+	bool operator==(const DccLocation &other) const {
+		return (this->module == other.module) && (this->port == other.port);
+	}
+};
+
+class DccIndex {
+public:
+	// Applies changes of single MTB-RC module & sends events to subscribers of changed addresses
+	void update(uint8_t module, const RcAddrs &added, const RcAddrs &removed);
+	// Removes all locations of the module (e.g. module object replaced) & sends events
+	void moduleRemoved(uint8_t module);
+	const std::vector<DccLocation> &locations(DccAddr addr) const { return this->m_locations[addr]; }
+	QJsonArray locationsJson(DccAddr) const;
+
+	void subscribe(QIODevice*, DccAddr);
+	void unsubscribe(QIODevice*, DccAddr);
+	void clientDisconnected(QIODevice*);
+	std::set<DccAddr> subscribed(const QIODevice*) const;
+
+	static bool isValidAddr(size_t addr) { return addr < DCC_ADDR_CNT; }
+
+private:
+	std::array<std::vector<DccLocation>, DCC_ADDR_CNT> m_locations;
+	std::unordered_map<DccAddr, std::vector<QIODevice*>> m_subscribers;
+	std::unordered_map<const QIODevice*, std::set<DccAddr>> m_clients;
+
+	void notify(DccAddr) const;
+};
+
+#endif
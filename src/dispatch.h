@@ -0,0 +1,58 @@
+#ifndef _DISPATCH_H_
+#define _DISPATCH_H_
+
+/* Compile-time string dispatch tables.
+ * Table is a constexpr array of {name, value} entries sorted by name (checked
+ * by static_assert(dispatchSorted(table))), lookup is a binary search without
+ * any allocation (names are ASCII, compared directly with QString's UTF-16).
+ */
+
+#include <QString>
+#include <algorithm>
+#include <string_view>
+#include <cstddef>
+
+template <typename T>
+struct DispatchEntry {
+	std::string_view name;
+	T value;
+};
+
+template <typename T, size_t N>
+constexpr bool dispatchSorted(const DispatchEntry<T> (&table)[N]) {
+	for (size_t i = 1; i < N; i++)
+		if (!(table[i-1].name < table[i].name))
+			return false;
+	return true;
+}
+
+inline int dispatchCompare(const QString &key, std::string_view name) {
+	const size_t keySize = static_cast<size_t>(key.size());
+	const size_t size = std::min(keySize, name.size());
+	const QChar *data = key.constData();
+	for (size_t i = 0; i < size; i++) {
+		const int diff = static_cast<int>(data[i].unicode()) - static_cast<int>(static_cast<unsigned char>(name[i]));
+		if (diff != 0)
+			return diff;
+	}
+	return (keySize < name.size()) ? -1 : ((keySize > name.size()) ? 1 : 0);
+}
+
+// Returns nullptr when 'key' is not in the table
+template <typename T, size_t N>
+const T *dispatchFind(const DispatchEntry<T> (&table)[N], const QString &key) {
+	size_t low = 0, high = N;
+	while (low < high) {
+		const size_t mid = (low + high) / 2;
+		const int cmp = dispatchCompare(key, table[mid].name);
+		if (cmp == 0)
+			return &table[mid].value;
+		if (cmp < 0)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+	return nullptr;
+}
+
+#endif
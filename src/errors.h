@@ -8,9 +8,13 @@ constexpr size_t MTB_MODULE_FAILED = 1102;
 constexpr size_t MTB_INVALID_SPEED = 1105;
 constexpr size_t MTB_INVALID_DV = 1106;
 constexpr size_t MTB_MODULE_ACTIVE = 1107;
+constexpr size_t MTB_MODULE_SEQUENCE_CANCELLED = 1108;
 constexpr size_t MTB_FILE_CANNOT_ACCESS = 1010;
 constexpr size_t MTB_MODULE_ALREADY_WRITING = 1110;
 constexpr size_t MTB_UNKNOWN_COMMAND = 1020;
+constexpr size_t MTB_BATCH_TIMEOUT = 1021;
+constexpr size_t MTB_INVALID_DCC_ADDR = 1022;
+constexpr size_t MTB_UNKNOWN_VIRTUAL_INPUT = 1023;
 
 constexpr size_t MTB_DEVICE_DISCONNECTED = 2004;
 constexpr size_t MTB_ALREADY_STARTED = 2012;
@@ -0,0 +1,220 @@
+#include "healthmonitor.h"
+#include "main.h"
+#include "logging.h"
+#include "utils.h"
+#include "qjsonsafe.h"
+
+HealthMonitor::HealthMonitor() {
+	QObject::connect(&this->m_timer, &QTimer::timeout, [this]() { this->tick(); });
+}
+
+void HealthMonitor::loadConfig(const QJsonObject &json) {
+	this->m_enabled = json["enabled"].toBool(false);
+	const int budget = std::max(json["budget"].toInt(HEALTH_DEFAULT_BUDGET), 1);
+	this->m_period = std::max(json["period"].toInt(HEALTH_DEFAULT_PERIOD), 0);
+	this->m_historySize = std::max(json["historySize"].toInt(HEALTH_DEFAULT_HISTORY), 2);
+	this->m_threshold = json["threshold"].toDouble(0.01);
+
+	if (json.contains("windows")) {
+		std::vector<size_t> windows;
+		for (const QJsonValue &value : QJsonSafe::safeArray(json, "windows"))
+			windows.push_back(QJsonSafe::safeUInt(value));
+		if (windows.empty())
+			throw JsonParseError("health_monitor: 'windows' must not be empty!");
+		this->m_windows = windows;
+	}
+
+	for (ModuleHealth &module : this->m_modules)
+		while (module.history.size() > this->m_historySize)
+			module.history.pop_front();
+
+	if (this->m_enabled)
+		this->m_timer.start(std::max(1000 / budget, 1));
+	else
+		this->m_timer.stop();
+}
+
+void HealthMonitor::tick() {
+	if (!mtbusb.connected()) {
+		this->m_reading.reset();
+		return;
+	}
+	if ((this->m_reading.has_value()) && (this->m_reading->pending))
+		return; // previous DV read not finished yet, keep the budget
+
+	if (!this->m_reading.has_value()) {
+		const std::optional<uint8_t> addr = this->nextModule();
+		if (!addr.has_value())
+			return;
+		this->m_reading = Reading{addr.value()};
+		this->m_lastAddr = addr.value();
+		this->m_modules[addr.value()].lastSample = Clock::now();
+	}
+
+	Reading &reading = this->m_reading.value();
+	const uint8_t addr = reading.addr;
+	if ((modules[addr] == nullptr) || (!modules[addr]->isActive())) {
+		this->m_reading.reset();
+		return;
+	}
+
+	if (!backgroundBudget.take())
+		return;
+	reading.pending = true;
+	// DV cache shared with clients' 'module_diag' requests
+	const uint8_t dvi = DVS[reading.next];
+	modules[addr]->readDv(
+		dvi,
+		[this, addr, dvi](const std::vector<uint8_t> &data) { this->dvRead(addr, dvi, data); },
+		[this, addr](Mtb::CmdError) { this->dvNotRead(addr); }
+	);
+}
+
+std::optional<uint8_t> HealthMonitor::nextModule() const {
+	// Round-robin over active modules, each module sampled at most once per period
+	const Clock::time_point now = Clock::now();
+	for (size_t i = 1; i <= Mtb::_MAX_MODULES; i++) {
+		const uint8_t addr = (this->m_lastAddr + i) % Mtb::_MAX_MODULES;
+		if ((modules[addr] == nullptr) || (!modules[addr]->isActive()))
+			continue;
+		const std::optional<Clock::time_point> &last = this->m_modules[addr].lastSample;
+		if ((!last.has_value()) || (now - last.value() >= std::chrono::milliseconds(this->m_period)))
+			return addr;
+	}
+	return std::nullopt;
+}
+
+void HealthMonitor::dvRead(uint8_t addr, uint8_t dvi, const std::vector<uint8_t> &data) {
+	if ((!this->m_reading.has_value()) || (this->m_reading->addr != addr) || (!this->m_reading->pending))
+		return;
+
+	Reading &reading = this->m_reading.value();
+	reading.pending = false;
+	if ((dvi != DVS[reading.next]) || (data.size() != sizeof(uint32_t))) {
+		this->m_reading.reset();
+		return;
+	}
+
+	reading.counters[reading.next] = pack<uint32_t>(data);
+	reading.next++;
+	if (reading.next == COUNTERS) {
+		const std::array<uint32_t, COUNTERS> counters = reading.counters;
+		this->m_reading.reset();
+		this->addSample(addr, counters);
+	}
+}
+
+void HealthMonitor::dvNotRead(uint8_t addr) {
+	// Module is sampled again in the next period
+	if ((this->m_reading.has_value()) && (this->m_reading->addr == addr) && (this->m_reading->pending))
+		this->m_reading.reset();
+}
+
+void HealthMonitor::addSample(uint8_t addr, const std::array<uint32_t, COUNTERS> &counters) {
+	ModuleHealth &module = this->m_modules[addr];
+	module.history.push_back({Clock::now(), counters});
+	while (module.history.size() > this->m_historySize)
+		module.history.pop_front();
+
+	const std::optional<double> rate = this->errorRate(module, this->m_windows.front());
+	if (!rate.has_value())
+		return;
+	const bool degraded = module.degraded ? (rate.value() >= this->m_threshold/2) : (rate.value() >= this->m_threshold);
+	if (degraded == module.degraded)
+		return;
+
+	module.degraded = degraded;
+	const QString message = "Module "+QString::number(addr)+": MTBbus error rate "+
+		QString::number(rate.value()*100, 'f', 2)+" % over "+QString::number(this->m_windows.front())+" s";
+	if (degraded)
+		log(message+", check MTBbus cabling!", Mtb::LogLevel::Warning);
+	else
+		log(message+", MTBbus communication ok again", Mtb::LogLevel::Info);
+	this->sendEvent(addr);
+}
+
+std::optional<double> HealthMonitor::errorRate(const ModuleHealth &module, size_t window) const {
+	// Sum of differences of neighbor samples (counters reset by module reboot are skipped),
+	// the last interval is always included
+	if (module.history.size() < 2)
+		return std::nullopt;
+
+	const Clock::time_point since = module.history.back().time - std::chrono::seconds(window);
+	uint64_t errors = 0, total = 0;
+	bool any = false;
+	for (size_t i = module.history.size()-1; i > 0; i--) {
+		const Sample &current = module.history[i];
+		const Sample &previous = module.history[i-1];
+		if ((any) && (current.time <= since))
+			break;
+
+		bool reset = false;
+		for (size_t j = 0; j < COUNTERS; j++)
+			if (current.counters[j] < previous.counters[j])
+				reset = true;
+		if (reset)
+			continue;
+
+		// counters: received, bad CRC, sent, not sent
+		errors += (current.counters[1] - previous.counters[1]) + (current.counters[3] - previous.counters[3]);
+		total += (current.counters[0] - previous.counters[0]) + (current.counters[2] - previous.counters[2]);
+		any = true;
+	}
+
+	if (!any)
+		return std::nullopt;
+	return (errors+total > 0) ? static_cast<double>(errors) / (errors+total) : 0.0;
+}
+
+QJsonObject HealthMonitor::moduleJson(uint8_t addr, bool history) const {
+	const ModuleHealth &module = this->m_modules[addr];
+	QJsonObject json{
+		{"address", addr},
+		{"state", module.degraded ? "degraded" : "ok"},
+		{"samples", static_cast<int>(module.history.size())},
+	};
+
+	if (!module.history.empty()) {
+		QJsonObject counters;
+		for (size_t i = 0; i < COUNTERS; i++)
+			counters[Mtb::DVCommonToStr(DVS[i])] = static_cast<qint64>(module.history.back().counters[i]);
+		json["counters"] = counters;
+	}
+
+	QJsonObject rates; // window [s] -> error rate
+	for (const size_t window : this->m_windows) {
+		const std::optional<double> rate = this->errorRate(module, window);
+		rates[QString::number(window)] = rate.has_value() ? QJsonValue(rate.value()) : QJsonValue();
+	}
+	json["error_rate"] = rates;
+
+	if (history) {
+		const Clock::time_point now = Clock::now();
+		QJsonArray samples;
+		for (const Sample &sample : module.history) {
+			QJsonArray counters;
+			for (const uint32_t counter : sample.counters)
+				counters.push_back(static_cast<qint64>(counter));
+			samples.push_back(QJsonObject{
+				{"age_ms", static_cast<qint64>(
+					std::chrono::duration_cast<std::chrono::milliseconds>(now - sample.time).count())},
+				{"counters", counters},
+			});
+		}
+		json["history"] = samples;
+	}
+
+	return json;
+}
+
+void HealthMonitor::sendEvent(uint8_t addr) const {
+	QJsonObject json{
+		{"command", "module_health"},
+		{"type", "event"},
+		{"module_health", this->moduleJson(addr, false)},
+	};
+	journal.record(json, EventScope::ModuleOrTopology, addr);
+	subscriptions.forModuleOrTopology(addr, [&json](QIODevice *socket) {
+		server.send(socket, json);
+	});
+}
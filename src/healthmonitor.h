@@ -0,0 +1,84 @@
+#ifndef _HEALTH_MONITOR_H_
+#define _HEALTH_MONITOR_H_
+
+/* Background MTBbus health monitor.
+ * Periodically reads MTBbus counters DVs (received, bad CRC, sent, not sent)
+ * of all active modules at low MTBbus priority through modules' DV cache
+ * (reads are shared with clients' 'module_diag' requests). Number of DV reads
+ * per second is limited by configurable budget. Each complete read of the counters of
+ * a module is stored as a sample into bounded per-module history, error rates
+ * are computed over configurable time windows from the history.
+ * When error rate of a module over the shortest window crosses the threshold,
+ * 'module_health' event is sent (with hysteresis: back to ok when the rate
+ * drops below half of the threshold).
+ */
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QTimer>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <optional>
+#include "mtbusb.h"
+#include "mtbusb-common.h"
+
+constexpr size_t HEALTH_DEFAULT_BUDGET = 2; // DV reads per second
+constexpr size_t HEALTH_DEFAULT_PERIOD = 60000; // ms between samples of a single module
+constexpr size_t HEALTH_DEFAULT_HISTORY = 240; // samples per module
+
+class HealthMonitor {
+public:
+	HealthMonitor();
+	void loadConfig(const QJsonObject&);
+	QJsonObject moduleJson(uint8_t addr, bool history) const;
+	bool hasData(uint8_t addr) const { return !this->m_modules[addr].history.empty(); }
+
+private:
+	using Clock = std::chrono::steady_clock;
+	static constexpr size_t COUNTERS = 4;
+	static constexpr std::array<uint8_t, COUNTERS> DVS = {
+		Mtb::DVCommon::MtbBusReceived, Mtb::DVCommon::MtbBusBadCrc,
+		Mtb::DVCommon::MtbBusSent, Mtb::DVCommon::MtbBusNotSent,
+	};
+
+	struct Sample {
+		Clock::time_point time;
+		std::array<uint32_t, COUNTERS> counters;
+	};
+
+	struct ModuleHealth {
+		std::deque<Sample> history;
+		std::optional<Clock::time_point> lastSample;
+		bool degraded = false;
+	};
+
+	// Read of counters of a single module in progress
+	struct Reading {
+		uint8_t addr;
+		size_t next = 0; // index to DVS
+		std::array<uint32_t, COUNTERS> counters{};
+		bool pending = false; // DV read on the bus
+	};
+
+	bool m_enabled = false;
+	size_t m_period = HEALTH_DEFAULT_PERIOD;
+	size_t m_historySize = HEALTH_DEFAULT_HISTORY;
+	double m_threshold = 0.01;
+	std::vector<size_t> m_windows{60, 600, 3600}; // seconds, first = window for threshold
+	QTimer m_timer;
+	std::array<ModuleHealth, Mtb::_MAX_MODULES> m_modules;
+	std::optional<Reading> m_reading;
+	uint8_t m_lastAddr = 0;
+
+	void tick();
+	std::optional<uint8_t> nextModule() const;
+	void dvRead(uint8_t addr, uint8_t dvi, const std::vector<uint8_t> &data);
+	void dvNotRead(uint8_t addr);
+	void addSample(uint8_t addr, const std::array<uint32_t, COUNTERS>&);
+	// Error rate over last 'window' seconds, nullopt = not enough samples
+	std::optional<double> errorRate(const ModuleHealth&, size_t window) const;
+	void sendEvent(uint8_t addr) const;
+};
+
+#endif
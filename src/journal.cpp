@@ -0,0 +1,107 @@
+#include <QDateTime>
+#include <algorithm>
+#include "journal.h"
+
+EventJournal::EventJournal()
+	: m_lastSeq(static_cast<uint64_t>(QDateTime::currentMSecsSinceEpoch())*1000) {}
+
+void EventJournal::record(QJsonObject &event, EventScope scope, size_t addr, const QString &name) {
+	this->m_lastSeq++;
+	event["event_seq"] = static_cast<qint64>(this->m_lastSeq);
+
+	if ((this->m_capacity == 0) || (scope == EventScope::None))
+		return;
+	if (this->m_entries.size() >= this->m_capacity)
+		this->m_entries.pop_front();
+	this->m_entries.push_back({this->m_lastSeq, scope, addr, name, event, std::nullopt});
+}
+
+void EventJournal::recordIo(QJsonObject &event, uint8_t addr, const JournalIo &io) {
+	this->record(event, EventScope::Module, addr);
+	if ((this->m_capacity > 0) && (!this->m_entries.empty()) && (this->m_entries.back().seq == this->m_lastSeq))
+		this->m_entries.back().io = io;
+}
+
+std::optional<QJsonObject> EventJournal::ioEventFor(const QJsonObject &event, const JournalIo &io,
+                                                    Subscriber &subscriber, uint64_t connection) {
+	const bool match = (io.outputs) ? subscriber.ports.outputsMatch(io.changed)
+	                                : subscriber.ports.inputsMatch(io.changed);
+	if ((!match) || (std::find(io.ignore.begin(), io.ignore.end(), connection) != io.ignore.end()))
+		return std::nullopt;
+
+	QJsonObject result = event;
+	const QString command = result["command"].toString();
+	QJsonObject body = result[command].toObject();
+	if ((subscriber.delta) && (io.delta.has_value())) {
+		body[(io.outputs) ? "outputs" : "inputs"] = io.delta.value();
+		body["delta"] = true;
+		body["changed"] = static_cast<qint64>(io.changed);
+	}
+	size_t &seq = (io.outputs) ? subscriber.outputsSeq : subscriber.inputsSeq;
+	seq++;
+	body["seq"] = static_cast<qint64>(seq);
+	result[command] = body;
+	return result;
+}
+
+void EventJournal::setCapacity(size_t capacity) {
+	this->m_capacity = capacity;
+	while (this->m_entries.size() > capacity)
+		this->m_entries.pop_front();
+}
+
+bool EventJournal::covers(uint64_t seq) const {
+	if (seq > this->m_lastSeq)
+		return false; // sequence number from the future (e.g. client's last_seq from another daemon instance)
+	if (seq == this->m_lastSeq)
+		return true; // nothing missed
+	return (!this->m_entries.empty()) && (this->m_entries.front().seq <= seq+1);
+}
+
+std::vector<QJsonObject> EventJournal::eventsAfter(uint64_t seq, const QIODevice *socket, uint64_t connection,
+                                                   Subscriptions &subscriptions, const JournalClient &client) const {
+	std::vector<QJsonObject> result;
+	// Entries are sorted by seq -> skip older entries by binary search
+	auto it = std::lower_bound(this->m_entries.begin(), this->m_entries.end(), seq+1,
+	                           [](const JournalEntry &entry, uint64_t seq) { return entry.seq < seq; });
+	for (; it != this->m_entries.end(); ++it) {
+		bool send = false;
+		switch (it->scope) {
+		case EventScope::All:
+			send = true;
+			break;
+		case EventScope::Topology:
+			send = subscriptions.isTopologySubscribed(socket);
+			break;
+		case EventScope::Module:
+			send = subscriptions.isSubscribed(socket, it->addr);
+			break;
+		case EventScope::ModuleOrTopology:
+			send = subscriptions.isSubscribed(socket, it->addr) || subscriptions.isTopologySubscribed(socket);
+			break;
+		case EventScope::DccAddress:
+			send = (client.dccAddrs.count(it->addr) > 0);
+			break;
+		case EventScope::VirtualInput:
+			send = (client.virtualInputs.count(it->name) > 0);
+			break;
+		case EventScope::None:
+			break;
+		}
+		if (!send)
+			continue;
+
+		if (it->io.has_value()) {
+			// Same rules as live delivery
+			for (Subscriber &subscriber : subscriptions.moduleSubscribers(it->addr)) {
+				if (subscriber.socket != socket)
+					continue;
+				if (std::optional<QJsonObject> event = ioEventFor(it->event, it->io.value(), subscriber, connection))
+					result.push_back(event.value());
+			}
+		} else {
+			result.push_back(it->event);
+		}
+	}
+	return result;
+}
@@ -0,0 +1,88 @@
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+/* Bounded in-memory journal of events sent to clients.
+ * Each event gets a global sequence number ('event_seq'). Client which
+ * reconnects could ask for events it missed ('resume' command), they are
+ * replayed from the journal as long as they are still present in it.
+ * Replay applies the same per-client rules as live delivery (port filters,
+ * delta encoding, setter exclusion, per-subscription 'seq').
+ * Sequence numbers start at daemon's start time (in us), so they are
+ * increasing even across daemon restarts.
+ */
+
+#include <QJsonObject>
+#include <deque>
+#include <optional>
+#include <set>
+#include <vector>
+#include "subscriptions.h"
+
+constexpr size_t JOURNAL_DEFAULT_SIZE = 4096; // events
+
+// Which clients receive the event
+enum class EventScope {
+	All,
+	Topology, // clients subscribed to topology changes
+	Module, // clients subscribed to the module
+	ModuleOrTopology,
+	DccAddress, // clients subscribed to the DCC address ('addr')
+	VirtualInput, // clients subscribed to the virtual input ('name')
+	None, // sequenced only, never replayed (e.g. per-connection events)
+};
+
+// Inputs/outputs changed event of a module, delivered differently to each subscriber
+struct JournalIo {
+	bool outputs; // false = inputs changed
+	PortMask changed;
+	// Changed ports only ('inputs'/'outputs' of delta event), nullopt = nobody needs delta event
+	std::optional<QJsonObject> delta;
+	std::vector<uint64_t> ignore; // connections which do not get the event (e.g. setter of outputs)
+};
+
+struct JournalEntry {
+	uint64_t seq;
+	EventScope scope;
+	size_t addr; // module address or DCC address
+	QString name; // virtual input
+	QJsonObject event;
+	std::optional<JournalIo> io;
+};
+
+// Subscriptions of a client kept outside of Subscriptions
+struct JournalClient {
+	std::set<size_t> dccAddrs;
+	std::set<QString> virtualInputs;
+};
+
+class EventJournal {
+public:
+	EventJournal();
+
+	// Assigns sequence number to the event ('event_seq' key) & stores it in the journal
+	void record(QJsonObject &event, EventScope, size_t addr = 0, const QString &name = {});
+	// Inputs/outputs changed event of module 'addr'
+	void recordIo(QJsonObject &event, uint8_t addr, const JournalIo &io);
+	void setCapacity(size_t);
+
+	bool enabled() const { return (this->m_capacity > 0); }
+	uint64_t lastSeq() const { return this->m_lastSeq; }
+	// All the events after 'seq' are available in the journal
+	bool covers(uint64_t seq) const;
+	// Events after 'seq', which would be sent to the client with current subscriptions,
+	// encoded for the client (increments 'seq' of its module subscriptions)
+	std::vector<QJsonObject> eventsAfter(uint64_t seq, const QIODevice*, uint64_t connection, Subscriptions&,
+	                                     const JournalClient&) const;
+
+	// Inputs/outputs changed event as delivered to the subscriber ('connection' = its connection id),
+	// nullopt = not delivered
+	static std::optional<QJsonObject> ioEventFor(const QJsonObject &event, const JournalIo&, Subscriber&,
+	                                             uint64_t connection);
+
+private:
+	std::deque<JournalEntry> m_entries;
+	size_t m_capacity = JOURNAL_DEFAULT_SIZE;
+	uint64_t m_lastSeq;
+};
+
+#endif
@@ -8,6 +8,7 @@
 #include "mtbusb-common.h"
 #include "errors.h"
 #include "logging.h"
+#include "dispatch.h"
 
 #include "uni.h"
 #include "unis.h"
@@ -17,12 +18,19 @@
 #ifdef Q_OS_WIN
 #include <windows.h>
 #endif
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
 
 Mtb::MtbUsb mtbusb;
 DaemonServer server;
 std::array<std::unique_ptr<MtbModule>, Mtb::_MAX_MODULES> modules;
-std::array<std::unordered_set<QTcpSocket*>, Mtb::_MAX_MODULES> subscribes;
-std::unordered_set<QTcpSocket*> topoSubscribes;
+Subscriptions subscriptions;
+EventJournal journal;
+DccIndex dccIndex;
+VirtualInputs virtualInputs;
+ActivationScheduler activations;
+TokenBucket backgroundBudget;
 
 #ifdef Q_OS_WIN
 static BOOL WINAPI console_ctrl_handler(DWORD dwCtrlType);
@@ -44,11 +52,15 @@ const QJsonObject DEFAULT_CONFIG = {
 		{"host", "127.0.0.1"},
 		{"port", static_cast<int>(SERVER_DEFAULT_PORT)},
 		{"keepAlive", true},
-		{"allowedClients", QJsonArray{"127.0.0.1"}}
+		{"allowedClients", QJsonArray{"127.0.0.1"}},
+		{"outBufferLimit", static_cast<int>(SERVER_DEFAULT_OUT_BUFFER_LIMIT)},
+		{"outBufferPolicy", "coalesce"},
+		{"journalSize", static_cast<int>(JOURNAL_DEFAULT_SIZE)},
 	}},
 	{"mtb-usb", QJsonObject{
 		{"port", "auto"},
 		{"keepAlive", true},
+		{"reconnectGrace", 2000},
 		// In case {"speed", 115200} is present, speed is forced to MTB-USB
 		// If not present, MTB-USB chooses speed based on its EEPROM-saved value
 	}},
@@ -60,18 +72,67 @@ const QJsonObject DEFAULT_CONFIG = {
 		{"directory", "prodLog"},
 		{"detectLevel", static_cast<int>(Mtb::LogLevel::Warning)},
 	}},
+	{"health_monitor", QJsonObject{
+		{"enabled", true},
+		{"budget", static_cast<int>(HEALTH_DEFAULT_BUDGET)},
+		{"period", static_cast<int>(HEALTH_DEFAULT_PERIOD)},
+		{"historySize", static_cast<int>(HEALTH_DEFAULT_HISTORY)},
+		{"threshold", 0.01},
+		{"windows", QJsonArray{60, 600, 3600}},
+	}},
+	{"diag_cache", QJsonObject{
+		{"defaultTtl", 0},
+		{"ttl", QJsonObject{
+			{"uptime", 1000},
+			{"mcu_voltage", 1000},
+			{"mcu_temperature", 1000},
+			{"mtbbus_received", 1000},
+			{"mtbbus_bad_crc", 1000},
+			{"mtbbus_sent", 1000},
+			{"mtbbus_not_sent", 1000},
+		}},
+	}},
+	{"background_budget", QJsonObject{
+		{"rate", BACKGROUND_DEFAULT_RATE},
+		{"burst", BACKGROUND_DEFAULT_BURST},
+	}},
+	{"speed_autotune", QJsonObject{
+		{"trial", static_cast<int>(TUNER_DEFAULT_TRIAL)},
+		{"budget", TUNER_DEFAULT_BUDGET},
+		{"load", true},
+	}},
 };
 
 
 DaemonCoreApplication::DaemonCoreApplication(int &argc, char **argv)
      : QCoreApplication(argc, argv) {
-	QObject::connect(&server, SIGNAL(jsonReceived(QTcpSocket*, const QJsonObject&)),
-	                 this, SLOT(serverReceived(QTcpSocket*, const QJsonObject&)), Qt::DirectConnection);
-	QObject::connect(&server, SIGNAL(clientDisconnected(QTcpSocket*)),
-	                 this, SLOT(serverClientDisconnected(QTcpSocket*)), Qt::DirectConnection);
+	QObject::connect(&server, SIGNAL(jsonReceived(QIODevice*, const QJsonObject&)),
+	                 this, SLOT(serverReceived(QIODevice*, const QJsonObject&)), Qt::DirectConnection);
+	QObject::connect(&server, SIGNAL(clientDisconnected(QIODevice*)),
+	                 this, SLOT(serverClientDisconnected(QIODevice*)), Qt::DirectConnection);
+	server.setWriteAccessPolicy([this](const QIODevice *socket, const ClientSession &session) {
+		return this->writeAccessPolicy(socket, session);
+	});
+
+	this->speedTuner.onSpeedChanged = [this]() { server.broadcast(this->mtbUsbEvent(EventScope::All)); };
+	this->speedTuner.onSpeedSettled = [this](Mtb::MtbBusSpeed speed) {
+		// Forced to MTB-USB on reconnect, stored to file by 'save_config'
+		QJsonObject mtbusbObj = this->config["mtb-usb"].toObject();
+		mtbusbObj["speed"] = Mtb::mtbBusSpeedToInt(speed);
+		this->config["mtb-usb"] = mtbusbObj;
+	};
+
+	activations.onActivate = [this](uint8_t addr) { this->activateModule(addr); };
+	MtbModule::onInputsChanged = [this](uint8_t addr, PortMask current) {
+		// Only changes reported by MTB-USB are evaluated (not inputs read on activation)
+		if ((this->inputsChange) && (this->inputsChange->addr == addr))
+			this->rules.inputsChanged(addr, this->inputsChange->previous, current, this->inputsChange->received);
+	};
 
 	QObject::connect(&t_reconnect, SIGNAL(timeout()), this, SLOT(tReconnectTick()));
 	QObject::connect(&t_reactivate, SIGNAL(timeout()), this, SLOT(tReactivateTick()));
+	QObject::connect(&t_reconnectGrace, SIGNAL(timeout()), this, SLOT(tReconnectGraceTick()));
+	this->t_reconnectGrace.setSingleShot(true);
 
 	// Use Qt::DirectConnection in all mtbusb signals, because it is significantly faster.
 	// ASSERT: singnal must be emitted in the same thread!
@@ -103,6 +164,7 @@ DaemonCoreApplication::DaemonCoreApplication(int &argc, char **argv)
 			    Mtb::LogLevel::Info);
 			this->config = DEFAULT_CONFIG;
 			this->saveConfig(configFileName);
+			this->applyConfig();
 		} catch (const JsonParseError& e) {
 			log("Unable to load config file "+configFileName+": "+e.what(), Mtb::LogLevel::Error);
 			startError = StartupError::ConfigLoad;
@@ -120,9 +182,24 @@ DaemonCoreApplication::DaemonCoreApplication(int &argc, char **argv)
 		size_t port = serverConfig["port"].toInt();
 		bool keepAlive = serverConfig["keepAlive"].toBool(true);
 		QHostAddress host(serverConfig["host"].toString());
+
+		OutBufferPolicy outBufferPolicy = OutBufferPolicy::Coalesce;
+		try {
+			outBufferPolicy = outBufferPolicyFromStr(serverConfig["outBufferPolicy"].toString("coalesce"));
+		} catch (const std::logic_error& e) {
+			log(QString(e.what())+", using coalesce", Mtb::LogLevel::Warning);
+		}
+		server.setOutBuffer(serverConfig["outBufferLimit"].toInt(SERVER_DEFAULT_OUT_BUFFER_LIMIT), outBufferPolicy);
+		journal.setCapacity(serverConfig["journalSize"].toInt(JOURNAL_DEFAULT_SIZE));
+
 		log("Starting server: "+host.toString()+":"+QString::number(port)+"...", Mtb::LogLevel::Info);
 		try {
 			server.listen(host, port, keepAlive);
+			const QString localSocket = serverConfig["localSocket"].toString();
+			if (!localSocket.isEmpty()) {
+				log("Starting local server: "+localSocket+"...", Mtb::LogLevel::Info);
+				server.listenLocal(localSocket);
+			}
 		} catch (const std::exception& e) {
 			log(e.what(), Mtb::LogLevel::Error);
 			startError = StartupError::ServerStart;
@@ -223,9 +300,18 @@ void DaemonCoreApplication::mtbUsbProperSpeedSet() {
 }
 
 void DaemonCoreApplication::mtbUsbGotModules() {
-	server.broadcast(this->mtbUsbEvent());
+	server.broadcast(this->mtbUsbEvent(EventScope::All));
 
 	const auto activeModules = mtbusb.activeModules().value();
+	const bool warm = this->warmDisconnected.has_value();
+	if (warm) {
+		const auto disconnected = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - this->warmDisconnected.value());
+		this->t_reconnectGrace.stop();
+		this->warmDisconnected.reset();
+		log("MTB-USB reconnected within grace period ("+QString::number(disconnected.count())+
+		    " ms), revalidating kept modules...", Mtb::LogLevel::Info);
+	}
 
 	{ // Logging
 		size_t count = 0;
@@ -238,9 +324,42 @@ void DaemonCoreApplication::mtbUsbGotModules() {
 		log(message, Mtb::LogLevel::Info);
 	}
 
-	for (size_t i = 0; i < Mtb::_MAX_MODULES; i++)
-		if (activeModules[i])
-			this->activateModule(i);
+	std::vector<uint8_t> activate;
+	for (size_t i = 0; i < Mtb::_MAX_MODULES; i++) {
+		if ((warm) && (modules[i] != nullptr) && (modules[i]->isActive())) {
+			if (activeModules[i])
+				this->warmReactivateModule(i);
+			else
+				modules[i]->mtbBusLost();
+		} else if ((activeModules[i]) && ((modules[i] == nullptr) || (!modules[i]->isQuarantined()))) {
+			activate.push_back(i); // quarantined modules are activated when quarantine ends
+		}
+	}
+	activations.schedule(activate, true);
+}
+
+void DaemonCoreApplication::warmReactivateModule(uint8_t addr) {
+	// Lightweight activation of module kept active through short MTB-USB disconnection,
+	// full activation is done only when the module changed
+	mtbusb.send(
+		Mtb::CmdMtbModuleInfoRequest(
+			addr,
+			{[this](uint8_t addr, Mtb::ModuleInfo info, void*) {
+				if ((modules[addr] != nullptr) && (modules[addr]->mtbUsbWarmReconnect(info)))
+					return;
+				log("Module "+QString::number(addr)+" changed during MTB-USB disconnection, activating...",
+				    Mtb::LogLevel::Info);
+				if (modules[addr] != nullptr)
+					modules[addr]->mtbUsbDisconnected();
+				this->moduleGotInfo(addr, info);
+			}},
+			{[this, addr](Mtb::CmdError, void*) {
+				if (modules[addr] != nullptr)
+					modules[addr]->mtbUsbDisconnected();
+				this->activateModule(addr);
+			}}
+		)
+	);
 }
 
 void DaemonCoreApplication::activateModule(uint8_t addr, size_t attemptsRemaining) {
@@ -252,19 +371,29 @@ void DaemonCoreApplication::activateModule(uint8_t addr, size_t attemptsRemainin
 			{[this, addr, attemptsRemaining](Mtb::CmdError, void*) {
 				log("Did not get info from module "+QString::number(addr)+", trying again...",
 				    Mtb::LogLevel::Error);
+				// Retries are background traffic, they must not block activation of other modules
+				activations.done(addr);
 				if (attemptsRemaining > 0) {
-					QTimer::singleShot(500, [this, addr, attemptsRemaining]() {
-						if (!mtbusb.connected())
-							return;
-						if ((modules[addr] == nullptr) || (!modules[addr]->isActive() && !modules[addr]->isActivating()))
-							this->activateModule(addr, attemptsRemaining-1);
-					});
+					const size_t retry = MTB_ACTIVATION_ATTEMPTS - std::min(attemptsRemaining, MTB_ACTIVATION_ATTEMPTS);
+					this->activationRetry(addr, attemptsRemaining, T_ACTIVATION_RETRY << retry);
 				}
 			}}
 		)
 	);
 }
 
+void DaemonCoreApplication::activationRetry(uint8_t addr, size_t attemptsRemaining, size_t delay) {
+	QTimer::singleShot(delay, [this, addr, attemptsRemaining]() {
+		if (!mtbusb.connected())
+			return;
+		if ((modules[addr] != nullptr) && (modules[addr]->isActive() || modules[addr]->isActivating()))
+			return;
+		if (!backgroundBudget.take()) // no budget -> try later, attempt not consumed
+			return this->activationRetry(addr, attemptsRemaining, T_ACTIVATION_RETRY);
+		this->activateModule(addr, attemptsRemaining-1);
+	});
+}
+
 void DaemonCoreApplication::moduleGotInfo(uint8_t addr, Mtb::ModuleInfo info) {
 	if ((modules[addr] != nullptr) && (static_cast<size_t>(modules[addr]->moduleType()) != info.type)) {
 		log("Detected module "+QString::number(addr)+" type & stored module type mismatch! Forgetting config...",
@@ -278,23 +407,55 @@ void DaemonCoreApplication::moduleGotInfo(uint8_t addr, Mtb::ModuleInfo info) {
 	}
 
 	modules[addr]->mtbBusActivate(info);
+	if (!modules[addr]->isActivating()) // no activation steps (e.g. unknown module type or bootloader)
+		activations.done(addr);
 }
 
 void DaemonCoreApplication::mtbUsbOnDisconnect() {
-	server.broadcast(this->mtbUsbEvent());
+	this->speedTuner.abort("Disconnected from MTB-USB!");
+	activations.clear();
+	server.broadcast(this->mtbUsbEvent(EventScope::All));
+
+	const int grace = this->config["mtb-usb"].toObject()["reconnectGrace"].toInt(0);
+	if (this->warmDisconnected.has_value()) {
+		// Disconnected again during reconnect, grace period continues
+		this->t_reconnect.start(T_RECONNECT_GRACE_PERIOD);
+	} else if (grace > 0) {
+		this->warmDisconnected = std::chrono::steady_clock::now();
+		this->t_reconnectGrace.start(grace);
+		this->t_reconnect.start(T_RECONNECT_GRACE_PERIOD);
+		log("Keeping modules for "+QString::number(grace)+" ms, waiting for MTB-USB to appear...",
+		    Mtb::LogLevel::Info);
+		return;
+	} else {
+		this->modulesMtbUsbDisconnected();
+		this->t_reconnect.start(T_RECONNECT_PERIOD);
+	}
+	log("Waiting for MTB-USB to appear...", Mtb::LogLevel::Info);
+}
 
+void DaemonCoreApplication::modulesMtbUsbDisconnected() {
 	for (size_t i = 0; i < Mtb::_MAX_MODULES; i++)
 		if (modules[i] != nullptr)
 			modules[i]->mtbUsbDisconnected();
+}
 
-	this->t_reconnect.start(T_RECONNECT_PERIOD);
-	log("Waiting for MTB-USB to appear...", Mtb::LogLevel::Info);
+void DaemonCoreApplication::tReconnectGraceTick() {
+	if (!this->warmDisconnected.has_value())
+		return;
+	this->warmDisconnected.reset();
+	log("MTB-USB not reconnected within grace period, modules inactive", Mtb::LogLevel::Warning);
+	this->modulesMtbUsbDisconnected();
+	if (this->t_reconnect.isActive())
+		this->t_reconnect.start(T_RECONNECT_PERIOD);
 }
 
 void DaemonCoreApplication::mtbUsbOnNewModule(uint8_t addr) {
 	if ((modules[addr] == nullptr) || ((!modules[addr]->isActive()) && (!modules[addr]->isRebooting()) &&
-	    (!modules[addr]->isFirmwareUpgrading())))
-		this->activateModule(addr);
+	    (!modules[addr]->isFirmwareUpgrading()) && (!modules[addr]->isQuarantined())))
+		activations.schedule(addr);
+	else if (modules[addr] != nullptr)
+		modules[addr]->mtbUsbNewModule(); // e.g. rebooted module is ready
 
 	// Send new-module event to clients with topology change subscription
 	// Usually, more modules occur in a short time -> avoid sending multiple events
@@ -303,8 +464,9 @@ void DaemonCoreApplication::mtbUsbOnNewModule(uint8_t addr) {
 		this->newTimerPending = true;
 		QTimer::singleShot(T_MTBUSB_EVENT_PERIOD, [this]() {
 			this->newTimerPending = false;
-			for (auto& socket : topoSubscribes)
-				server.send(socket, this->mtbUsbEvent());
+			const QJsonObject event = this->mtbUsbEvent(EventScope::Topology);
+			for (QIODevice *socket : subscriptions.topologySubscribers())
+				server.send(socket, event);
 		});
 	}
 }
@@ -313,7 +475,7 @@ void DaemonCoreApplication::mtbUsbOnModuleFail(uint8_t addr) {
 	// Warning: any operation could be pending on module
 	// Beware module instance deletion!
 	if ((modules[addr] != nullptr) && (!modules[addr]->isFirmwareUpgrading()) && (!modules[addr]->isRebooting()))
-		modules[addr]->mtbBusLost();
+		modules[addr]->mtbUsbModuleFail();
 
 	// Send module-lost event to clients with topology change subscription
 	// Usually, more modules fail in a short time -> avoid sending multiple events
@@ -322,15 +484,23 @@ void DaemonCoreApplication::mtbUsbOnModuleFail(uint8_t addr) {
 		this->failTimerPending = true;
 		QTimer::singleShot(T_MTBUSB_EVENT_PERIOD, [this]() {
 			this->failTimerPending = false;
-			for (auto& socket : topoSubscribes)
-				server.send(socket, this->mtbUsbEvent());
+			const QJsonObject event = this->mtbUsbEvent(EventScope::Topology);
+			for (QIODevice *socket : subscriptions.topologySubscribers())
+				server.send(socket, event);
 		});
 	}
 }
 
 void DaemonCoreApplication::mtbUsbOnInputsChange(uint8_t addr, const std::vector<uint8_t> &data) {
-	if (modules[addr] != nullptr)
-		modules[addr]->mtbBusInputsChanged(data);
+	if (modules[addr] == nullptr)
+		return;
+
+	const auto received = std::chrono::steady_clock::now();
+	const std::optional<PortMask> previous = modules[addr]->inputsPacked();
+	if (previous)
+		this->inputsChange = InputsChange{addr, previous.value(), received};
+	modules[addr]->mtbBusInputsChanged(data);
+	this->inputsChange.reset();
 }
 
 void DaemonCoreApplication::mtbUsbOnDiagStateChange(uint8_t addr, const std::vector<uint8_t> &data) {
@@ -369,66 +539,63 @@ void DaemonCoreApplication::tReactivateTick() {
 	if (!mtbusb.connected())
 		return;
 
-	for (size_t i = 0; i < Mtb::_MAX_MODULES; i++)
-		if (modules[i] != nullptr)
-			modules[i]->reactivateCheck();
+	const std::array<bool, Mtb::_MAX_MODULES> active = mtbusb.activeModules().value_or(
+		std::array<bool, Mtb::_MAX_MODULES>{});
+	for (size_t i = 0; i < Mtb::_MAX_MODULES; i++) {
+		if (modules[i] == nullptr)
+			continue;
+		// Quarantined module reported by MTB-USB was not activated
+		if ((modules[i]->quarantineEnded()) && (active[i]) && (!modules[i]->isActive()))
+			activations.schedule(i);
+		modules[i]->reactivateCheck();
+	}
 }
 
 /* JSON server handling ------------------------------------------------------*/
 
-void DaemonCoreApplication::serverReceived(QTcpSocket *socket, const QJsonObject &request) {
+void DaemonCoreApplication::serverReceived(QIODevice *socket, const QJsonObject &request) {
 	try {
 		if (!request.contains("command"))
 			return; // probably some kind of empty ping or something like this -> no response
 		QString command = QJsonSafe::safeString(request, "command");
 
-		if (command == "mtbusb") {
-			this->serverCmdMtbusb(socket, request);
-
-		} else if (command == "version") {
-			this->serverCmdVersion(socket, request);
-
-		} else if (command == "save_config") {
-			this->serverCmdSaveConfig(socket, request);
-
-		} else if (command == "load_config") {
-			this->serverCmdLoadConfig(socket, request);
-
-		} else if (command == "module") {
-			this->serverCmdModule(socket, request);
-
-		} else if (command == "module_delete") {
-			this->serverCmdModuleDelete(socket, request);
-
-		} else if (command == "modules") {
-			this->serverCmdModules(socket, request);
-
-		} else if (command == "module_subscribe") {
-			this->serverCmdModuleSubscribe(socket, request);
-
-		} else if (command == "module_unsubscribe") {
-			this->serverCmdModuleUnsubscribe(socket, request);
-
-		} else if (command == "my_module_subscribes") {
-			this->serverCmdMyModuleSubscribes(socket, request);
-
-		} else if (command == "module_set_config") {
-			this->serverCmdModuleSetConfig(socket, request);
-
-		} else if (command == "module_specific_command") {
-			this->serverCmdModuleSpecificCommand(socket, request);
-
-		} else if (command == "set_address") {
-			this->serverCmdSetAddress(socket, request);
-
-		} else if (command == "reset_my_outputs") {
-			this->serverCmdResetMyOutputs(socket, request);
-
-		} else if (command == "topology_subscribe") {
-			this->serverCmdTopoSubscribe(socket, request);
-
-		} else if (command == "topology_unsubscribe") {
-			this->serverCmdTopoUnsubscribe(socket, request);
+		using Handler = void (DaemonCoreApplication::*)(QIODevice*, const QJsonObject&);
+		static constexpr DispatchEntry<Handler> handlers[] = {
+			{"batch", &DaemonCoreApplication::serverCmdBatch},
+			{"clients", &DaemonCoreApplication::serverCmdClients},
+			{"dcc_subscribe", &DaemonCoreApplication::serverCmdDccSubscribe},
+			{"dcc_unsubscribe", &DaemonCoreApplication::serverCmdDccUnsubscribe},
+			{"find_dcc_address", &DaemonCoreApplication::serverCmdFindDccAddress},
+			{"load_config", &DaemonCoreApplication::serverCmdLoadConfig},
+			{"module", &DaemonCoreApplication::serverCmdModule},
+			{"module_delete", &DaemonCoreApplication::serverCmdModuleDelete},
+			{"module_set_config", &DaemonCoreApplication::serverCmdModuleSetConfig},
+			{"module_specific_command", &DaemonCoreApplication::serverCmdModuleSpecificCommand},
+			{"module_subscribe", &DaemonCoreApplication::serverCmdModuleSubscribe},
+			{"module_unsubscribe", &DaemonCoreApplication::serverCmdModuleUnsubscribe},
+			{"modules", &DaemonCoreApplication::serverCmdModules},
+			{"modules_diag", &DaemonCoreApplication::serverCmdModulesDiag},
+			{"modules_set_outputs", &DaemonCoreApplication::serverCmdModulesSetOutputs},
+			{"mtbbus_health", &DaemonCoreApplication::serverCmdMtbbusHealth},
+			{"mtbusb", &DaemonCoreApplication::serverCmdMtbusb},
+			{"mtbusb_autotune", &DaemonCoreApplication::serverCmdMtbusbAutotune},
+			{"my_module_subscribes", &DaemonCoreApplication::serverCmdMyModuleSubscribes},
+			{"reset_my_outputs", &DaemonCoreApplication::serverCmdResetMyOutputs},
+			{"resume", &DaemonCoreApplication::serverCmdResume},
+			{"rules", &DaemonCoreApplication::serverCmdRules},
+			{"save_config", &DaemonCoreApplication::serverCmdSaveConfig},
+			{"set_address", &DaemonCoreApplication::serverCmdSetAddress},
+			{"topology_subscribe", &DaemonCoreApplication::serverCmdTopoSubscribe},
+			{"topology_unsubscribe", &DaemonCoreApplication::serverCmdTopoUnsubscribe},
+			{"version", &DaemonCoreApplication::serverCmdVersion},
+			{"virtual_inputs", &DaemonCoreApplication::serverCmdVirtualInputs},
+			{"virtual_inputs_subscribe", &DaemonCoreApplication::serverCmdVirtualInputsSubscribe},
+			{"virtual_inputs_unsubscribe", &DaemonCoreApplication::serverCmdVirtualInputsUnsubscribe},
+		};
+		static_assert(dispatchSorted(handlers), "Server commands must be sorted by name!");
+
+		if (const Handler *handler = dispatchFind(handlers, command)) {
+			(this->**handler)(socket, request);
 
 		} else if (command.startsWith("module_")) {
 			size_t addr = request["address"].toInt();
@@ -451,7 +618,7 @@ void DaemonCoreApplication::serverReceived(QTcpSocket *socket, const QJsonObject
 	}
 }
 
-void DaemonCoreApplication::serverCmdMtbusb(QTcpSocket *socket, const QJsonObject &request) {
+void DaemonCoreApplication::serverCmdMtbusb(QIODevice *socket, const QJsonObject &request) {
 	if (request.contains("mtbusb")) { // Changing MTB-USB
 		QJsonObject jsonMtbUsb = QJsonSafe::safeObject(request, "mtbusb");
 		if (jsonMtbUsb.contains("speed")) { // Change MTBbus speed
@@ -459,6 +626,8 @@ void DaemonCoreApplication::serverCmdMtbusb(QTcpSocket *socket, const QJsonObjec
 				return sendAccessDenied(socket, request);
 			if (!mtbusb.connected() || !mtbusb.mtbUsbInfo().has_value())
 				return sendError(socket, request, MTB_DEVICE_DISCONNECTED, "Disconnected from MTB-USB!");
+			if (this->speedTuner.running())
+				return sendError(socket, request, MTB_ALREADY_STARTED, "MTBbus speed auto-tune is running!");
 			size_t speed = QJsonSafe::safeUInt(jsonMtbUsb, "speed");
 			if (!Mtb::mtbBusSpeedValid(speed, mtbusb.mtbUsbInfo().value().fw_raw()))
 				return sendError(socket, request, MTB_INVALID_SPEED, "Invalid MTBbus speed!");
@@ -484,7 +653,46 @@ void DaemonCoreApplication::serverCmdMtbusb(QTcpSocket *socket, const QJsonObjec
 	server.send(socket, response);
 }
 
-void DaemonCoreApplication::serverCmdVersion(QTcpSocket *socket, const QJsonObject &request) {
+void DaemonCoreApplication::serverCmdMtbusbAutotune(QIODevice *socket, const QJsonObject &request) {
+	if ((request.contains("start")) && (QJsonSafe::safeBool(request, "start"))) {
+		if (!this->hasWriteAccess(socket))
+			return sendAccessDenied(socket, request);
+		if (!mtbusb.connected() || !mtbusb.mtbUsbInfo().has_value())
+			return sendError(socket, request, MTB_DEVICE_DISCONNECTED, "Disconnected from MTB-USB!");
+		if (this->speedTuner.running())
+			return sendError(socket, request, MTB_ALREADY_STARTED, "MTBbus speed auto-tune already running!");
+		this->speedTuner.start(request);
+	}
+
+	QJsonObject response = jsonOkResponse(request);
+	response["mtbusb_autotune"] = this->speedTuner.json();
+	server.send(socket, response);
+}
+
+void DaemonCoreApplication::serverCmdMtbbusHealth(QIODevice *socket, const QJsonObject &request) {
+	QJsonObject response = jsonOkResponse(request);
+	const bool history = request["history"].toBool(false);
+	QJsonObject jsonModules;
+
+	if (request.contains("addresses")) {
+		const QJsonArray addrs = QJsonSafe::safeArray(request, "addresses");
+		if (!DaemonCoreApplication::validateAddrs(addrs, response)) {
+			server.send(socket, response);
+			return;
+		}
+		for (const auto &value : addrs)
+			jsonModules[QString::number(value.toInt())] = this->health.moduleJson(value.toInt(), history);
+	} else {
+		for (size_t i = 0; i < Mtb::_MAX_MODULES; i++)
+			if (this->health.hasData(i))
+				jsonModules[QString::number(i)] = this->health.moduleJson(i, history);
+	}
+
+	response["modules"] = jsonModules;
+	server.send(socket, response);
+}
+
+void DaemonCoreApplication::serverCmdVersion(QIODevice *socket, const QJsonObject &request) {
 	QJsonObject response = jsonOkResponse(request);
 	QJsonObject version{
 		{"sw_version", VERSION},
@@ -495,7 +703,7 @@ void DaemonCoreApplication::serverCmdVersion(QTcpSocket *socket, const QJsonObje
 	server.send(socket, response);
 }
 
-void DaemonCoreApplication::serverCmdSaveConfig(QTcpSocket *socket, const QJsonObject &request) {
+void DaemonCoreApplication::serverCmdSaveConfig(QIODevice *socket, const QJsonObject &request) {
 	if (!this->hasWriteAccess(socket))
 		return sendAccessDenied(socket, request);
 
@@ -521,7 +729,7 @@ void DaemonCoreApplication::serverCmdSaveConfig(QTcpSocket *socket, const QJsonO
 	server.send(socket, response);
 }
 
-void DaemonCoreApplication::serverCmdLoadConfig(QTcpSocket *socket, const QJsonObject &request) {
+void DaemonCoreApplication::serverCmdLoadConfig(QIODevice *socket, const QJsonObject &request) {
 	if (!this->hasWriteAccess(socket))
 		return sendAccessDenied(socket, request);
 
@@ -552,12 +760,21 @@ void DaemonCoreApplication::serverCmdLoadConfig(QTcpSocket *socket, const QJsonO
 	server.send(socket, response);
 }
 
-void DaemonCoreApplication::serverCmdModule(QTcpSocket *socket, const QJsonObject &request) {
+void DaemonCoreApplication::serverCmdModule(QIODevice *socket, const QJsonObject &request) {
 	QJsonObject response = jsonOkResponse(request);
 
 	size_t addr = request["address"].toInt();
 	if ((Mtb::isValidModuleAddress(addr)) && (modules[addr] != nullptr)) {
-		response["module"] = modules[addr]->moduleInfo(request["state"].toBool(), true);
+		const size_t version = modules[addr]->version();
+		if (request.contains("since_version")) {
+			const bool changed = (version > QJsonSafe::safeUInt(request, "since_version"));
+			response["changed"] = changed;
+			if (changed)
+				response["module"] = modules[addr]->cachedModuleInfo(request["state"].toBool());
+		} else {
+			response["module"] = modules[addr]->cachedModuleInfo(request["state"].toBool());
+		}
+		response["version"] = static_cast<qint64>(version);
 		response["status"] = "ok";
 	} else {
 		response["status"] = "error";
@@ -567,7 +784,7 @@ void DaemonCoreApplication::serverCmdModule(QTcpSocket *socket, const QJsonObjec
 	server.send(socket, response);
 }
 
-void DaemonCoreApplication::serverCmdModuleDelete(QTcpSocket *socket, const QJsonObject &request) {
+void DaemonCoreApplication::serverCmdModuleDelete(QIODevice *socket, const QJsonObject &request) {
 	QJsonObject response = jsonOkResponse(request);
 
 	size_t addr = request["address"].toInt();
@@ -581,36 +798,57 @@ void DaemonCoreApplication::serverCmdModuleDelete(QTcpSocket *socket, const QJso
 		response["error"] = DaemonServer::error(MTB_MODULE_ACTIVE, "Cannot delete active module");
 	} else {
 		modules[addr] = nullptr;
+		DaemonCoreApplication::moduleRemoved(addr);
+		this->modulesDeleted[addr] = MtbModule::newVersion();
 		log("Module "+QString::number(addr)+": deleted on client request!", Mtb::LogLevel::Info);
 
 		// Send module-delete event
-		std::unordered_set<QTcpSocket*> clients(topoSubscribes);
-		clients.insert(subscribes[addr].begin(), subscribes[addr].end());
-		for (auto& sock : clients) {
-			if (socket != sock) {
-				server.send(sock, {
-					{"command", "module_deleted"},
-					{"type", "event"},
-					{"module", static_cast<int>(addr)},
-				});
-			}
-		}
+		QJsonObject event{
+			{"command", "module_deleted"},
+			{"type", "event"},
+			{"module", static_cast<int>(addr)},
+		};
+		journal.record(event, EventScope::ModuleOrTopology, addr);
+		subscriptions.forModuleOrTopology(addr, [socket, &event](QIODevice *sock) {
+			if (socket != sock)
+				server.send(sock, event);
+		});
 	}
 
 	server.send(socket, response);
 }
 
-void DaemonCoreApplication::serverCmdModules(QTcpSocket *socket, const QJsonObject &request) {
+void DaemonCoreApplication::serverCmdModules(QIODevice *socket, const QJsonObject &request) {
 	QJsonObject response = jsonOkResponse(request);
-	QJsonObject jsonModules;
-
-	for (size_t i = 0; i < Mtb::_MAX_MODULES; i++) {
-		if (modules[i] != nullptr)
-			jsonModules[QString::number(i)] = modules[i]->moduleInfo(
-				request["state"].toBool(), true
-			);
+	const bool state = request["state"].toBool();
+	const size_t version = MtbModule::modulesVersion();
+
+	if (request.contains("since_version")) {
+		// Only modules changed/deleted after 'since_version'
+		const size_t since = QJsonSafe::safeUInt(request, "since_version");
+		QJsonObject jsonModules;
+		QJsonArray deleted;
+		for (size_t i = 0; i < Mtb::_MAX_MODULES; i++) {
+			if ((modules[i] != nullptr) && (modules[i]->version() > since))
+				jsonModules[QString::number(i)] = modules[i]->cachedModuleInfo(state);
+			else if ((modules[i] == nullptr) && (this->modulesDeleted[i] > since))
+				deleted.push_back(static_cast<int>(i));
+		}
+		response["modules"] = jsonModules;
+		response["deleted"] = deleted;
+	} else {
+		// Full snapshot is cached until any module changes
+		std::optional<std::pair<size_t, QJsonObject>> &cached = this->modulesCache[state];
+		if ((!cached.has_value()) || (cached.value().first != version)) {
+			QJsonObject jsonModules;
+			for (size_t i = 0; i < Mtb::_MAX_MODULES; i++)
+				if (modules[i] != nullptr)
+					jsonModules[QString::number(i)] = modules[i]->cachedModuleInfo(state);
+			cached.emplace(version, jsonModules);
+		}
+		response["modules"] = cached.value().second;
 	}
-	response["modules"] = jsonModules;
+	response["version"] = static_cast<qint64>(version);
 
 	server.send(socket, response);
 }
@@ -628,29 +866,102 @@ bool DaemonCoreApplication::validateAddrs(const QJsonArray &addrs, QJsonObject&
 	return true;
 }
 
-void DaemonCoreApplication::serverCmdModuleSubscribe(QTcpSocket *socket, const QJsonObject &request) {
+bool DaemonCoreApplication::validatePorts(const QJsonArray &ports, PortMask &mask, QJsonObject& response) {
+	mask = 0;
+	for (const auto &value : ports) {
+		int port = value.toInt(-1);
+		if ((port < 0) || (static_cast<size_t>(port) >= MAX_PORTS)) {
+			response["status"] = "error";
+			response["error"] = DaemonServer::error(MTB_MODULE_INVALID_PORT,
+				"Invalid port: "+value.toVariant().toString());
+			return false;
+		}
+		mask |= (1U << port);
+	}
+	return true;
+}
+
+bool DaemonCoreApplication::validatePortFilters(const QJsonObject &ports, std::map<uint8_t, PortFilter> &filters,
+                                                QJsonObject& response) {
+	for (const QString &key : ports.keys()) {
+		bool ok;
+		unsigned int addr = key.toUInt(&ok);
+		if ((!ok) || (!Mtb::isValidModuleAddress(addr))) {
+			response["status"] = "error";
+			response["error"] = DaemonServer::error(MTB_MODULE_INVALID_ADDR, "Invalid module address: "+key);
+			return false;
+		}
+
+		const QJsonObject jsonFilter = QJsonSafe::safeObject(ports[key]);
+		PortFilter filter;
+		if ((jsonFilter.contains("inputs")) &&
+		    (!validatePorts(QJsonSafe::safeArray(jsonFilter, "inputs"), filter.inputs, response)))
+			return false;
+		if ((jsonFilter.contains("outputs")) &&
+		    (!validatePorts(QJsonSafe::safeArray(jsonFilter, "outputs"), filter.outputs, response)))
+			return false;
+		filters.insert_or_assign(addr, filter);
+	}
+	return true;
+}
+
+QJsonObject DaemonCoreApplication::portFilterToJson(const PortFilter &filter) {
+	QJsonObject result;
+	const std::vector<std::pair<QString, PortMask>> masks {{"inputs", filter.inputs}, {"outputs", filter.outputs}};
+	for (const auto &[key, mask] : masks) {
+		if (mask == ALL_PORTS)
+			continue;
+		QJsonArray ports;
+		for (size_t port = 0; port < MAX_PORTS; port++)
+			if (mask & (1U << port))
+				ports.push_back(static_cast<int>(port));
+		result[key] = ports;
+	}
+	return result;
+}
+
+void DaemonCoreApplication::serverCmdModuleSubscribe(QIODevice *socket, const QJsonObject &request) {
 	// First validate addresses (do not change anything if validation fails)
 	QJsonObject response = jsonOkResponse(request);
+	std::optional<bool> delta;
+	if (request.contains("delta"))
+		delta = QJsonSafe::safeBool(request, "delta");
+	std::map<uint8_t, PortFilter> filters;
+	if ((request.contains("ports")) &&
+	    (!DaemonCoreApplication::validatePortFilters(QJsonSafe::safeObject(request, "ports"), filters, response)))
+		goto cmdModuleSubscribeEnd;
+
 	if (request.contains("addresses")) {
 		const QJsonArray reqAddrs = QJsonSafe::safeArray(request, "addresses");
 		if (!DaemonCoreApplication::validateAddrs(reqAddrs, response))
 			goto cmdModuleSubscribeEnd;
 
 		// Addresses already validated
-		for (const auto &value : reqAddrs)
-			subscribes[QJsonSafe::safeUInt(value)].emplace(socket);
+		for (const auto &value : reqAddrs) {
+			size_t addr = QJsonSafe::safeUInt(value);
+			if (filters.find(addr) == filters.end())
+				subscriptions.subscribe(socket, addr, {}, delta);
+		}
 		response["addresses"] = reqAddrs;
 	} else {
 		// Subscribe to all addresses
 		for (size_t addr = 1; addr < Mtb::_MAX_MODULES; addr++)
-			subscribes[addr].emplace(socket);
+			if (filters.find(addr) == filters.end())
+				subscriptions.subscribe(socket, addr, {}, delta);
 	}
 
+	for (const auto &[addr, filter] : filters)
+		subscriptions.subscribe(socket, addr, filter, delta);
+	if (request.contains("ports"))
+		response["ports"] = request["ports"];
+	if (delta.value_or(false))
+		response["delta"] = true;
+
 cmdModuleSubscribeEnd:
 	server.send(socket, response);
 }
 
-void DaemonCoreApplication::serverCmdModuleUnsubscribe(QTcpSocket *socket, const QJsonObject &request) {
+void DaemonCoreApplication::serverCmdModuleUnsubscribe(QIODevice *socket, const QJsonObject &request) {
 	// First validate addresses (do not change anything if validation fails)
 	QJsonObject response = jsonOkResponse(request);
 	if (request.contains("addresses")) {
@@ -660,19 +971,18 @@ void DaemonCoreApplication::serverCmdModuleUnsubscribe(QTcpSocket *socket, const
 
 		// Addresses already validated
 		for (const auto &value : reqAddrs)
-			subscribes[QJsonSafe::safeUInt(value)].erase(socket);
+			subscriptions.unsubscribe(socket, QJsonSafe::safeUInt(value));
 
 		response["addresses"] = reqAddrs;
 	} else {
 		// Unsubscribe to all addresses
-		for (size_t addr = 0; addr < Mtb::_MAX_MODULES; addr++)
-			subscribes[addr].erase(socket);
+		subscriptions.setSubscribed(socket, ModuleSet());
 	}
 cmdModuleUnsubscribeEnd:
 	server.send(socket, response);
 }
 
-void DaemonCoreApplication::serverCmdMyModuleSubscribes(QTcpSocket *socket, const QJsonObject &request) {
+void DaemonCoreApplication::serverCmdMyModuleSubscribes(QIODevice *socket, const QJsonObject &request) {
 	// First validate addresses (do not change anything if validation fails)
 	QJsonObject response = jsonOkResponse(request);
 
@@ -681,25 +991,39 @@ void DaemonCoreApplication::serverCmdMyModuleSubscribes(QTcpSocket *socket, cons
 		if (!DaemonCoreApplication::validateAddrs(reqAddrs, response))
 			goto cmdMyModuleSubscribesEnd;
 
-		// Remove all subscriptions of the client
-		for (size_t addr = 0; addr < Mtb::_MAX_MODULES; addr++)
-			subscribes[addr].erase(socket);
-
-		// Subscribe to specific addresses
+		// Subscribe to specific addresses only
+		ModuleSet addrs;
 		for (const auto &value : reqAddrs)
-			subscribes[QJsonSafe::safeUInt(value)].emplace(socket);
+			addrs[QJsonSafe::safeUInt(value)] = true;
+		subscriptions.setSubscribed(socket, addrs);
 	}
 
 cmdMyModuleSubscribesEnd:
 	QJsonArray clientsSubscribes;
-	for (size_t addr = 0; addr < Mtb::_MAX_MODULES; addr++)
-		if (subscribes[addr].find(socket) != subscribes[addr].end())
+	QJsonObject clientsPorts;
+	QJsonArray clientsDelta;
+	const ModuleSet subscribed = subscriptions.subscribed(socket);
+	for (size_t addr = 0; addr < Mtb::_MAX_MODULES; addr++) {
+		if (subscribed[addr]) {
 			clientsSubscribes.push_back(static_cast<int>(addr));
+			const std::optional<Subscriber> subscriber = subscriptions.subscriber(socket, addr);
+			if (!subscriber.has_value())
+				continue;
+			if (!subscriber.value().ports.all())
+				clientsPorts[QString::number(addr)] = portFilterToJson(subscriber.value().ports);
+			if (subscriber.value().delta)
+				clientsDelta.push_back(static_cast<int>(addr));
+		}
+	}
 	response["addresses"] = clientsSubscribes;
+	if (!clientsPorts.isEmpty())
+		response["ports"] = clientsPorts;
+	if (!clientsDelta.isEmpty())
+		response["delta"] = clientsDelta;
 	server.send(socket, response);
 }
 
-void DaemonCoreApplication::serverCmdModuleSetConfig(QTcpSocket *socket, const QJsonObject &request) {
+void DaemonCoreApplication::serverCmdModuleSetConfig(QIODevice *socket, const QJsonObject &request) {
 	// Set config can create new module
 	if (!this->hasWriteAccess(socket))
 		return sendAccessDenied(socket, request);
@@ -720,7 +1044,7 @@ void DaemonCoreApplication::serverCmdModuleSetConfig(QTcpSocket *socket, const Q
 	modules[addr]->jsonSetConfig(socket, request);
 }
 
-void DaemonCoreApplication::serverCmdModuleSpecificCommand(QTcpSocket *socket, const QJsonObject &request) {
+void DaemonCoreApplication::serverCmdModuleSpecificCommand(QIODevice *socket, const QJsonObject &request) {
 	if (!this->hasWriteAccess(socket))
 		return sendAccessDenied(socket, request);
 
@@ -775,7 +1099,7 @@ void DaemonCoreApplication::serverCmdModuleSpecificCommand(QTcpSocket *socket, c
 	}
 }
 
-void DaemonCoreApplication::serverCmdSetAddress(QTcpSocket *socket, const QJsonObject &request) {
+void DaemonCoreApplication::serverCmdSetAddress(QIODevice *socket, const QJsonObject &request) {
 	if (!this->hasWriteAccess(socket))
 		return sendAccessDenied(socket, request);
 
@@ -799,10 +1123,15 @@ void DaemonCoreApplication::serverCmdSetAddress(QTcpSocket *socket, const QJsonO
 	);
 }
 
-void DaemonCoreApplication::serverCmdResetMyOutputs(QTcpSocket *socket, const QJsonObject &request) {
+void DaemonCoreApplication::serverCmdResetMyOutputs(QIODevice *socket, const QJsonObject &request) {
 	if (!this->hasWriteAccess(socket))
 		return sendAccessDenied(socket, request);
 
+	// Pending timed outputs of the client would set the outputs again
+	for (const auto &module : modules)
+		if (module != nullptr)
+			module->cancelOutputSequences(socket);
+
 	this->clientResetOutputs(
 		socket,
 		[socket, request]() { server.send(socket, jsonOkResponse(request)); },
@@ -810,15 +1139,368 @@ void DaemonCoreApplication::serverCmdResetMyOutputs(QTcpSocket *socket, const QJ
 	);
 }
 
-void DaemonCoreApplication::serverCmdTopoSubscribe(QTcpSocket *socket, const QJsonObject &request) {
+void DaemonCoreApplication::serverCmdTopoSubscribe(QIODevice *socket, const QJsonObject &request) {
+	QJsonObject response = jsonOkResponse(request);
+	subscriptions.subscribeTopology(socket);
+	server.send(socket, response);
+}
+
+void DaemonCoreApplication::serverCmdTopoUnsubscribe(QIODevice *socket, const QJsonObject &request) {
+	QJsonObject response = jsonOkResponse(request);
+	subscriptions.unsubscribeTopology(socket);
+	server.send(socket, response);
+}
+
+void DaemonCoreApplication::serverCmdFindDccAddress(QIODevice *socket, const QJsonObject &request) {
+	const size_t addr = QJsonSafe::safeUInt(request, "address");
+	if (!DccIndex::isValidAddr(addr))
+		return sendError(socket, request, MTB_INVALID_DCC_ADDR, "Invalid DCC address");
+
+	QJsonObject response = jsonOkResponse(request);
+	response["address"] = static_cast<int>(addr);
+	response["locations"] = dccIndex.locationsJson(addr);
+	server.send(socket, response);
+}
+
+std::optional<std::vector<DccAddr>> DaemonCoreApplication::dccAddrs(QIODevice *socket, const QJsonObject &request) {
+	std::vector<DccAddr> addrs;
+	for (const auto &value : QJsonSafe::safeArray(request, "addresses")) {
+		const size_t addr = QJsonSafe::safeUInt(value);
+		if (!DccIndex::isValidAddr(addr)) {
+			sendError(socket, request, MTB_INVALID_DCC_ADDR, "Invalid DCC address: "+QString::number(addr));
+			return std::nullopt;
+		}
+		addrs.push_back(addr);
+	}
+	return addrs;
+}
+
+QJsonArray DaemonCoreApplication::dccSubscribedJson(const QIODevice *socket) {
+	QJsonArray result;
+	for (const DccAddr addr : dccIndex.subscribed(socket))
+		result.push_back(addr);
+	return result;
+}
+
+void DaemonCoreApplication::serverCmdDccSubscribe(QIODevice *socket, const QJsonObject &request) {
+	const std::optional<std::vector<DccAddr>> addrs = this->dccAddrs(socket, request);
+	if (!addrs.has_value())
+		return;
+
+	// Current locations of newly subscribed addresses, events are sent only on change
+	QJsonObject locations;
+	for (const DccAddr addr : addrs.value()) {
+		dccIndex.subscribe(socket, addr);
+		locations[QString::number(addr)] = dccIndex.locationsJson(addr);
+	}
+
+	QJsonObject response = jsonOkResponse(request);
+	response["addresses"] = dccSubscribedJson(socket);
+	response["locations"] = locations;
+	server.send(socket, response);
+}
+
+void DaemonCoreApplication::serverCmdDccUnsubscribe(QIODevice *socket, const QJsonObject &request) {
+	const std::optional<std::vector<DccAddr>> addrs = this->dccAddrs(socket, request);
+	if (!addrs.has_value())
+		return;
+	for (const DccAddr addr : addrs.value())
+		dccIndex.unsubscribe(socket, addr);
+
+	QJsonObject response = jsonOkResponse(request);
+	response["addresses"] = dccSubscribedJson(socket);
+	server.send(socket, response);
+}
+
+std::optional<std::vector<QString>> DaemonCoreApplication::virtualInputNames(QIODevice *socket,
+                                                                            const QJsonObject &request) {
+	std::vector<QString> names;
+	for (const auto &value : QJsonSafe::safeArray(request, "names")) {
+		const QString name = QJsonSafe::safeString(value);
+		if (!virtualInputs.exists(name)) {
+			sendError(socket, request, MTB_UNKNOWN_VIRTUAL_INPUT, "Unknown virtual input: "+name);
+			return std::nullopt;
+		}
+		names.push_back(name);
+	}
+	return names;
+}
+
+QJsonArray DaemonCoreApplication::virtualInputsSubscribedJson(const QIODevice *socket) {
+	QJsonArray result;
+	for (const QString &name : virtualInputs.subscribed(socket))
+		result.push_back(name);
+	return result;
+}
+
+void DaemonCoreApplication::serverCmdVirtualInputs(QIODevice *socket, const QJsonObject &request) {
+	QJsonObject response = jsonOkResponse(request);
+	response["virtual_inputs"] = virtualInputs.json();
+	server.send(socket, response);
+}
+
+void DaemonCoreApplication::serverCmdVirtualInputsSubscribe(QIODevice *socket, const QJsonObject &request) {
+	const std::optional<std::vector<QString>> names = this->virtualInputNames(socket, request);
+	if (!names.has_value())
+		return;
+
+	// Current state of newly subscribed virtual inputs, events are sent only on change
+	QJsonObject states;
+	for (const QString &name : names.value()) {
+		virtualInputs.subscribe(socket, name);
+		states[name] = virtualInputs.state(name);
+	}
+
+	QJsonObject response = jsonOkResponse(request);
+	response["names"] = virtualInputsSubscribedJson(socket);
+	response["virtual_inputs"] = states;
+	server.send(socket, response);
+}
+
+void DaemonCoreApplication::serverCmdVirtualInputsUnsubscribe(QIODevice *socket, const QJsonObject &request) {
+	const std::optional<std::vector<QString>> names = this->virtualInputNames(socket, request);
+	if (!names.has_value())
+		return;
+	for (const QString &name : names.value())
+		virtualInputs.unsubscribe(socket, name);
+
 	QJsonObject response = jsonOkResponse(request);
-	topoSubscribes.emplace(socket);
+	response["names"] = virtualInputsSubscribedJson(socket);
 	server.send(socket, response);
 }
 
-void DaemonCoreApplication::serverCmdTopoUnsubscribe(QTcpSocket *socket, const QJsonObject &request) {
+void DaemonCoreApplication::serverCmdClients(QIODevice *socket, const QJsonObject &request) {
+	QJsonObject response = jsonOkResponse(request);
+	response["server"] = server.clientsJson();
+	server.send(socket, response);
+}
+
+void DaemonCoreApplication::serverCmdRules(QIODevice *socket, const QJsonObject &request) {
+	QJsonObject response = jsonOkResponse(request);
+	const QJsonObject rules = this->rules.json();
+	for (auto it = rules.begin(); it != rules.end(); ++it)
+		response[it.key()] = it.value();
+	server.send(socket, response);
+}
+
+void DaemonCoreApplication::serverCmdBatch(QIODevice *socket, const QJsonObject &request) {
+	const QJsonArray requests = QJsonSafe::safeArray(request, "requests");
+	if (static_cast<size_t>(requests.size()) > SERVER_BATCH_MAX_REQUESTS) {
+		sendError(socket, request, MTB_INVALID_JSON,
+		          "Too many requests in batch, max "+QString::number(SERVER_BATCH_MAX_REQUESTS));
+		return;
+	}
+	for (const auto& value : requests) {
+		const QJsonObject subrequest = value.toObject();
+		if (!value.isObject() || !subrequest["command"].isString()) {
+			sendError(socket, request, MTB_INVALID_JSON, "Each request in batch must contain command!");
+			return;
+		}
+		// Commands collecting their own sub-responses (nested batch) & long operations exceeding batch timeout
+		static const QSet<QString> forbidden = {
+			"batch", "modules_set_outputs", "modules_diag", "module_output_pulse", "module_output_sequence",
+			"module_reboot", "module_upgrade_fw",
+		};
+		const QString command = subrequest["command"].toString();
+		if (forbidden.contains(command)) {
+			sendError(socket, request, MTB_INVALID_JSON, "Command "+command+" is not allowed in batch!");
+			return;
+		}
+	}
+
+	// Dispatch all the sub-requests in a single pass -> resulting MTBbus commands are sent back-to-back
+	const std::vector<int> ids = server.beginBatch(socket, request, requests);
+	for (size_t i = 0; i < ids.size(); i++) {
+		QJsonObject subrequest = requests[i].toObject();
+		subrequest["type"] = "request";
+		subrequest["id"] = ids[i];
+		this->serverReceived(socket, subrequest);
+	}
+}
+
+void DaemonCoreApplication::serverCmdModulesSetOutputs(QIODevice *socket, const QJsonObject &request) {
+	if (!this->hasWriteAccess(socket))
+		return sendAccessDenied(socket, request);
+
+	// Validate everything first, set nothing if any module's outputs are invalid
+	const QJsonObject jsonModules = QJsonSafe::safeObject(request, "modules");
+	std::vector<uint8_t> addrs;
+	QJsonArray subrequests;
+	for (const QString &key : jsonModules.keys()) {
+		bool ok;
+		const uint addr = key.toUInt(&ok);
+		QJsonObject error;
+		if ((!ok) || (!Mtb::isValidModuleAddress(addr)) || (modules[addr] == nullptr)) {
+			error = DaemonServer::error(MTB_MODULE_INVALID_ADDR, "Invalid module address: "+key);
+		} else if (!jsonModules[key].isObject()) {
+			error = DaemonServer::error(MTB_INVALID_JSON, "Outputs of module "+key+" must be object!");
+		} else {
+			modules[addr]->validateOutputs(jsonModules[key].toObject(), error);
+		}
+
+		if (!error.isEmpty()) {
+			QJsonObject response = jsonOkResponse(request);
+			response["status"] = "error";
+			response["error"] = error;
+			response["address"] = key.toInt();
+			server.send(socket, response);
+			return;
+		}
+
+		addrs.push_back(addr);
+		subrequests.push_back(QJsonObject{
+			{"command", "module_set_outputs"},
+			{"type", "request"},
+			{"address", static_cast<int>(addr)},
+			{"outputs", jsonModules[key]},
+		});
+	}
+
+	const std::vector<int> ids = server.beginBatch(socket, request, subrequests,
+		[addrs](QJsonObject &response, const std::vector<QJsonObject> &responses) {
+			QJsonObject result;
+			for (size_t i = 0; i < responses.size(); i++) {
+				QJsonObject moduleResult {{"status", responses[i]["status"]}};
+				if (responses[i]["status"] == "ok")
+					moduleResult["outputs"] = responses[i]["outputs"];
+				else
+					moduleResult["error"] = responses[i]["error"];
+				result[QString::number(addrs[i])] = moduleResult;
+			}
+			response["modules"] = result;
+		}
+	);
+
+	// All CmdMtbModuleSetOutput commands of the group go to the bus together, in front of other traffic
+	mtbusb.beginBurst();
+	try {
+		for (size_t i = 0; i < ids.size(); i++) {
+			QJsonObject subrequest = subrequests[i].toObject();
+			subrequest["id"] = ids[i];
+			modules[addrs[i]]->jsonCommand(socket, subrequest, true);
+		}
+	} catch (...) {
+		mtbusb.endBurst();
+		throw;
+	}
+	mtbusb.endBurst();
+}
+
+void DaemonCoreApplication::serverCmdModulesDiag(QIODevice *socket, const QJsonObject &request) {
+	// DVs are read by 'module_diag' sub-requests (DV cache applies) at low MTBbus priority
+	const bool allDVs = (request["DVkeys"].toString() == "all");
+	const QJsonArray dvKeys = allDVs ? QJsonArray() : QJsonSafe::safeArray(request, "DVkeys");
+
+	QJsonObject result; // module -> DV key -> value, unknown DVs are filled in advance
+	std::vector<std::pair<QString, QString>> keys; // module & DV key of each sub-request
+	QJsonArray subrequests;
+	for (const auto &value : QJsonSafe::safeArray(request, "addresses")) {
+		const int addr = value.toInt(-1);
+		if ((addr < 0) || (!Mtb::isValidModuleAddress(addr)) || (modules[addr] == nullptr))
+			return sendError(socket, request, MTB_MODULE_INVALID_ADDR,
+			                 "Invalid module address: "+value.toVariant().toString());
+		const MtbModule &module = *modules[addr];
+		const QString moduleKey = QString::number(addr);
+
+		QJsonObject moduleResult;
+		std::vector<uint8_t> dvs;
+		if (allDVs) {
+			dvs = module.knownDVs();
+		} else {
+			for (const auto &jsonKey : dvKeys) {
+				const QString key = QJsonSafe::safeString(jsonKey);
+				const std::optional<uint8_t> dv = module.StrToDV(key);
+				if (dv.has_value())
+					dvs.push_back(dv.value());
+				else
+					moduleResult[key] = QJsonObject{{"error", DaemonServer::error(MTB_INVALID_DV, "Unknown DV!")}};
+			}
+		}
+
+		for (const uint8_t dv : dvs) {
+			QJsonObject subrequest{
+				{"command", "module_diag"},
+				{"type", "request"},
+				{"address", addr},
+				{"DVnum", dv},
+			};
+			if (request.contains("max_age_ms"))
+				subrequest["max_age_ms"] = request["max_age_ms"];
+			subrequests.push_back(subrequest);
+			keys.push_back({moduleKey, module.DVToStr(dv)});
+		}
+		result[moduleKey] = moduleResult;
+	}
+
+	if (static_cast<size_t>(subrequests.size()) > MODULES_DIAG_MAX_DVS)
+		return sendError(socket, request, MTB_INVALID_JSON,
+		                 "Too many DVs, max "+QString::number(MODULES_DIAG_MAX_DVS));
+
+	const size_t timeout = SERVER_BATCH_TIMEOUT_MS + (subrequests.size() * MODULES_DIAG_TIMEOUT_PER_DV_MS);
+	const std::vector<int> ids = server.beginBatch(socket, request, subrequests,
+		[result, keys](QJsonObject &response, const std::vector<QJsonObject> &responses) {
+			QJsonObject jsonModules = result;
+			for (size_t i = 0; i < responses.size(); i++) {
+				const QJsonObject &subresponse = responses[i];
+				QJsonObject dv;
+				if (subresponse["status"] == "ok") {
+					for (const char *key : {"DVnum", "DVvalue", "DVvalueRaw", "DVage_ms"})
+						dv[key] = subresponse[key];
+				} else {
+					dv["error"] = subresponse["error"];
+				}
+				QJsonObject moduleResult = jsonModules[keys[i].first].toObject();
+				moduleResult[keys[i].second] = dv;
+				jsonModules[keys[i].first] = moduleResult;
+			}
+			response["modules"] = jsonModules;
+		},
+		timeout
+	);
+
+	for (size_t i = 0; i < ids.size(); i++) {
+		QJsonObject subrequest = subrequests[i].toObject();
+		subrequest["id"] = ids[i];
+		const size_t addr = subrequest["address"].toInt();
+		if (modules[addr] != nullptr)
+			modules[addr]->getDiag(socket, subrequest, true);
+	}
+}
+
+void DaemonCoreApplication::serverCmdResume(QIODevice *socket, const QJsonObject &request) {
+	if (!request["last_seq"].isDouble())
+		return sendError(socket, request, MTB_INVALID_JSON, "'last_seq' must be a number!");
+	const uint64_t lastSeq = static_cast<uint64_t>(request["last_seq"].toDouble());
 	QJsonObject response = jsonOkResponse(request);
-	topoSubscribes.erase(socket);
+
+	if (journal.covers(lastSeq)) {
+		// Replay missed events (based on current subscriptions of the client)
+		const std::set<DccAddr> dccAddrs = dccIndex.subscribed(socket);
+		const JournalClient client{
+			std::set<size_t>(dccAddrs.begin(), dccAddrs.end()),
+			virtualInputs.subscribed(socket),
+		};
+		const std::vector<QJsonObject> events = journal.eventsAfter(lastSeq, socket, server.connectionId(socket),
+		                                                            subscriptions, client);
+		for (const QJsonObject &event : events)
+			server.send(socket, event);
+		response["resumed"] = true;
+		response["replayed"] = static_cast<int>(events.size());
+	} else {
+		// Gap is too old -> send compact snapshot of current state instead
+		const bool topology = subscriptions.isTopologySubscribed(socket);
+		QJsonObject jsonModules;
+		for (size_t i = 0; i < Mtb::_MAX_MODULES; i++)
+			if ((modules[i] != nullptr) && ((topology) || (subscriptions.isSubscribed(socket, i))))
+				jsonModules[QString::number(i)] = modules[i]->cachedModuleInfo(true);
+		response["resumed"] = false;
+		response["snapshot"] = QJsonObject{
+			{"mtbusb", this->mtbUsbJson()},
+			{"modules", jsonModules},
+		};
+	}
+	response["last_seq"] = static_cast<qint64>(journal.lastSeq());
+
 	server.send(socket, response);
 }
 
@@ -843,16 +1525,20 @@ QJsonObject DaemonCoreApplication::mtbUsbJson() const {
 				jsonActiveModules.push_back(static_cast<int>(i));
 
 		status["active_modules"] = jsonActiveModules;
+		status["activation"] = activations.json();
+		status["background_budget"] = backgroundBudget.json();
 	}
 	return status;
 }
 
-QJsonObject DaemonCoreApplication::mtbUsbEvent() const {
-	return {
+QJsonObject DaemonCoreApplication::mtbUsbEvent(EventScope scope) const {
+	QJsonObject event{
 		{"command", "mtbusb"},
 		{"type", "event"},
 		{"mtbusb", this->mtbUsbJson()},
 	};
+	journal.record(event, scope);
+	return event;
 }
 
 /* Configuration ------------------------------------------------------------ */
@@ -901,6 +1587,28 @@ void DaemonCoreApplication::loadConfig(const QString& filename) {
 	}
 
 	this->config.remove("modules");
+	this->applyConfig();
+}
+
+void DaemonCoreApplication::applyConfig() {
+	// Loads everything except modules from this->config
+	if (this->config.contains("rules"))
+		this->rules.load(QJsonSafe::safeArray(this->config, "rules"));
+	else
+		this->rules.load({});
+
+	// Config files without 'diag_cache' (older versions) get default TTLs
+	MtbModule::loadDvCacheConfig(QJsonSafe::safeObject(
+		(this->config.contains("diag_cache")) ? this->config : DEFAULT_CONFIG, "diag_cache"));
+
+	if (this->config.contains("virtual_inputs"))
+		virtualInputs.load(QJsonSafe::safeObject(this->config, "virtual_inputs"));
+	else
+		virtualInputs.load({});
+
+	this->health.loadConfig(this->config["health_monitor"].toObject());
+	this->speedTuner.loadConfig(this->config["speed_autotune"].toObject());
+	backgroundBudget.loadConfig(this->config["background_budget"].toObject());
 
 	{
 		// Load allowed clients
@@ -908,7 +1616,12 @@ void DaemonCoreApplication::loadConfig(const QString& filename) {
 		this->writeAccess.clear();
 		for (const auto& value : QJsonSafe::safeArray(serverConfig, "allowedClients"))
 			this->writeAccess.insert(QHostAddress(QJsonSafe::safeString(value)));
+		this->localWriteAccess.clear();
+		if (serverConfig.contains("localAllowedUsers"))
+			for (const auto& value : QJsonSafe::safeArray(serverConfig, "localAllowedUsers"))
+				this->localWriteAccess.insert(QJsonSafe::safeUInt(value));
 	}
+	server.refreshWriteAccess();
 }
 
 void DaemonCoreApplication::saveConfig(const QString &filename) {
@@ -934,39 +1647,35 @@ void DaemonCoreApplication::saveConfig(const QString &filename) {
 	file.close();
 }
 
-std::vector<QTcpSocket*> outputSetters() {
-	std::vector<QTcpSocket*> result;
-	for (const auto& modulePtr : modules) {
-		if (modulePtr != nullptr) {
-			for (QTcpSocket* socket : modulePtr->outputSetters())
-				if (std::find(result.begin(), result.end(), socket) == result.end())
-					result.push_back(socket);
-		}
-	}
-	return result;
-}
-
-void DaemonCoreApplication::serverClientDisconnected(QTcpSocket* socket) {
-	for (size_t i = 0; i < Mtb::_MAX_MODULES; i++) {
-		subscribes[i].erase(socket);
+void DaemonCoreApplication::serverClientDisconnected(QIODevice* socket) {
+	subscriptions.clientDisconnected(socket);
+	dccIndex.clientDisconnected(socket);
+	virtualInputs.clientDisconnected(socket);
+	for (size_t i = 0; i < Mtb::_MAX_MODULES; i++)
 		if (modules[i] != nullptr)
 			modules[i]->clientDisconnected(socket);
-	}
-	topoSubscribes.erase(socket);
 
 	this->clientResetOutputs(socket, [](){}, [](){});
 }
 
 void DaemonCoreApplication::clientResetOutputs(
-		QTcpSocket* socket,
+		QIODevice* socket,
 		std::function<void()> onOk,
 		std::function<void()> onError) {
-	const std::vector<QTcpSocket*>& setters = outputSetters();
+	ClientSession *session = server.session(socket);
+	if (session == nullptr)
+		return onOk();
+	const std::vector<QIODevice*> setters = server.outputSetters();
+	const std::map<uint8_t, PortMask> owned = session->ownedOutputs;
 
 	if (setters.size() >= 2) {
-		for (size_t i = 0; i < Mtb::_MAX_MODULES; i++)
-			if (modules[i] != nullptr)
-				modules[i]->resetOutputsOfClient(socket);
+		// Only modules with outputs owned by the client, in address order, sent to the bus together
+		mtbusb.beginBurst();
+		for (const auto &pair : owned)
+			if (modules[pair.first] != nullptr)
+				modules[pair.first]->resetOutputsOfClient(socket);
+		mtbusb.endBurst();
+		session->ownedOutputs.clear(); // e.g. outputs of modules without config
 		onOk();
 	} else if ((setters.size() == 1) && (setters[0] == socket)) {
 		// Reset outputs of all modules with broadcast
@@ -988,11 +1697,34 @@ void DaemonCoreApplication::clientResetOutputs(
 	}
 }
 
-bool DaemonCoreApplication::hasWriteAccess(const QTcpSocket *socket) {
-	return this->writeAccess.contains(socket->peerAddress());
+bool DaemonCoreApplication::hasWriteAccess(const QIODevice *socket) {
+	const ClientSession *session = server.session(socket);
+	return (session != nullptr) && (session->writeAccess);
+}
+
+bool DaemonCoreApplication::writeAccessPolicy(const QIODevice *socket, const ClientSession &session) const {
+	// Evaluated once per client (on connect & config load), result is cached in client's session
+	if (auto tcpSocket = dynamic_cast<const QTcpSocket*>(socket))
+		return this->writeAccess.contains(tcpSocket->peerAddress());
+
+	// Local socket: use peer credentials, daemon's own user always has write access
+	if (!session.uid.has_value())
+		return false;
+#ifdef Q_OS_UNIX
+	if (session.uid.value() == getuid())
+		return true;
+#endif
+	return this->localWriteAccess.contains(session.uid.value());
+}
+
+void DaemonCoreApplication::moduleRemoved(uint8_t addr) {
+	server.moduleRemoved(addr); // nobody owns outputs of the module anymore
+	virtualInputs.update(addr, 0);
+	dccIndex.moduleRemoved(addr);
 }
 
 std::unique_ptr<MtbModule> DaemonCoreApplication::newModule(size_t type, uint8_t addr) {
+	DaemonCoreApplication::moduleRemoved(addr); // new module replaces the previous one
 	if ((type&0xF0) == (static_cast<size_t>(MtbModuleType::Univ2ir)&0xF0)) {
 		return std::make_unique<MtbUni>(addr);
 	} else if (type == static_cast<size_t>(MtbModuleType::Unis10)) {
@@ -2,29 +2,48 @@
 #define _MAIN_H_
 
 #include <QCoreApplication>
+#include <QIODevice>
 #include <QTcpSocket>
 #include <unordered_set>
 #include <QSet>
 #include <array>
+#include <chrono>
+#include <optional>
 #include "mtbusb.h"
 #include "server.h"
 #include "module.h"
+#include "subscriptions.h"
+#include "journal.h"
+#include "dccindex.h"
+#include "rules.h"
+#include "virtualinputs.h"
+#include "healthmonitor.h"
+#include "speedtuner.h"
+#include "activation.h"
+#include "tokenbucket.h"
 #include "qjsonsafe.h"
 
 extern Mtb::MtbUsb mtbusb;
 extern DaemonServer server;
 extern std::array<std::unique_ptr<MtbModule>, Mtb::_MAX_MODULES> modules;
-extern std::array<std::unordered_set<QTcpSocket*>, Mtb::_MAX_MODULES> subscribes;
-extern std::unordered_set<QTcpSocket*> topoSubscribes;
+extern Subscriptions subscriptions;
+extern EventJournal journal;
+extern DccIndex dccIndex;
+extern VirtualInputs virtualInputs;
+extern ActivationScheduler activations;
+extern TokenBucket backgroundBudget;
 
 constexpr size_t T_RECONNECT_PERIOD = 1000; // 1 s
+constexpr size_t T_RECONNECT_GRACE_PERIOD = 100; // 100 ms, during reconnect grace period
 constexpr size_t T_REACTIVATE_PERIOD = 500; // 500 ms
 constexpr size_t T_MTBUSB_EVENT_PERIOD = 500; // 500 ms
+constexpr size_t T_ACTIVATION_RETRY = 500; // 500 ms, doubled with each retry
+constexpr size_t MTB_ACTIVATION_ATTEMPTS = 5;
+constexpr size_t MODULES_DIAG_MAX_DVS = 4096; // max number of DVs read by single 'modules_diag' request
+constexpr size_t MODULES_DIAG_TIMEOUT_PER_DV_MS = 50;
 
 const QString DEFAULT_CONFIG_FILENAME = "mtb-daemon.json";
 
-std::vector<QTcpSocket*> outputSetters();
-
 struct ConfigNotFound : public std::logic_error {
 	ConfigNotFound(const std::string &str) : std::logic_error(str) {}
 	ConfigNotFound(const QString &str) : logic_error(str.toStdString()) {}
@@ -48,7 +67,8 @@ public:
 	DaemonCoreApplication(int &argc, char **argv);
 	~DaemonCoreApplication() override = default;
 
-	bool hasWriteAccess(const QTcpSocket*);
+	bool hasWriteAccess(const QIODevice*);
+	bool writeAccessPolicy(const QIODevice*, const ClientSession&) const;
 	StartupError startupError() const { return startError; }
 
 private:
@@ -56,48 +76,92 @@ private:
 	QString configFileName;
 	QTimer t_reconnect;
 	QTimer t_reactivate;
+	QTimer t_reconnectGrace;
+	// MTB-USB disconnected, modules kept active until reconnect or end of grace period
+	std::optional<std::chrono::steady_clock::time_point> warmDisconnected;
 	QSet<QHostAddress> writeAccess;
+	QSet<uint32_t> localWriteAccess; // uids of local-socket clients with write access
 	StartupError startError = StartupError::Ok;
 	bool failTimerPending = false;
 	bool newTimerPending = false;
+	std::array<size_t, Mtb::_MAX_MODULES> modulesDeleted{}; // version of module deletion per address
+	// Version & full 'modules' response content for state=false/true
+	std::array<std::optional<std::pair<size_t, QJsonObject>>, 2> modulesCache;
+	RulesEngine rules;
+	// Inputs change from MTB-USB being processed: module, inputs before the change, time of receipt
+	struct InputsChange {
+		uint8_t addr;
+		PortMask previous;
+		std::chrono::steady_clock::time_point received;
+	};
+	std::optional<InputsChange> inputsChange;
+	HealthMonitor health;
+	SpeedTuner speedTuner;
 
 	QJsonObject mtbUsbJson() const;
-	QJsonObject mtbUsbEvent() const;
+	QJsonObject mtbUsbEvent(EventScope) const;
 	void mtbUsbProperSpeedSet();
 	void mtbUsbGotInfo();
 	void mtbUsbGotModules();
 
-	void activateModule(uint8_t addr, size_t attemptsRemaining = 5);
+	void activateModule(uint8_t addr, size_t attemptsRemaining = MTB_ACTIVATION_ATTEMPTS);
+	void activationRetry(uint8_t addr, size_t attemptsRemaining, size_t delay);
+	void warmReactivateModule(uint8_t addr);
+	void modulesMtbUsbDisconnected();
 	void moduleGotInfo(uint8_t addr, Mtb::ModuleInfo);
 	void moduleDidNotGetInfo();
 	static std::unique_ptr<MtbModule> newModule(size_t type, uint8_t addr);
+	static void moduleRemoved(uint8_t addr); // forget state bound to module being deleted/replaced
 
 	void loadConfig(const QString &filename);
+	void applyConfig();
 	void saveConfig(const QString &filename);
 
 	void mtbUsbConnect();
 
-	void clientResetOutputs(QTcpSocket*, std::function<void()> onOk,
+	void clientResetOutputs(QIODevice*, std::function<void()> onOk,
 	                        std::function<void()> onError);
 
-	void serverCmdMtbusb(QTcpSocket*, const QJsonObject&);
-	void serverCmdVersion(QTcpSocket*, const QJsonObject&);
-	void serverCmdSaveConfig(QTcpSocket*, const QJsonObject&);
-	void serverCmdLoadConfig(QTcpSocket*, const QJsonObject&);
-	void serverCmdModule(QTcpSocket*, const QJsonObject&);
-	void serverCmdModuleDelete(QTcpSocket*, const QJsonObject&);
-	void serverCmdModules(QTcpSocket*, const QJsonObject&);
-	void serverCmdModuleSubscribe(QTcpSocket*, const QJsonObject&);
-	void serverCmdMyModuleSubscribes(QTcpSocket*, const QJsonObject&);
-	void serverCmdModuleUnsubscribe(QTcpSocket*, const QJsonObject&);
-	void serverCmdModuleSetConfig(QTcpSocket*, const QJsonObject&);
-	void serverCmdModuleSpecificCommand(QTcpSocket*, const QJsonObject&);
-	void serverCmdSetAddress(QTcpSocket*, const QJsonObject&);
-	void serverCmdResetMyOutputs(QTcpSocket*, const QJsonObject&);
-	void serverCmdTopoSubscribe(QTcpSocket*, const QJsonObject&);
-	void serverCmdTopoUnsubscribe(QTcpSocket*, const QJsonObject&);
+	void serverCmdMtbusb(QIODevice*, const QJsonObject&);
+	void serverCmdMtbbusHealth(QIODevice*, const QJsonObject&);
+	void serverCmdMtbusbAutotune(QIODevice*, const QJsonObject&);
+	void serverCmdVersion(QIODevice*, const QJsonObject&);
+	void serverCmdSaveConfig(QIODevice*, const QJsonObject&);
+	void serverCmdLoadConfig(QIODevice*, const QJsonObject&);
+	void serverCmdModule(QIODevice*, const QJsonObject&);
+	void serverCmdModuleDelete(QIODevice*, const QJsonObject&);
+	void serverCmdModules(QIODevice*, const QJsonObject&);
+	void serverCmdModuleSubscribe(QIODevice*, const QJsonObject&);
+	void serverCmdMyModuleSubscribes(QIODevice*, const QJsonObject&);
+	void serverCmdModuleUnsubscribe(QIODevice*, const QJsonObject&);
+	void serverCmdModuleSetConfig(QIODevice*, const QJsonObject&);
+	void serverCmdModuleSpecificCommand(QIODevice*, const QJsonObject&);
+	void serverCmdSetAddress(QIODevice*, const QJsonObject&);
+	void serverCmdResetMyOutputs(QIODevice*, const QJsonObject&);
+	void serverCmdTopoSubscribe(QIODevice*, const QJsonObject&);
+	void serverCmdTopoUnsubscribe(QIODevice*, const QJsonObject&);
+	void serverCmdClients(QIODevice*, const QJsonObject&);
+	void serverCmdBatch(QIODevice*, const QJsonObject&);
+	void serverCmdModulesSetOutputs(QIODevice*, const QJsonObject&);
+	void serverCmdModulesDiag(QIODevice*, const QJsonObject&);
+	void serverCmdResume(QIODevice*, const QJsonObject&);
+	void serverCmdFindDccAddress(QIODevice*, const QJsonObject&);
+	void serverCmdDccSubscribe(QIODevice*, const QJsonObject&);
+	void serverCmdDccUnsubscribe(QIODevice*, const QJsonObject&);
+	void serverCmdRules(QIODevice*, const QJsonObject&);
+	void serverCmdVirtualInputs(QIODevice*, const QJsonObject&);
+	void serverCmdVirtualInputsSubscribe(QIODevice*, const QJsonObject&);
+	void serverCmdVirtualInputsUnsubscribe(QIODevice*, const QJsonObject&);
 
 	static bool validateAddrs(const QJsonArray &addrs, QJsonObject& response);
+	static bool validatePorts(const QJsonArray &ports, PortMask &mask, QJsonObject& response);
+	static bool validatePortFilters(const QJsonObject &ports, std::map<uint8_t, PortFilter> &filters,
+	                                QJsonObject& response);
+	static QJsonObject portFilterToJson(const PortFilter&);
+	static std::optional<std::vector<DccAddr>> dccAddrs(QIODevice*, const QJsonObject &request);
+	static QJsonArray dccSubscribedJson(const QIODevice*);
+	static std::optional<std::vector<QString>> virtualInputNames(QIODevice*, const QJsonObject &request);
+	static QJsonArray virtualInputsSubscribedJson(const QIODevice*);
 
 private slots:
 	void mtbUsbOnLog(QString message, Mtb::LogLevel loglevel);
@@ -108,11 +172,12 @@ private slots:
 	void mtbUsbOnInputsChange(uint8_t addr, const std::vector<uint8_t> &data);
 	void mtbUsbOnDiagStateChange(uint8_t addr, const std::vector<uint8_t> &data);
 
-	void serverReceived(QTcpSocket*, const QJsonObject&);
-	void serverClientDisconnected(QTcpSocket*);
+	void serverReceived(QIODevice*, const QJsonObject&);
+	void serverClientDisconnected(QIODevice*);
 
 	void tReconnectTick();
 	void tReactivateTick();
+	void tReconnectGraceTick();
 };
 
 #endif
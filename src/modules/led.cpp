@@ -32,43 +32,43 @@ QJsonObject MtbLed::moduleInfo(bool state, bool config) const {
 
 /* Json Set Outputs --------------------------------------------------------- */
 
-void MtbLed::jsonSetOutput(QTcpSocket *socket, const QJsonObject &request) {
-	if (!this->active) {
-		sendError(socket, request, MTB_MODULE_FAILED, "Cannot set output of inactive module!");
-		return;
-	}
-	if (this->isFirmwareUpgrading()) {
-		sendError(socket, request, MTB_MODULE_UPGRADING_FW, "Firmware of module is being upgraded!");
-		return;
-	}
-	if (this->busModuleInfo.inBootloader()) {
-		sendError(socket, request, MTB_MODULE_IN_BOOTLOADER, "Module is in bootloader!");
-		return;
-	}
-	if (this->isConfigSetting()) {
-		sendError(socket, request, MTB_MODULE_CONFIG_SETTING, "Configuration of module is being changed!");
-		return;
-	}
+bool MtbLed::validateOutputs(const QJsonObject &outputs, QJsonObject &error) const {
+	if (!this->outputsSettable(error))
+		return false;
 
-	QJsonObject outputs = QJsonSafe::safeObject(request, "outputs");
-	QMap<size_t, bool> ports; // state per port
-
-	// Validate ports
 	bool ok;
 	for (const auto &key : outputs.keys()) {
 		int port = key.toInt(&ok);
 		if ((!ok) || (port < 0) || (port >= static_cast<int>(LED_IO_CNT))) {
-			sendError(socket, request, MTB_MODULE_INVALID_PORT, "Invalid port: "+key);
-			return;
+			error = DaemonServer::error(MTB_MODULE_INVALID_PORT, "Invalid port: "+key);
+			return false;
 		}
 
 		try {
-			ports[port] = QJsonSafe::safeBool(outputs[key]);
+			QJsonSafe::safeBool(outputs[key]);
 		} catch (const JsonParseError& e) {
-			sendError(socket, request, MTB_MODULE_INVALID_PORT, "Invalid port "+key+" content: "+e.what());
-			return;
+			error = DaemonServer::error(MTB_MODULE_INVALID_PORT, "Invalid port "+key+" content: "+e.what());
+			return false;
 		}
 	}
+	return true;
+}
+
+void MtbLed::jsonSetOutput(QIODevice *socket, const QJsonObject &request) {
+	QJsonObject error;
+	if (!this->outputsSettable(error)) {
+		sendError(socket, request, error);
+		return;
+	}
+	QJsonObject outputs = QJsonSafe::safeObject(request, "outputs");
+	if (!this->validateOutputs(outputs, error)) {
+		sendError(socket, request, error);
+		return;
+	}
+
+	QMap<size_t, bool> ports; // state per port
+	for (const auto &key : outputs.keys())
+		ports[key.toInt()] = QJsonSafe::safeBool(outputs[key]);
 
 	bool send = (this->outputsWant == this->outputsConfirmed);
 	bool changed = false;
@@ -80,7 +80,7 @@ void MtbLed::jsonSetOutput(QTcpSocket *socket, const QJsonObject &request) {
 			if ((this->whoSetOutput[port] != nullptr) && (this->whoSetOutput[port] != socket))
 				this->mlog("Multiple clients set same output: "+QString::number(port),
 				           Mtb::LogLevel::Warning);
-			this->whoSetOutput[port] = socket;
+			this->setOutputOwner(this->whoSetOutput[port], socket, port);
 		}
 		this->outputsWant[port] = ports[port];
 	}
@@ -115,12 +115,13 @@ void MtbLed::setOutputs() {
 }
 
 void MtbLed::mtbBusOutputsSet(const std::vector<uint8_t>& data) {
+	const auto previous = this->outputsConfirmed;
 	this->outputsConfirmed = this->mtbDataToIo(data);
 
 	// TODO: check if output really set?
 
 	// Report ok callback to clients
-	std::vector<QTcpSocket*> ignore;
+	std::vector<QIODevice*> ignore;
 	for (const ServerRequest &sr : this->setOutputsSent) {
 		QJsonObject response{
 			{"command", "module_set_outputs"},
@@ -137,7 +138,7 @@ void MtbLed::mtbBusOutputsSet(const std::vector<uint8_t>& data) {
 	this->setOutputsSent.clear();
 
 	// Report outputs changed event to other clients
-	this->sendOutputsChanged(ioStateToJson(this->outputsConfirmed), ignore);
+	this->sendOutputsChanged(ioStateToJson(this->outputsConfirmed), diffMask(previous, this->outputsConfirmed), ignore);
 
 	// Send next outputs
 	if (this->setOutputsWaiting.empty()) {
@@ -148,15 +149,37 @@ void MtbLed::mtbBusOutputsSet(const std::vector<uint8_t>& data) {
 	}
 }
 
-QJsonObject MtbLed::ioStateToJson(const std::array<bool, LED_IO_CNT> &state) {
-	QJsonArray json;
+uint32_t MtbLed::ioPacked(const std::array<bool, LED_IO_CNT> &state) {
 	uint32_t packed = 0;
-	for (size_t i = 0; i < state.size(); i++) {
-		json.push_back(state[i]);
+	for (size_t i = 0; i < state.size(); i++)
 		if (state[i])
 			packed |= (1 << i);
+	return packed;
+}
+
+QJsonObject MtbLed::ioStateToJson(const std::array<bool, LED_IO_CNT> &state) {
+	QJsonArray json;
+	for (size_t i = 0; i < state.size(); i++)
+		json.push_back(state[i]);
+	return {{"full", json}, {"packed", static_cast<int>(ioPacked(state))}};
+}
+
+QJsonObject MtbLed::inputsDeltaJson(PortMask) const {
+	return {{"packed", static_cast<qint64>(ioPacked(this->inputs))}};
+}
+
+QJsonObject MtbLed::outputsDeltaJson(PortMask) const {
+	return {{"packed", static_cast<qint64>(ioPacked(this->outputsConfirmed))}};
+}
+
+QJsonObject MtbLed::outputsWantJson(const QJsonObject &ports) const {
+	QJsonObject result;
+	for (const auto &key : ports.keys()) {
+		const size_t port = key.toInt();
+		if (port < this->outputsWant.size())
+			result[key] = this->outputsWant[port];
 	}
-	return {{"full", json}, {"packed", static_cast<int>(packed)}};
+	return result;
 }
 
 void MtbLed::mtbBusOutputsNotSet(Mtb::CmdError error) {
@@ -176,6 +199,7 @@ void MtbLed::mtbBusOutputsNotSet(Mtb::CmdError error) {
 
 	// TODO: mark module as failed? Do anything else?
 	this->outputsConfirmed = this->outputsWant;
+	this->bumpVersion(true);
 
 	// Send next outputs
 	if (this->setOutputsWaiting.empty()) {
@@ -188,7 +212,7 @@ void MtbLed::mtbBusOutputsNotSet(Mtb::CmdError error) {
 
 /* Json Set Config ---------------------------------------------------------- */
 
-void MtbLed::jsonSetConfig(QTcpSocket *socket, const QJsonObject &request) {
+void MtbLed::jsonSetConfig(QIODevice *socket, const QJsonObject &request) {
 	if (this->configWriting.has_value()) {
 		sendError(socket, request, MTB_MODULE_ALREADY_WRITING, "Another client is writing config now!");
 		return;
@@ -227,6 +251,7 @@ void MtbLed::jsonSetConfig(QTcpSocket *socket, const QJsonObject &request) {
 }
 
 void MtbLed::mtbBusConfigWritten() {
+	this->bumpVersion();
 	this->config = this->configToWrite;
 	const ServerRequest request = this->configWriting.value();
 	this->configWriting.reset();
@@ -267,7 +292,7 @@ void MtbLed::mtbBusConfigNotWritten(Mtb::CmdError error) {
 
 /* Json Upgrade Firmware ---------------------------------------------------- */
 
-void MtbLed::jsonUpgradeFw(QTcpSocket *socket, const QJsonObject &request) {
+void MtbLed::jsonUpgradeFw(QIODevice *socket, const QJsonObject &request) {
 	if (this->isFirmwareUpgrading()) {
 		sendError(socket, request, MTB_MODULE_UPGRADING_FW, "Firmware is already being upgraded!");
 		return;
@@ -283,7 +308,7 @@ void MtbLed::jsonUpgradeFw(QTcpSocket *socket, const QJsonObject &request) {
 
 /* -------------------------------------------------------------------------- */
 
-void MtbLed::resetOutputsOfClient(QTcpSocket *socket) {
+void MtbLed::resetOutputsOfClient(QIODevice *socket) {
 	MtbModule::resetOutputsOfClient(socket);
 
 	bool send = false;
@@ -291,7 +316,7 @@ void MtbLed::resetOutputsOfClient(QTcpSocket *socket) {
 		for (size_t i = 0; i < LED_IO_CNT; i++) {
 			if (this->whoSetOutput[i] == socket) {
 				this->outputsWant[i] = this->config.value().outputsSafe[i];
-				this->whoSetOutput[i] = nullptr;
+				this->setOutputOwner(this->whoSetOutput[i], nullptr, i);
 				send = true;
 			}
 		}
@@ -304,14 +329,6 @@ void MtbLed::resetOutputsOfClient(QTcpSocket *socket) {
 	}
 }
 
-std::vector<QTcpSocket*> MtbLed::outputSetters() const {
-	std::vector<QTcpSocket*> result;
-	for (QTcpSocket* socket : this->whoSetOutput)
-		if ((socket != nullptr) && (std::find(result.begin(), result.end(), socket) == result.end()))
-			result.push_back(socket);
-	return result;
-}
-
 std::vector<uint8_t> MtbLed::ioToMtb(const std::array<bool, LED_IO_CNT> &state) {
 	// Set outputs data based on diff in this->outputsWant
 	std::vector<uint8_t> data {0, 0, 0, 0};
@@ -337,12 +354,13 @@ std::array<bool, LED_IO_CNT> MtbLed::mtbDataToIo(const std::vector<uint8_t> &mtb
 }
 
 void MtbLed::allOutputsReset() {
+	const auto previous = this->outputsConfirmed;
 	for (size_t i = 0; i < LED_IO_CNT; i++) {
 		this->outputsWant[i] = this->config.has_value() ? this->config.value().outputsSafe[i] : false;
 		this->outputsConfirmed[i] = this->outputsWant[i];
-		this->whoSetOutput[i] = nullptr;
+		this->setOutputOwner(this->whoSetOutput[i], nullptr, i);
 	}
-	this->sendOutputsChanged(ioStateToJson(this->outputsConfirmed), {});
+	this->sendOutputsChanged(ioStateToJson(this->outputsConfirmed), diffMask(previous, this->outputsConfirmed), {});
 }
 
 /* MTB-LED activation ---------------------------------------------------------
@@ -373,6 +391,7 @@ void MtbLed::mtbBusActivate(Mtb::ModuleInfo info) {
 }
 
 void MtbLed::activate() {
+	this->bumpVersion();
 	this->activating = true;
 
 	if (this->busModuleInfo.warning || this->busModuleInfo.error)
@@ -426,6 +445,7 @@ void MtbLed::configSet() {
 void MtbLed::inputsRead(const std::vector<uint8_t> &data) {
 	// Mtb module activation: got info & config set & inputs read → mark module as active
 	this->inputs = this->mtbDataToIo(data);
+	this->inputsUpdated();
 
 	mtbusb.send(
 		Mtb::CmdMtbModuleResetOutputs(
@@ -447,24 +467,44 @@ void MtbLed::outputsReset() {
 	}
 
 	for (size_t i = 0; i < LED_IO_CNT; i++)
-		this->whoSetOutput[i] = nullptr;
+		this->setOutputOwner(this->whoSetOutput[i], nullptr, i);
 
 	this->fullyActivated();
 }
 
+/* Warm reconnect ----------------------------------------------------------- */
+
+void MtbLed::warmInputsRead(const std::vector<uint8_t> &data) {
+	const auto previous = this->inputs;
+	this->inputs = this->mtbDataToIo(data);
+	const PortMask changed = diffMask(previous, this->inputs);
+	if (changed != 0)
+		this->sendInputsChanged(ioStateToJson(this->inputs), changed);
+
+	if (this->setOutputsSent.empty())
+		this->setOutputs();
+	this->warmActivated();
+}
+
 /* Inputs changed ----------------------------------------------------------- */
 
 void MtbLed::mtbBusInputsChanged(const std::vector<uint8_t> &data) {
 	if (this->active || this->activating) {
+		const auto previous = this->inputs;
 		this->inputs = this->mtbDataToIo(data);
-		this->sendInputsChanged(ioStateToJson(this->inputs));
+		this->sendInputsChanged(ioStateToJson(this->inputs), diffMask(previous, this->inputs));
 	}
 }
 
+std::optional<PortMask> MtbLed::inputsPacked() const {
+	return ioPacked(this->inputs);
+}
+
 void MtbLed::mtbUsbDisconnected() {
 	MtbModule::mtbUsbDisconnected();
 	this->allOutputsReset();
 	this->inputs.fill(false);
+	this->inputsUpdated();
 }
 
 /* MtbLedConfig ------------------------------------------------------------- */
@@ -519,11 +559,6 @@ void MtbLedConfig::fromMtbUsb(const std::vector<uint8_t> &data) {
 		this->brightness[i] = data[i+4];
 }
 
-void MtbLed::reactivateCheck() {
-	if ((!this->activating) && (this->activationsRemaining > 0) && (!this->active))
-		this->activate();
-}
-
 /* Configuration ------------------------------------------------------------ */
 
 void MtbLed::loadConfig(const QJsonObject &json) {
@@ -39,7 +39,7 @@ protected:
 
 	std::optional<MtbLedConfig> config;
 	std::optional<MtbLedConfig> configToWrite;
-	std::array<QTcpSocket*, LED_IO_CNT> whoSetOutput;
+	std::array<QIODevice*, LED_IO_CNT> whoSetOutput;
 
 	std::vector<ServerRequest> setOutputsWaiting;
 	std::vector<ServerRequest> setOutputsSent;
@@ -47,12 +47,17 @@ protected:
 	void configSet();
 
 	void inputsRead(const std::vector<uint8_t>&);
+	void warmInputsRead(const std::vector<uint8_t>&) override;
 	void outputsReset();
 	void outputsSet(uint8_t, const std::vector<uint8_t>&);
+	static uint32_t ioPacked(const std::array<bool, LED_IO_CNT>&);
 	static QJsonObject ioStateToJson(const std::array<bool, LED_IO_CNT>&);
+	QJsonObject inputsDeltaJson(PortMask changed) const override;
+	QJsonObject outputsDeltaJson(PortMask changed) const override;
+	QJsonObject outputsWantJson(const QJsonObject &ports) const override;
 
-	void jsonSetOutput(QTcpSocket*, const QJsonObject&) override;
-	void jsonUpgradeFw(QTcpSocket*, const QJsonObject&) override;
+	void jsonSetOutput(QIODevice*, const QJsonObject&) override;
+	void jsonUpgradeFw(QIODevice*, const QJsonObject&) override;
 
 	void setOutputs();
 	void mtbBusOutputsSet(const std::vector<uint8_t> &data);
@@ -60,7 +65,7 @@ protected:
 	void mtbBusConfigWritten();
 	void mtbBusConfigNotWritten(Mtb::CmdError);
 
-	void activate();
+	void activate() override;
 
 	static std::vector<uint8_t> ioToMtb(const std::array<bool, LED_IO_CNT>&);
 	static std::array<bool, LED_IO_CNT> mtbDataToIo(const std::vector<uint8_t>& mtbBusData);
@@ -71,20 +76,20 @@ public:
 	MtbLed(uint8_t addr);
 	~MtbLed() override = default;
 	QJsonObject moduleInfo(bool state, bool config) const override;
+	bool validateOutputs(const QJsonObject &outputs, QJsonObject &error) const override;
 
 	void mtbBusActivate(Mtb::ModuleInfo) override;
 	void mtbBusInputsChanged(const std::vector<uint8_t>&) override;
+	std::optional<PortMask> inputsPacked() const override;
 	void mtbUsbDisconnected() override;
 
-	void jsonSetConfig(QTcpSocket*, const QJsonObject&) override;
+	void jsonSetConfig(QIODevice*, const QJsonObject&) override;
 
 	void loadConfig(const QJsonObject&) override;
 	void saveConfig(QJsonObject&) const override;
 
-	std::vector<QTcpSocket*> outputSetters() const override;
-	void resetOutputsOfClient(QTcpSocket*) override;
+	void resetOutputsOfClient(QIODevice*) override;
 	void allOutputsReset() override;
-	void reactivateCheck() override;
 };
 
 #endif
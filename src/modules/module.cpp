@@ -1,10 +1,18 @@
 #include <QJsonArray>
+#include <algorithm>
 #include "module.h"
 #include "main.h"
 #include "logging.h"
 #include "utils.h"
+#include "dispatch.h"
 
-MtbModule::MtbModule(uint8_t addr) : address(addr), name("Module "+QString::number(addr)) {}
+size_t MtbModule::lastVersion = 0;
+std::map<QString, size_t> MtbModule::dvCacheTtl;
+size_t MtbModule::dvCacheTtlDefault = 0;
+std::function<void(uint8_t addr, PortMask current)> MtbModule::onInputsChanged;
+
+MtbModule::MtbModule(uint8_t addr)
+	: address(addr), name("Module "+QString::number(addr)), changeVersion(MtbModule::newVersion()) {}
 
 MtbModuleType MtbModule::moduleType() const { return this->type; }
 
@@ -13,6 +21,10 @@ bool MtbModule::isRebooting() const { return this->rebooting.rebooting; }
 bool MtbModule::isBeacon() const { return this->beacon; }
 bool MtbModule::isActivating() const { return this->activating; }
 
+bool MtbModule::isQuarantined() const {
+	return (this->quarantinedUntil.has_value()) && (std::chrono::steady_clock::now() < this->quarantinedUntil.value());
+}
+
 QJsonObject MtbModule::moduleInfo(bool, bool) const {
 	QJsonObject obj;
 	obj["address"] = this->address;
@@ -39,15 +51,42 @@ QJsonObject MtbModule::moduleInfo(bool, bool) const {
 		obj["fw_deprecated"] = this->fwDeprecated();
 	} else {
 		obj["state"] = (this->isRebooting()) ? "rebooting" : "inactive";
+		if (this->quarantinedUntil.has_value())
+			obj["quarantined"] = true;
 	}
 
 	return obj;
 }
 
+/* Versioning -------------------------------------------------------------- */
+
+size_t MtbModule::newVersion() { return ++MtbModule::lastVersion; }
+size_t MtbModule::modulesVersion() { return MtbModule::lastVersion; }
+size_t MtbModule::version() const { return this->changeVersion; }
+
+void MtbModule::bumpVersion(bool ioOnly) {
+	this->changeVersion = MtbModule::newVersion();
+	this->infoCache[1].reset();
+	if (!ioOnly)
+		this->infoCache[0].reset();
+}
+
+QJsonObject MtbModule::cachedModuleInfo(bool state) const {
+	std::optional<QJsonObject> &cached = this->infoCache[state];
+	if (!cached.has_value())
+		cached = this->moduleInfo(state, true);
+	return cached.value();
+}
+
+/* -------------------------------------------------------------------------- */
+
 void MtbModule::mtbBusActivate(Mtb::ModuleInfo moduleInfo) {
+	this->bumpVersion();
 	this->activationsRemaining = MTB_MODULE_ACTIVATIONS;
 	this->busModuleInfo = moduleInfo;
-	this->rebooting.activatedByMtbUsb = true;
+	this->dvCacheInvalidate();
+	if ((this->rebootWait.waiting) && (!this->rebootWait.bootloader))
+		this->rebootWaitStop(); // activated by MTB-USB (e.g. NewModule event processed by the daemon)
 	this->type = static_cast<MtbModuleType>(moduleInfo.type);
 
 	if (this->fwDeprecated()) {
@@ -58,19 +97,101 @@ void MtbModule::mtbBusActivate(Mtb::ModuleInfo moduleInfo) {
 
 void MtbModule::mtbBusLost() {
 	this->mlog("Lost", Mtb::LogLevel::Info);
+	this->bumpVersion();
 	this->activating = false;
 	this->active = false;
 	this->activationsRemaining = 0;
+	this->dvCacheInvalidate();
+	virtualInputs.update(this->address, 0); // inputs of lost module are unknown
+	this->sendModuleInfo();
+}
+
+void MtbModule::mtbUsbModuleFail() {
+	// Only failures reported by MTB-USB count, deliberate losses (reboot, ...) do not
+	const auto now = std::chrono::steady_clock::now();
+	this->losses.push_back(now);
+	while (now - this->losses.front() > std::chrono::milliseconds(MTB_MODULE_FLAP_WINDOW_MS))
+		this->losses.pop_front();
+	if (this->losses.size() >= MTB_MODULE_FLAPS) {
+		this->mlog("Lost "+QString::number(this->losses.size())+" times within "+
+		           QString::number(MTB_MODULE_FLAP_WINDOW_MS/1000)+" s, quarantined for "+
+		           QString::number(MTB_MODULE_QUARANTINE_MS/1000)+" s", Mtb::LogLevel::Warning);
+		this->quarantinedUntil = now + std::chrono::milliseconds(MTB_MODULE_QUARANTINE_MS);
+		this->losses.clear();
+	}
+	this->mtbBusLost();
+}
+
+bool MtbModule::quarantineEnded() {
+	if ((!this->quarantinedUntil.has_value()) || (this->isQuarantined()))
+		return false;
+	this->bumpVersion();
+	this->quarantinedUntil.reset();
+	this->mlog("Quarantine ended", Mtb::LogLevel::Info);
 	this->sendModuleInfo();
+	return true;
 }
 
 void MtbModule::mtbUsbDisconnected() {
 	this->active = false;
+	this->dvCacheInvalidate();
+	this->bumpVersion();
+}
+
+/* Warm reconnect: module kept active through short MTB-USB disconnection
+ * 1) General information are read (by daemon, type & FW must be unchanged)
+ * 2) Inputs are get
+ * 3) Wanted outputs are set again, if any (module could have reset them)
+ */
+
+bool MtbModule::mtbUsbWarmReconnect(Mtb::ModuleInfo info) {
+	if ((!this->active) || (this->activating) || (this->isFirmwareUpgrading()) || (this->isRebooting()) ||
+	    (info.type != static_cast<uint8_t>(this->type)) || (info.inBootloader()) ||
+	    (info.uint_fw_version() != this->busModuleInfo.uint_fw_version()))
+		return false;
+
+	const bool error = info.error, warning = info.warning;
+	info.error = this->busModuleInfo.error;
+	info.warning = this->busModuleInfo.warning;
+	this->bumpVersion();
+	this->busModuleInfo = info;
+	this->dvCacheInvalidate();
+	this->mtbBusDiagStateChanged(error, warning); // sends module event when changed
+	this->warmActivate();
+	return true;
+}
+
+void MtbModule::warmActivate() {
+	mtbusb.send(
+		Mtb::CmdMtbModuleGetInputs(
+			this->address,
+			{[this](uint8_t, const std::vector<uint8_t>& data, void*) { this->warmInputsRead(data); }},
+			{[this](Mtb::CmdError, void*) { this->warmActivationFailed(); }}
+		)
+	);
+}
+
+void MtbModule::warmInputsRead(const std::vector<uint8_t>&) {
+	this->warmActivationFailed();
+}
+
+void MtbModule::warmActivated() {
+	this->mlog("Revalidated after MTB-USB reconnect", Mtb::LogLevel::Info);
+}
+
+void MtbModule::warmActivationFailed() {
+	this->mlog("Revalidation after MTB-USB reconnect failed, activating...", Mtb::LogLevel::Warning);
+	this->mtbUsbDisconnected();
+	this->mtbBusActivate(this->busModuleInfo);
 }
 
 void MtbModule::mtbBusInputsChanged(const std::vector<uint8_t>&) {
 }
 
+std::optional<PortMask> MtbModule::inputsPacked() const {
+	return std::nullopt;
+}
+
 void MtbModule::mtbBusDiagStateChanged(const std::vector<uint8_t>& data) {
 	if (data.size() < 1)
 		return;
@@ -91,54 +212,236 @@ void MtbModule::mtbBusDiagStateChanged(bool isError, bool isWarning) {
 	}
 
 	if (changed) {
+		this->bumpVersion();
 		this->sendModuleInfo();
 		this->mlog("Module diag state changed: warning="+QString::number(this->busModuleInfo.warning)+", error="+
 		           QString::number(this->busModuleInfo.error), Mtb::LogLevel::Warning);
 	}
 }
 
-void MtbModule::jsonCommand(QTcpSocket *socket, const QJsonObject &request, bool hasWriteAccess) {
+void MtbModule::jsonCommand(QIODevice *socket, const QJsonObject &request, bool hasWriteAccess) {
 	QString command = QJsonSafe::safeString(request, "command");
 
-	// Commands for clients with read-only access
-	if (command == "module_diag")
-		return this->jsonGetDiag(socket, request);
+	struct Command {
+		void (MtbModule::*handler)(QIODevice*, const QJsonObject&);
+		bool write; // requires write access
+	};
+	static constexpr DispatchEntry<Command> commands[] = {
+		{"module_beacon", {&MtbModule::jsonBeacon, true}},
+		{"module_diag", {&MtbModule::jsonGetDiag, false}},
+		{"module_output_pulse", {&MtbModule::jsonOutputPulse, true}},
+		{"module_output_sequence", {&MtbModule::jsonOutputSequence, true}},
+		{"module_reboot", {&MtbModule::jsonReboot, true}},
+		{"module_set_address", {&MtbModule::jsonSetAddress, true}},
+		{"module_set_config", {&MtbModule::jsonSetConfig, true}},
+		{"module_set_outputs", {&MtbModule::jsonSetOutput, true}},
+		{"module_specific_command", {&MtbModule::jsonSpecificCommand, true}},
+		{"module_upgrade_fw", {&MtbModule::jsonUpgradeFw, true}},
+	};
+	static_assert(dispatchSorted(commands), "Module commands must be sorted by name!");
 
-	if (!hasWriteAccess)
+	const Command *cmd = dispatchFind(commands, command);
+	if (cmd == nullptr) // explicitly answer "unknown command"
+		return sendError(socket, request, MTB_UNKNOWN_COMMAND, "Unknown command!");
+	if ((cmd->write) && (!hasWriteAccess))
 		return sendAccessDenied(socket, request);
+	(this->*(cmd->handler))(socket, request);
+}
 
-	// Commands for clients with write access
-	if (command == "module_set_outputs")
-		return this->jsonSetOutput(socket, request);
-	if (command == "module_set_config")
-		return this->jsonSetConfig(socket, request);
-	if (command == "module_upgrade_fw")
-		return this->jsonUpgradeFw(socket, request);
-	if (command == "module_reboot")
-		return this->jsonReboot(socket, request);
-	if (command == "module_specific_command")
-		return this->jsonSpecificCommand(socket, request);
-	if (command == "module_beacon")
-		return this->jsonBeacon(socket, request);
-	if (command == "module_set_address")
-		return this->jsonSetAddress(socket, request);
-
-	// Explicitly answer "unknown command"
-	sendError(socket, request, MTB_UNKNOWN_COMMAND, "Unknown command!");
-}
-
-void MtbModule::jsonSetOutput(QTcpSocket *socket, const QJsonObject &request) {
+void MtbModule::jsonSetOutput(QIODevice *socket, const QJsonObject &request) {
 	sendError(socket, request, MTB_MODULE_UNSUPPORTED_COMMAND, "This module does not support output setting!");
 }
 
-void MtbModule::jsonSetConfig(QTcpSocket*, const QJsonObject &json) {
+bool MtbModule::validateOutputs(const QJsonObject&, QJsonObject &error) const {
+	error = DaemonServer::error(MTB_MODULE_UNSUPPORTED_COMMAND, "This module does not support output setting!");
+	return false;
+}
+
+QJsonObject MtbModule::outputsWantJson(const QJsonObject&) const {
+	return {};
+}
+
+/* Timed outputs ------------------------------------------------------------ */
+
+void MtbModule::jsonOutputPulse(QIODevice *socket, const QJsonObject &request) {
+	// Pulse = outputs set for 'duration_ms', then returned to the state before the pulse
+	const QJsonObject outputs = QJsonSafe::safeObject(request, "outputs");
+	const size_t duration = QJsonSafe::safeUInt(request, "duration_ms");
+	if (duration > MTB_OUTPUT_SEQUENCE_MAX_DELAY_MS)
+		return sendError(socket, request, MTB_INVALID_JSON,
+		                 "'duration_ms' max "+QString::number(MTB_OUTPUT_SEQUENCE_MAX_DELAY_MS));
+
+	QJsonObject error;
+	if (!this->validateOutputs(outputs, error))
+		return sendError(socket, request, error);
+
+	this->startOutputSequence(socket, request, {outputs, this->outputsWantJson(outputs)}, {duration, 0});
+}
+
+void MtbModule::jsonOutputSequence(QIODevice *socket, const QJsonObject &request) {
+	const QJsonArray steps = QJsonSafe::safeArray(request, "steps");
+	if ((steps.empty()) || (static_cast<size_t>(steps.size()) > MTB_OUTPUT_SEQUENCE_MAX_STEPS))
+		return sendError(socket, request, MTB_INVALID_JSON,
+		                 "'steps' must contain 1-"+QString::number(MTB_OUTPUT_SEQUENCE_MAX_STEPS)+" steps");
+
+	std::vector<QJsonObject> outputs;
+	std::vector<size_t> delays;
+	for (int i = 0; i < steps.size(); i++) {
+		const QJsonObject step = QJsonSafe::safeObject(steps[i]);
+		const size_t delay = step.contains("delay_ms") ? QJsonSafe::safeUInt(step, "delay_ms") : 0;
+		if (delay > MTB_OUTPUT_SEQUENCE_MAX_DELAY_MS)
+			return sendError(socket, request, MTB_INVALID_JSON,
+			                 "'delay_ms' max "+QString::number(MTB_OUTPUT_SEQUENCE_MAX_DELAY_MS));
+
+		QJsonObject error;
+		outputs.push_back(QJsonSafe::safeObject(step, "outputs"));
+		if (!this->validateOutputs(outputs.back(), error)) {
+			QJsonObject response = jsonOkResponse(request);
+			response["status"] = "error";
+			response["error"] = error;
+			response["step"] = i;
+			return server.send(socket, response);
+		}
+		delays.push_back(delay);
+	}
+
+	this->startOutputSequence(socket, request, outputs, delays);
+}
+
+void MtbModule::startOutputSequence(QIODevice *socket, const QJsonObject &request,
+                                    const std::vector<QJsonObject> &outputs, const std::vector<size_t> &delays) {
+	QJsonArray subrequests;
+	size_t duration = 0;
+	for (size_t i = 0; i < outputs.size(); i++) {
+		subrequests.push_back(QJsonObject{
+			{"command", "module_set_outputs"},
+			{"type", "request"},
+			{"address", this->address},
+			{"outputs", outputs[i]},
+		});
+		duration += delays[i];
+	}
+
+	const std::vector<int> ids = server.beginBatch(
+		socket, request, subrequests,
+		[addr = this->address](QJsonObject &response, const std::vector<QJsonObject> &responses) {
+			QJsonArray steps;
+			for (const QJsonObject &stepResponse : responses) {
+				QJsonObject step{{"status", stepResponse["status"]}};
+				if (stepResponse["status"] == "ok")
+					step["outputs"] = stepResponse["outputs"];
+				else
+					step["error"] = stepResponse["error"];
+				steps.push_back(step);
+			}
+			response["address"] = addr;
+			response["steps"] = steps;
+		},
+		duration + SERVER_BATCH_TIMEOUT_MS
+	);
+	if (ids.size() != outputs.size())
+		return;
+
+	auto sequence = std::make_shared<OutputSequence>();
+	sequence->socket = socket;
+	sequence->delays = delays;
+	for (size_t i = 0; i < ids.size(); i++) {
+		QJsonObject step = subrequests[i].toObject();
+		step["id"] = ids[i];
+		sequence->steps.push_back(step);
+	}
+	sequence->start = std::chrono::steady_clock::now();
+	this->outputSequences.push_back(sequence);
+	this->outputSequenceStep(sequence);
+}
+
+void MtbModule::outputSequenceStep(const std::shared_ptr<OutputSequence> &sequence) {
+	// Steps are scheduled relative to start of the sequence, so delays do not accumulate jitter
+	while (sequence->next < sequence->steps.size()) {
+		const size_t i = sequence->next;
+		sequence->next++;
+		try {
+			this->jsonSetOutput(sequence->socket, sequence->steps[i]);
+		} catch (const JsonParseError &e) {
+			sendError(sequence->socket, sequence->steps[i], MTB_INVALID_JSON, "JSON parse error: "+QString(e.what()));
+		}
+		sequence->at += std::chrono::milliseconds(sequence->delays[i]);
+
+		if ((sequence->next < sequence->steps.size()) && (sequence->delays[i] > 0)) {
+			const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+				sequence->start + sequence->at - std::chrono::steady_clock::now());
+			std::weak_ptr<OutputSequence> weak = sequence;
+			// Sequence is owned by the module -> module exists as long as sequence exists
+			QTimer::singleShot(std::max<int>(remaining.count(), 0), Qt::PreciseTimer, &server, [this, weak]() {
+				if (const std::shared_ptr<OutputSequence> sequence = weak.lock())
+					this->outputSequenceStep(sequence);
+			});
+			return;
+		}
+	}
+
+	this->outputSequences.erase(
+		std::remove(this->outputSequences.begin(), this->outputSequences.end(), sequence),
+		this->outputSequences.end()
+	);
+}
+
+void MtbModule::cancelOutputSequences(const QIODevice *socket) {
+	if (this->outputSequences.empty())
+		return;
+	std::vector<std::shared_ptr<OutputSequence>> cancelled;
+	for (const auto &sequence : this->outputSequences)
+		if (sequence->socket == socket)
+			cancelled.push_back(sequence);
+	if (cancelled.empty())
+		return;
+
+	this->outputSequences.erase(
+		std::remove_if(this->outputSequences.begin(), this->outputSequences.end(),
+		               [socket](const auto &sequence) { return sequence->socket == socket; }),
+		this->outputSequences.end()
+	);
+
+	// Answer remaining steps, so the client gets the sequence response immediately
+	for (const auto &sequence : cancelled)
+		for (size_t i = sequence->next; i < sequence->steps.size(); i++)
+			sendError(sequence->socket, sequence->steps[i], MTB_MODULE_SEQUENCE_CANCELLED,
+			          "Output sequence cancelled");
+}
+
+bool MtbModule::outputsSettable(QJsonObject &error) const {
+	if (!this->active)
+		error = DaemonServer::error(MTB_MODULE_FAILED, "Cannot set output of inactive module!");
+	else if (this->isFirmwareUpgrading())
+		error = DaemonServer::error(MTB_MODULE_UPGRADING_FW, "Firmware of module is being upgraded!");
+	else if (this->busModuleInfo.inBootloader())
+		error = DaemonServer::error(MTB_MODULE_IN_BOOTLOADER, "Module is in bootloader!");
+	else if (this->isConfigSetting())
+		error = DaemonServer::error(MTB_MODULE_CONFIG_SETTING, "Configuration of module is being changed!");
+	else
+		return true;
+	return false;
+}
+
+void MtbModule::setOutputOwner(QIODevice *&owner, QIODevice *socket, size_t port) const {
+	if (owner == socket)
+		return;
+	if (owner != nullptr)
+		server.outputReleased(owner, this->address, port);
+	if (socket != nullptr)
+		server.outputOwned(socket, this->address, port);
+	owner = socket;
+}
+
+void MtbModule::jsonSetConfig(QIODevice*, const QJsonObject &json) {
+	this->bumpVersion();
 	if (json.contains("type_code"))
 		this->type = static_cast<MtbModuleType>(QJsonSafe::safeUInt(json, "type_code"));
 	if (json.contains("name"))
 		this->name = QJsonSafe::safeString(json, "name");
 }
 
-void MtbModule::jsonSetAddress(QTcpSocket *socket, const QJsonObject &request) {
+void MtbModule::jsonSetAddress(QIODevice *socket, const QJsonObject &request) {
 	if (this->isFirmwareUpgrading())
 		return sendError(socket, request, MTB_MODULE_UPGRADING_FW, "Firmware of module is being upgraded!");
 	if (this->busModuleInfo.inBootloader())
@@ -166,11 +469,11 @@ void MtbModule::jsonSetAddress(QTcpSocket *socket, const QJsonObject &request) {
 	);
 }
 
-void MtbModule::jsonUpgradeFw(QTcpSocket *socket, const QJsonObject &request) {
+void MtbModule::jsonUpgradeFw(QIODevice *socket, const QJsonObject &request) {
 	sendError(socket, request, MTB_MODULE_UNSUPPORTED_COMMAND, "This module does not support firmware upgrading!");
 }
 
-void MtbModule::jsonReboot(QTcpSocket *socket, const QJsonObject &request) {
+void MtbModule::jsonReboot(QIODevice *socket, const QJsonObject &request) {
 	if (this->isRebooting())
 		return sendError(socket, request, MTB_MODULE_REBOOTING, "Already rebooting!");
 
@@ -195,6 +498,20 @@ void MtbModule::jsonReboot(QTcpSocket *socket, const QJsonObject &request) {
 	);
 }
 
+MtbOutputType jsonOutputType(const QJsonObject &json) {
+	static constexpr DispatchEntry<MtbOutputType> types[] = {
+		{"flicker", MtbOutputType::Flicker},
+		{"plain", MtbOutputType::Plain},
+		{"s-com", MtbOutputType::SCom},
+	};
+	static_assert(dispatchSorted(types), "Output types must be sorted by name!");
+
+	const MtbOutputType *type = dispatchFind(types, json["type"].toString());
+	if (type == nullptr)
+		throw JsonParseError("unknown output type");
+	return *type;
+}
+
 QString moduleTypeToStr(MtbModuleType type) {
 	switch (type) {
 	case MtbModuleType::Univ2ir: return "MTB-UNI v2 IR";
@@ -208,40 +525,87 @@ QString moduleTypeToStr(MtbModuleType type) {
 	}
 }
 
-void MtbModule::sendInputsChanged(QJsonObject inputs) const {
-	QJsonObject json{
-		{"command", "module_inputs_changed"},
+/* Inputs/outputs changed events ---------------------------------------------
+ * Subscribers with delta subscription get only changed ports, other
+ * subscribers get full state. Changed ports are computed only when someone
+ * needs them (delta subscriber or journal), the journal stores them next to
+ * the full event and delta event is assembled on delivery. 'seq' is counted
+ * per subscriber: only events really delivered to the client increment it,
+ * so any gap means a lost event. Delivery rules are shared with journal
+ * replay (EventJournal::ioEventFor).
+ */
+
+QJsonObject MtbModule::ioChangedEvent(const QString &command, const QString &key, const QJsonObject &state) const {
+	return {
+		{"command", command},
 		{"type", "event"},
-		{"module_inputs_changed", QJsonObject{
+		{command, QJsonObject{
 			{"address", this->address},
 			{"type", moduleTypeToStr(this->type)},
 			{"type_code", static_cast<int>(this->type)},
-			{"inputs", inputs},
-		}}
+			{key, state},
+		}},
 	};
+}
 
-	for (auto socket : subscribes[this->address])
-		server.send(socket, json);
+bool MtbModule::ioDeltaNeeded() const {
+	if (journal.enabled())
+		return true;
+	const std::vector<Subscriber> &subscribers = subscriptions.moduleSubscribers(this->address);
+	return std::any_of(subscribers.begin(), subscribers.end(),
+	                   [](const Subscriber &subscriber) { return subscriber.delta; });
 }
 
-void MtbModule::sendOutputsChanged(QJsonObject outputs, const std::vector<QTcpSocket*>& ignore) const {
-	QJsonObject json{
-		{"command", "module_outputs_changed"},
-		{"type", "event"},
-		{"module_outputs_changed", QJsonObject{
-			{"address", this->address},
-			{"type", moduleTypeToStr(this->type)},
-			{"type_code", static_cast<int>(this->type)},
-			{"outputs", outputs},
-		}}
-	};
+void MtbModule::sendIoChanged(QJsonObject &event, const JournalIo &io) {
+	journal.recordIo(event, this->address, io);
 
-	for (auto socket : subscribes[this->address])
-		if (std::find(ignore.begin(), ignore.end(), socket) == ignore.end())
-			server.send(socket, json);
+	for (Subscriber &subscriber : subscriptions.moduleSubscribers(this->address)) {
+		const uint64_t connection = server.connectionId(subscriber.socket);
+		if (std::optional<QJsonObject> result = EventJournal::ioEventFor(event, io, subscriber, connection))
+			server.send(subscriber.socket, result.value());
+	}
+}
+
+void MtbModule::inputsUpdated() const {
+	if (const std::optional<PortMask> inputs = this->inputsPacked())
+		virtualInputs.update(this->address, inputs.value());
+}
+
+void MtbModule::sendInputsChanged(QJsonObject inputs, PortMask changed) {
+	this->inputsUpdated();
+	const std::optional<PortMask> current = this->inputsPacked();
+	if ((current) && (MtbModule::onInputsChanged))
+		MtbModule::onInputsChanged(this->address, current.value());
+	this->bumpVersion(true);
+	QJsonObject json = this->ioChangedEvent("module_inputs_changed", "inputs", inputs);
+	JournalIo io{false, changed, std::nullopt, {}};
+	if (this->ioDeltaNeeded())
+		io.delta = this->inputsDeltaJson(changed);
+	this->sendIoChanged(json, io);
+}
+
+void MtbModule::sendOutputsChanged(QJsonObject outputs, PortMask changed,
+                                   const std::vector<QIODevice*>& ignore) {
+	this->bumpVersion(true);
+	QJsonObject json = this->ioChangedEvent("module_outputs_changed", "outputs", outputs);
+	JournalIo io{true, changed, std::nullopt, {}};
+	if (this->ioDeltaNeeded())
+		io.delta = this->outputsDeltaJson(changed);
+	for (const QIODevice *socket : ignore)
+		io.ignore.push_back(server.connectionId(socket));
+	this->sendIoChanged(json, io);
+}
+
+QJsonObject MtbModule::inputsDeltaJson(PortMask) const {
+	return {};
+}
+
+QJsonObject MtbModule::outputsDeltaJson(PortMask) const {
+	return {};
 }
 
 void MtbModule::loadConfig(const QJsonObject &json) {
+	this->bumpVersion();
 	this->name = QJsonSafe::safeString(json, "name");
 	this->type = static_cast<MtbModuleType>(QJsonSafe::safeUInt(json, "type"));
 }
@@ -251,38 +615,39 @@ void MtbModule::saveConfig(QJsonObject &json) const {
 	json["type"] = static_cast<int>(this->type);
 }
 
-void MtbModule::sendModuleInfo(QTcpSocket *ignore, bool sendConfig) const {
+void MtbModule::sendModuleInfo(QIODevice *ignore, bool sendConfig) const {
 	QJsonObject json{
 		{"command", "module"},
 		{"type", "event"},
 		{"module", this->moduleInfo(true, sendConfig)},
 	};
+	journal.record(json, EventScope::ModuleOrTopology, this->address);
 
 	// For simplicity, send module's 'state' to all clients, altrough clients with topology-only
 	// subscription probably don't need the state.
-	std::unordered_set<QTcpSocket*> sockets(topoSubscribes);
-	sockets.insert(subscribes[this->address].begin(), subscribes[this->address].end());
-	for (auto socket : sockets)
+	subscriptions.forModuleOrTopology(this->address, [ignore, &json](QIODevice *socket) {
 		if (socket != ignore)
 			server.send(socket, json);
+	});
 }
 
-void MtbModule::resetOutputsOfClient(QTcpSocket*) {}
+void MtbModule::resetOutputsOfClient(QIODevice*) {}
 
-void MtbModule::clientDisconnected(QTcpSocket *socket) {
+void MtbModule::clientDisconnected(QIODevice *socket) {
+	this->cancelOutputSequences(socket);
 	if ((this->configWriting.has_value()) && (this->configWriting.value().socket == socket))
 		this->configWriting->socket = nullptr;
 	if ((this->fwUpgrade.fwUpgrading.has_value()) && (this->fwUpgrade.fwUpgrading.value().socket == socket))
 		this->fwUpgrade.fwUpgrading->socket = nullptr;
 }
 
-std::vector<QTcpSocket*> MtbModule::outputSetters() const {
-	return {};
-}
-
 bool MtbModule::isConfigSetting() const { return this->configWriting.has_value(); }
 
-void MtbModule::jsonGetDiag(QTcpSocket *socket, const QJsonObject &request) {
+void MtbModule::jsonGetDiag(QIODevice *socket, const QJsonObject &request) {
+	this->getDiag(socket, request, false);
+}
+
+void MtbModule::getDiag(QIODevice *socket, const QJsonObject &request, bool lowPriority) {
 	uint8_t dv_num = 0;
 	if (request.contains("DVnum")) {
 		dv_num = QJsonSafe::safeUInt(request, "DVnum");
@@ -293,41 +658,139 @@ void MtbModule::jsonGetDiag(QTcpSocket *socket, const QJsonObject &request) {
 		dv_num = dv.value();
 	}
 
-	mtbusb.send(
-		Mtb::CmdMtbModuleGetDiagValue(
-			this->address, dv_num,
-			{[this, socket, request](uint8_t, uint8_t dvi, const std::vector<uint8_t> &data, void*) {
-				QJsonObject response = jsonOkResponse(request);
-				response["DVnum"] = dvi;
-				response["DVkey"] = this->DVToStr(dvi);
-				response["DVvalue"] = this->dvRepr(dvi, data);
+	size_t ttl = this->dvTtl(dv_num);
+	if (request.contains("max_age_ms"))
+		ttl = std::min<size_t>(ttl, QJsonSafe::safeUInt(request, "max_age_ms"));
 
-				QJsonArray dataAr;
-				for (const uint8_t byte : data)
-					dataAr.push_back(byte);
-				response["DVvalueRaw"] = dataAr;
+	this->dvRequest(dv_num, ttl, lowPriority, {
+		[this, socket, request, dv_num](const std::vector<uint8_t> &data, std::chrono::milliseconds age) {
+			server.send(socket, this->dvResponse(request, dv_num, data, age));
+		},
+		[socket, request](Mtb::CmdError error) { sendError(socket, request, error); },
+	});
+}
 
-				server.send(socket, response);
+void MtbModule::readDv(uint8_t dvi, std::function<void(const std::vector<uint8_t>&)> onOk,
+                       std::function<void(Mtb::CmdError)> onError) {
+	this->dvRequest(dvi, this->dvTtl(dvi), true, {
+		[onOk](const std::vector<uint8_t> &data, std::chrono::milliseconds) { onOk(data); },
+		onError,
+	});
+}
 
-				if (dvi == Mtb::DVCommon::State) {
-					this->mtbBusDiagStateChanged(data);
-				} else if ((dvi == Mtb::DVCommon::Errors) || (dvi == Mtb::DVCommon::Warnings)) {
-					bool anyNonZero = false;
-					for (uint8_t byte : data)
-						if (byte != 0)
-							anyNonZero = true;
-
-					if (dvi == Mtb::DVCommon::Errors)
-						this->mtbBusDiagStateChanged(anyNonZero, this->busModuleInfo.warning);
-					else if (dvi == Mtb::DVCommon::Warnings)
-						this->mtbBusDiagStateChanged(this->busModuleInfo.error, anyNonZero);
-				}
-			}},
-			{[socket, request](Mtb::CmdError error, void*) {
-				sendError(socket, request, error);
-			}}
-		)
+size_t MtbModule::dvTtl(uint8_t dvi) const {
+	const auto it = MtbModule::dvCacheTtl.find(this->DVToStr(dvi));
+	return (it != MtbModule::dvCacheTtl.end()) ? it->second : MtbModule::dvCacheTtlDefault;
+}
+
+void MtbModule::dvRequest(uint8_t dvi, size_t ttl, bool lowPriority, DvRequest &&request) {
+	DvCacheEntry &entry = this->dvCache[dvi];
+	if (entry.received.has_value()) {
+		const auto age = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - entry.received.value());
+		if (static_cast<size_t>(age.count()) < ttl)
+			return request.onOk(entry.data, age);
+	}
+
+	entry.waiting.push_back(std::move(request));
+	// Command already on the bus, response is sent to all waiting requests. Normal-priority request
+	// is not merged to low-priority command only, it would wait behind all other traffic.
+	if ((entry.pending > 0) && ((lowPriority) || (entry.normalPending)))
+		return;
+
+	entry.pending++;
+	if (!lowPriority)
+		entry.normalPending = true;
+	Mtb::CmdMtbModuleGetDiagValue cmd(
+		this->address, dvi,
+		{[this, dvi, lowPriority](uint8_t, uint8_t, const std::vector<uint8_t> &data, void*) {
+			this->dvReceived(dvi, data, lowPriority);
+		}},
+		{[this, dvi, lowPriority](Mtb::CmdError error, void*) {
+			this->dvNotReceived(dvi, error, lowPriority);
+		}}
 	);
+	if (lowPriority)
+		mtbusb.sendLowPriority(std::move(cmd));
+	else
+		mtbusb.send(std::move(cmd));
+}
+
+std::vector<uint8_t> MtbModule::knownDVs() const {
+	std::vector<uint8_t> result;
+	for (const uint8_t dv : Mtb::dvsCommon.keys())
+		result.push_back(dv);
+	return result;
+}
+
+void MtbModule::dvReceived(uint8_t dvi, const std::vector<uint8_t> &data, bool lowPriority) {
+	DvCacheEntry &entry = this->dvCache[dvi];
+	entry.pending--;
+	if (!lowPriority)
+		entry.normalPending = false;
+	entry.data = data;
+	entry.received = std::chrono::steady_clock::now();
+	const std::vector<DvRequest> waiting = std::move(entry.waiting);
+	entry.waiting.clear();
+	for (const DvRequest &request : waiting)
+		request.onOk(data, std::chrono::milliseconds(0));
+
+	if (dvi == Mtb::DVCommon::State) {
+		this->mtbBusDiagStateChanged(data);
+	} else if ((dvi == Mtb::DVCommon::Errors) || (dvi == Mtb::DVCommon::Warnings)) {
+		bool anyNonZero = false;
+		for (uint8_t byte : data)
+			if (byte != 0)
+				anyNonZero = true;
+
+		if (dvi == Mtb::DVCommon::Errors)
+			this->mtbBusDiagStateChanged(anyNonZero, this->busModuleInfo.warning);
+		else if (dvi == Mtb::DVCommon::Warnings)
+			this->mtbBusDiagStateChanged(this->busModuleInfo.error, anyNonZero);
+	}
+}
+
+void MtbModule::dvNotReceived(uint8_t dvi, Mtb::CmdError error, bool lowPriority) {
+	DvCacheEntry &entry = this->dvCache[dvi];
+	entry.pending--;
+	if (!lowPriority)
+		entry.normalPending = false;
+	if (entry.pending > 0)
+		return; // the other command could still succeed
+	const std::vector<DvRequest> waiting = std::move(entry.waiting);
+	entry.waiting.clear();
+	for (const DvRequest &request : waiting)
+		request.onError(error);
+}
+
+QJsonObject MtbModule::dvResponse(const QJsonObject &request, uint8_t dvi, const std::vector<uint8_t> &data,
+                                  std::chrono::milliseconds age) const {
+	QJsonObject response = jsonOkResponse(request);
+	response["DVnum"] = dvi;
+	response["DVkey"] = this->DVToStr(dvi);
+	response["DVvalue"] = this->dvRepr(dvi, data);
+
+	QJsonArray dataAr;
+	for (const uint8_t byte : data)
+		dataAr.push_back(byte);
+	response["DVvalueRaw"] = dataAr;
+	response["DVage_ms"] = static_cast<qint64>(age.count());
+	return response;
+}
+
+void MtbModule::dvCacheInvalidate() {
+	// Keep waiting requests, their command is still pending on the bus
+	for (auto &pair : this->dvCache)
+		pair.second.received.reset();
+}
+
+void MtbModule::loadDvCacheConfig(const QJsonObject &json) {
+	std::map<QString, size_t> dvCacheTtl;
+	const QJsonObject ttl = (json.contains("ttl")) ? QJsonSafe::safeObject(json, "ttl") : QJsonObject();
+	for (const QString &key : ttl.keys())
+		dvCacheTtl[key] = QJsonSafe::safeUInt(ttl, key);
+	MtbModule::dvCacheTtlDefault = (json.contains("defaultTtl")) ? QJsonSafe::safeUInt(json, "defaultTtl") : 0;
+	MtbModule::dvCacheTtl = std::move(dvCacheTtl);
 }
 
 /* Firmware Upgrade ----------------------------------------------------------*/
@@ -359,6 +822,7 @@ bool MtbModule::isFirmwareUpgrading() const { return this->fwUpgrade.fwUpgrading
 
 void MtbModule::fwUpgdInit() {
 	this->mlog("Initializing firmware upgrade", Mtb::LogLevel::Info);
+	this->bumpVersion();
 	this->sendModuleInfo(this->fwUpgrade.fwUpgrading.value().socket);
 
 	if (this->busModuleInfo.inBootloader()) {
@@ -379,20 +843,21 @@ void MtbModule::fwUpgdInit() {
 }
 
 void MtbModule::fwUpgdReqAck() {
-	// Wait for module to reboot & initialize communication
-	// Check if module is in bootloader
-	QTimer::singleShot(200, [this](){
-		mtbusb.send(
-			Mtb::CmdMtbModuleInfoRequest(
-				this->address,
-				{[this](uint8_t, Mtb::ModuleInfo info, void*) { this->fwUpgdGotInfo(info); }},
-				{[this](Mtb::CmdError, void*) { this->fwUpgdError("Unable to get rebooted module information"); }}
-			)
-		);
-	});
+	// Wait for module to reboot & initialize communication in bootloader
+	this->rebootWaitStart(
+		true,
+		[this](Mtb::ModuleInfo info) { this->fwUpgdGotInfo(info); },
+		[this](bool answered) {
+			if (answered)
+				this->fwUpgdError("Module rebooted, but not in bootloader!");
+			else
+				this->fwUpgdError("Unable to get rebooted module information");
+		}
+	);
 }
 
 void MtbModule::fwUpgdGotInfo(Mtb::ModuleInfo info) {
+	this->bumpVersion();
 	this->busModuleInfo = info;
 	if (!this->busModuleInfo.inBootloader())
 		return this->fwUpgdError("Module rebooted, but not in bootloader!");
@@ -450,6 +915,7 @@ void MtbModule::fwUpgdError(const QString &error, size_t code) {
 		json["id"] = static_cast<int>(request.id.value());
 	server.send(request.socket, json);
 
+	this->bumpVersion();
 	this->fwUpgrade.fwUpgrading.reset();
 	this->fwUpgrade.data.clear();
 	this->sendModuleInfo(request.socket);
@@ -481,6 +947,7 @@ void MtbModule::fwUpgdRebooted() {
 		json["id"] = static_cast<int>(request.id.value());
 	server.send(request.socket, json);
 
+	this->bumpVersion();
 	this->fwUpgrade.fwUpgrading.reset();
 	this->fwUpgrade.data.clear();
 	this->sendModuleInfo(request.socket, true);
@@ -493,7 +960,6 @@ void MtbModule::reboot(std::function<void()> onOk, std::function<void()> onError
 	this->rebooting.rebooting = true;
 	this->rebooting.onOk = onOk;
 	this->rebooting.onError = onError;
-	this->rebooting.activatedByMtbUsb = false;
 	this->mtbBusLost();
 
 	this->sendModuleInfo(nullptr, true);
@@ -502,23 +968,19 @@ void MtbModule::reboot(std::function<void()> onOk, std::function<void()> onError
 		Mtb::CmdMtbModuleReboot(
 			this->address,
 			{[this](uint8_t, void*) {
-				QTimer::singleShot(1000, [this](){
-					if (this->rebooting.activatedByMtbUsb)
-						return;
-					mtbusb.send(
-						Mtb::CmdMtbModuleInfoRequest(
-							this->address,
-							{[this](uint8_t, Mtb::ModuleInfo info, void*) { this->mtbBusActivate(info); }},
-							{[this](Mtb::CmdError, void*) {
-								this->rebooting.rebooting = false;
-								this->sendModuleInfo(nullptr, true);
-								this->rebooting.onError();
-							}}
-						)
-					);
-				});
+				this->rebootWaitStart(
+					false,
+					[this](Mtb::ModuleInfo info) { this->mtbBusActivate(info); },
+					[this](bool) {
+						this->bumpVersion();
+						this->rebooting.rebooting = false;
+						this->sendModuleInfo(nullptr, true);
+						this->rebooting.onError();
+					}
+				);
 			}},
 			{[this](Mtb::CmdError, void*) {
+				this->bumpVersion();
 				this->rebooting.rebooting = false;
 				this->sendModuleInfo(nullptr, true);
 				this->rebooting.onError();
@@ -527,20 +989,136 @@ void MtbModule::reboot(std::function<void()> onOk, std::function<void()> onError
 	);
 }
 
+void MtbModule::rebootWaitStart(bool bootloader, std::function<void(Mtb::ModuleInfo)> onReady,
+                                std::function<void(bool answered)> onTimeout) {
+	this->rebootWait.waiting = true;
+	this->rebootWait.pending = false;
+	this->rebootWait.bootloader = bootloader;
+	this->rebootWait.answered = false;
+	this->rebootWait.restarted = false;
+	this->rebootWait.delay = std::chrono::milliseconds(MTB_MODULE_REBOOT_POLL_MIN_MS);
+	this->rebootWait.started = std::chrono::steady_clock::now();
+	this->rebootWait.deadline = this->rebootWait.started + std::chrono::milliseconds(MTB_MODULE_REBOOT_TIMEOUT_MS);
+	this->rebootWait.onReady = onReady;
+	this->rebootWait.onTimeout = onTimeout;
+	this->rebootWaitSchedule();
+}
+
+void MtbModule::rebootWaitSchedule() {
+	const size_t generation = ++this->rebootWait.generation;
+	QTimer::singleShot(this->rebootWait.delay.count(), [this, generation]() {
+		if ((this->rebootWait.waiting) && (this->rebootWait.generation == generation))
+			this->rebootWaitPoll();
+	});
+	this->rebootWait.delay = std::min(this->rebootWait.delay*2,
+	                                  std::chrono::milliseconds(MTB_MODULE_REBOOT_POLL_MAX_MS));
+}
+
+void MtbModule::rebootWaitPoll() {
+	if ((!this->rebootWait.waiting) || (this->rebootWait.pending))
+		return;
+	this->rebootWait.generation++; // cancel scheduled poll
+	this->rebootWait.pending = true;
+
+	mtbusb.send(
+		Mtb::CmdMtbModuleInfoRequest(
+			this->address,
+			{[this](uint8_t, Mtb::ModuleInfo info, void*) {
+				this->rebootWait.pending = false;
+				if (!this->rebootWait.waiting)
+					return;
+				if ((this->rebootWait.bootloader) && (!info.inBootloader())) {
+					// Could be still running application, wait for bootloader
+					this->rebootWait.answered = true;
+					return this->rebootWaitNext();
+				}
+				if ((!this->rebootWait.bootloader) && (!this->rebootWait.restarted))
+					return this->rebootWaitUptime(info);
+				auto onReady = this->rebootWait.onReady;
+				this->rebootWaitStop();
+				onReady(info);
+			}},
+			{[this](Mtb::CmdError, void*) {
+				this->rebootWait.pending = false;
+				this->rebootWait.restarted = true;
+				if (this->rebootWait.waiting)
+					this->rebootWaitNext();
+			}}
+		)
+	);
+}
+
+void MtbModule::rebootWaitUptime(Mtb::ModuleInfo info) {
+	// Uptime is in seconds (rounded down) -> rebooted module has uptime*1000 < time since reboot command
+	this->rebootWait.pending = true;
+	mtbusb.send(
+		Mtb::CmdMtbModuleGetDiagValue(
+			this->address, Mtb::DVCommon::Uptime,
+			{[this, info](uint8_t, uint8_t, const std::vector<uint8_t> &data, void*) {
+				this->rebootWait.pending = false;
+				if (!this->rebootWait.waiting)
+					return;
+				const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+					std::chrono::steady_clock::now() - this->rebootWait.started);
+				if ((data.size() != sizeof(uint32_t)) ||
+				    (static_cast<uint64_t>(pack<uint32_t>(data))*1000 >= static_cast<uint64_t>(elapsed.count()))) {
+					// Application not rebooted yet
+					this->rebootWait.answered = true;
+					return this->rebootWaitNext();
+				}
+				auto onReady = this->rebootWait.onReady;
+				this->rebootWaitStop();
+				onReady(info);
+			}},
+			{[this](Mtb::CmdError, void*) {
+				this->rebootWait.pending = false;
+				if (this->rebootWait.waiting)
+					this->rebootWaitNext();
+			}}
+		)
+	);
+}
+
+void MtbModule::rebootWaitNext() {
+	if ((mtbusb.connected()) && (std::chrono::steady_clock::now() < this->rebootWait.deadline))
+		return this->rebootWaitSchedule();
+
+	auto onTimeout = this->rebootWait.onTimeout;
+	const bool answered = this->rebootWait.answered;
+	this->rebootWaitStop();
+	onTimeout(answered);
+}
+
+void MtbModule::rebootWaitStop() {
+	this->rebootWait.waiting = false;
+	this->rebootWait.generation++;
+}
+
+void MtbModule::mtbUsbNewModule() {
+	if (this->rebootWait.waiting) {
+		this->rebootWait.restarted = true;
+		this->rebootWaitPoll();
+	}
+}
+
 void MtbModule::fullyActivated() {
+	this->bumpVersion();
 	this->activating = false;
 	this->activationsRemaining = 0;
 	this->active = true;
+	this->reactivateDelay = std::chrono::milliseconds(MTB_MODULE_BACKOFF_MIN_MS);
+	activations.done(this->address);
 	this->mlog("Activated", Mtb::LogLevel::Info);
 	this->sendModuleInfo(nullptr, true);
 
 	if (this->isRebooting()) {
+		this->bumpVersion();
 		this->rebooting.rebooting = false;
 		this->rebooting.onOk();
 	}
 }
 
-void MtbModule::jsonSpecificCommand(QTcpSocket *socket, const QJsonObject &request) {
+void MtbModule::jsonSpecificCommand(QIODevice *socket, const QJsonObject &request) {
 	const QJsonArray dataAr = QJsonSafe::safeArray(request, "data");
 	std::vector<uint8_t> data;
 	for (const auto var : dataAr) {
@@ -572,13 +1150,14 @@ void MtbModule::jsonSpecificCommand(QTcpSocket *socket, const QJsonObject &reque
 	);
 }
 
-void MtbModule::jsonBeacon(QTcpSocket *socket, const QJsonObject &request) {
+void MtbModule::jsonBeacon(QIODevice *socket, const QJsonObject &request) {
 	bool beacon = QJsonSafe::safeBool(request, "beacon");
 
 	mtbusb.send(
 		Mtb::CmdMtbModuleBeacon(
 			this->address, beacon,
 			{[this, socket, request, beacon](uint8_t, void*) {
+				this->bumpVersion();
 				this->beacon = beacon;
 				QJsonObject response = jsonOkResponse(request);
 				response["beacon"] = beacon;
@@ -593,10 +1172,27 @@ void MtbModule::jsonBeacon(QTcpSocket *socket, const QJsonObject &request) {
 
 void MtbModule::allOutputsReset() {}
 
-void MtbModule::reactivateCheck() {}
+void MtbModule::reactivateCheck() {
+	if ((this->activating) || (this->activationsRemaining == 0) || (this->active) || (!this->reactivateAllowed()))
+		return;
+	if (backgroundBudget.take()) // reactivation is background traffic
+		this->activate();
+}
+
+void MtbModule::activate() {
+	this->activationsRemaining = 0; // unknown module type, nothing to activate
+}
+
+bool MtbModule::reactivateAllowed() const {
+	return (std::chrono::steady_clock::now() >= this->reactivateNext) && (!this->isQuarantined());
+}
 
 void MtbModule::activationError(Mtb::CmdError) {
+	this->bumpVersion();
 	this->activating = false;
+	activations.done(this->address);
+	this->reactivateNext = std::chrono::steady_clock::now() + this->reactivateDelay;
+	this->reactivateDelay = std::min(2*this->reactivateDelay, std::chrono::milliseconds(MTB_MODULE_BACKOFF_MAX_MS));
 	if (this->activationsRemaining > 0) {
 		this->activationsRemaining--;
 		if (this->activationsRemaining <= 0)
@@ -1,12 +1,18 @@
 #ifndef _MODULE_H_
 #define _MODULE_H_
 
-#include <QTcpSocket>
+#include <QIODevice>
 #include <QJsonObject>
+#include <chrono>
+#include <deque>
+#include <memory>
 #include "mtbusb.h"
 #include "server.h"
+#include "subscriptions.h"
 #include "errors.h"
 
+struct JournalIo;
+
 enum class MtbModuleType {
 	Unknown = 0x00,
 	Univ2ir = 0x10,
@@ -19,8 +25,27 @@ enum class MtbModuleType {
 };
 
 constexpr size_t MTB_MODULE_ACTIVATIONS = 5;
+constexpr size_t MTB_MODULE_BACKOFF_MIN_MS = 500; // delay of reactivation after failed activation
+constexpr size_t MTB_MODULE_BACKOFF_MAX_MS = 30000;
+constexpr size_t MTB_MODULE_FLAPS = 5; // module lost this many times within MTB_MODULE_FLAP_WINDOW_MS -> quarantine
+constexpr size_t MTB_MODULE_FLAP_WINDOW_MS = 60000;
+constexpr size_t MTB_MODULE_QUARANTINE_MS = 60000;
+constexpr size_t MTB_MODULE_REBOOT_POLL_MIN_MS = 50; // first info request after reboot, doubled with each poll
+constexpr size_t MTB_MODULE_REBOOT_POLL_MAX_MS = 400;
+constexpr size_t MTB_MODULE_REBOOT_TIMEOUT_MS = 5000; // module must respond within this time after reboot
+constexpr size_t MTB_OUTPUT_SEQUENCE_MAX_STEPS = 64;
+constexpr size_t MTB_OUTPUT_SEQUENCE_MAX_DELAY_MS = 60000;
 QString moduleTypeToStr(MtbModuleType);
 
+// Type of MTB-UNI & MTB-UNIS output in JSON ('type' key of output)
+enum class MtbOutputType {
+	Plain,
+	SCom,
+	Flicker,
+};
+
+MtbOutputType jsonOutputType(const QJsonObject&); // throws JsonParseError for unknown type
+
 class MtbModule {
 protected:
 	bool active = false;
@@ -33,14 +58,38 @@ protected:
 	size_t activationsRemaining = 0;
 	bool activating = false;
 
+	// Reactivation backoff: delay doubles with each failed activation, reset when activated
+	std::chrono::milliseconds reactivateDelay{MTB_MODULE_BACKOFF_MIN_MS};
+	std::chrono::steady_clock::time_point reactivateNext;
+	std::deque<std::chrono::steady_clock::time_point> losses; // within MTB_MODULE_FLAP_WINDOW_MS
+	std::optional<std::chrono::steady_clock::time_point> quarantinedUntil; // flapping module not activated
+
 	struct Rebooting {
 		bool rebooting = false;
-		bool activatedByMtbUsb;
 		std::function<void()> onOk;
 		std::function<void()> onError;
 	};
 	Rebooting rebooting;
 
+	// Waiting for module after reboot: info is requested when MTB-USB reports the module
+	// (NewModule event) or by polling with increasing period, whichever comes first.
+	// Application could still answer shortly after reboot command, so answer is accepted only
+	// after the module was away or when its uptime started after the reboot command.
+	struct RebootWait {
+		bool waiting = false;
+		bool pending = false; // info request on the bus
+		bool bootloader = false; // module must respond in bootloader
+		bool answered = false; // module responded, but not in bootloader / not rebooted yet
+		bool restarted = false; // module did not answer or was reported by MTB-USB as new
+		size_t generation = 0; // scheduled polls with other generation are ignored
+		std::chrono::milliseconds delay{MTB_MODULE_REBOOT_POLL_MIN_MS};
+		std::chrono::steady_clock::time_point started;
+		std::chrono::steady_clock::time_point deadline;
+		std::function<void(Mtb::ModuleInfo)> onReady;
+		std::function<void(bool answered)> onTimeout;
+	};
+	RebootWait rebootWait;
+
 	struct FwUpgrade {
 		static constexpr size_t BLOCK_SIZE = 64;
 		using FirmwareStorage = std::map<size_t, std::vector<uint8_t>>;
@@ -50,16 +99,79 @@ protected:
 	};
 	FwUpgrade fwUpgrade;
 
-	void sendInputsChanged(QJsonObject inputs) const;
-	void sendOutputsChanged(QJsonObject outputs, const std::vector<QTcpSocket*> &ignore) const;
-	void sendModuleInfo(QTcpSocket *ignore = nullptr, bool sendConfig = false) const;
+	// Timed outputs setting ('module_output_pulse', 'module_output_sequence'), steps are
+	// 'module_set_outputs' sub-requests of server batch (single response for the whole sequence)
+	struct OutputSequence {
+		QIODevice *socket;
+		std::vector<QJsonObject> steps;
+		std::vector<size_t> delays; // ms after each step
+		size_t next = 0;
+		std::chrono::steady_clock::time_point start;
+		std::chrono::milliseconds at{0}; // time of next step since start
+	};
+	std::vector<std::shared_ptr<OutputSequence>> outputSequences;
+
+	// Diagnostic values cache ('module_diag'): value is reused until its TTL expires,
+	// concurrent requests of the same DV wait for single MTBbus command
+	struct DvRequest {
+		std::function<void(const std::vector<uint8_t> &data, std::chrono::milliseconds age)> onOk;
+		std::function<void(Mtb::CmdError)> onError;
+	};
+	struct DvCacheEntry {
+		std::vector<uint8_t> data;
+		std::optional<std::chrono::steady_clock::time_point> received; // nullopt = no valid value
+		std::vector<DvRequest> waiting; // non-empty = command on the bus
+		size_t pending = 0; // number of commands on the bus
+		bool normalPending = false; // any of pending commands sent at normal priority
+	};
+	std::map<uint8_t, DvCacheEntry> dvCache;
+	static std::map<QString, size_t> dvCacheTtl; // DV name -> TTL [ms]
+	static size_t dvCacheTtlDefault;
+	size_t dvTtl(uint8_t dvi) const;
+	void dvRequest(uint8_t dvi, size_t ttl, bool lowPriority, DvRequest&&);
+
+	// Version of the last change of the module & cached moduleInfo(state, true) for state=false/true
+	size_t changeVersion;
+	mutable std::array<std::optional<QJsonObject>, 2> infoCache;
+	static size_t lastVersion;
+
+	// Must be called on any change of module's info/config/state, ioOnly = only inputs/outputs changed
+	void bumpVersion(bool ioOnly = false);
+
+	// 'changed' = mask of changed ports, used to filter subscribers with port filter
+	// & to generate events for subscribers with delta subscription
+	void sendInputsChanged(QJsonObject inputs, PortMask changed);
+	void sendOutputsChanged(QJsonObject outputs, PortMask changed, const std::vector<QIODevice*> &ignore);
+	QJsonObject ioChangedEvent(const QString &command, const QString &key, const QJsonObject &state) const;
+	bool ioDeltaNeeded() const;
+	void sendIoChanged(QJsonObject &event, const JournalIo&);
+
+	// Only changed ports of current inputs/outputs state
+	virtual QJsonObject inputsDeltaJson(PortMask changed) const;
+	virtual QJsonObject outputsDeltaJson(PortMask changed) const;
+	void sendModuleInfo(QIODevice *ignore = nullptr, bool sendConfig = false) const;
 
-	virtual void jsonSetOutput(QTcpSocket*, const QJsonObject&);
-	virtual void jsonUpgradeFw(QTcpSocket*, const QJsonObject&);
-	virtual void jsonReboot(QTcpSocket*, const QJsonObject&);
-	virtual void jsonSpecificCommand(QTcpSocket*, const QJsonObject&);
-	virtual void jsonBeacon(QTcpSocket*, const QJsonObject&);
-	virtual void jsonGetDiag(QTcpSocket*, const QJsonObject&);
+	virtual void jsonSetOutput(QIODevice*, const QJsonObject&);
+	void jsonOutputPulse(QIODevice*, const QJsonObject&);
+	void jsonOutputSequence(QIODevice*, const QJsonObject&);
+	void startOutputSequence(QIODevice*, const QJsonObject &request, const std::vector<QJsonObject> &outputs,
+	                         const std::vector<size_t> &delays);
+	void outputSequenceStep(const std::shared_ptr<OutputSequence>&);
+	// Currently wanted state of 'ports' (keys of 'module_set_outputs' outputs) in 'module_set_outputs' format
+	virtual QJsonObject outputsWantJson(const QJsonObject &ports) const;
+	bool outputsSettable(QJsonObject &error) const;
+	// All changes of who set an output must go through this (keeps server's ownership index up to date)
+	void setOutputOwner(QIODevice *&owner, QIODevice *socket, size_t port) const;
+	virtual void jsonUpgradeFw(QIODevice*, const QJsonObject&);
+	virtual void jsonReboot(QIODevice*, const QJsonObject&);
+	virtual void jsonSpecificCommand(QIODevice*, const QJsonObject&);
+	virtual void jsonBeacon(QIODevice*, const QJsonObject&);
+	virtual void jsonGetDiag(QIODevice*, const QJsonObject&);
+	void dvReceived(uint8_t dvi, const std::vector<uint8_t> &data, bool lowPriority);
+	void dvNotReceived(uint8_t dvi, Mtb::CmdError, bool lowPriority);
+	QJsonObject dvResponse(const QJsonObject &request, uint8_t dvi, const std::vector<uint8_t> &data,
+	                       std::chrono::milliseconds age) const;
+	void dvCacheInvalidate();
 
 	void fwUpgdInit();
 	void fwUpgdError(const QString&, size_t code = MTB_MODULE_FWUPGD_ERROR);
@@ -73,14 +185,34 @@ protected:
 	static std::map<size_t, std::vector<uint8_t>> parseFirmware(const QJsonObject&);
 
 	void reboot(std::function<void()> onOk, std::function<void()> onError);
+	void rebootWaitStart(bool bootloader, std::function<void(Mtb::ModuleInfo)> onReady,
+	                     std::function<void(bool answered)> onTimeout);
+	void rebootWaitSchedule();
+	void rebootWaitPoll();
+	void rebootWaitUptime(Mtb::ModuleInfo); // module answered before it was seen away
+	void rebootWaitNext(); // poll failed
+	void rebootWaitStop();
 	void fullyActivated();
 	void activationError(Mtb::CmdError);
+	// Backoff & quarantine passed
+	bool reactivateAllowed() const;
+	// Full activation of the module (config, inputs, outputs), called on activation & reactivation
+	virtual void activate();
+	// Starts lightweight revalidation after MTB-USB reconnect (inputs are read again)
+	void warmActivate();
+	// Inputs read on warm reconnect: store & send changes, set outputs again, then warmActivated();
+	// module types without inputs state are fully activated
+	virtual void warmInputsRead(const std::vector<uint8_t>&);
+	void warmActivated();
+	void warmActivationFailed();
 
 	void mlog(const QString& message, Mtb::LogLevel) const;
 
 	virtual QJsonObject dvRepr(uint8_t dvi, const std::vector<uint8_t> &data) const;
 
 	void mtbBusDiagStateChanged(bool isError, bool isWarning);
+	// Must be called whenever packed inputs could have changed (keeps virtual inputs up to date)
+	void inputsUpdated() const;
 
 	static void alignFirmware(std::map<size_t, std::vector<uint8_t>>&, size_t pageSize);
 
@@ -93,33 +225,59 @@ public:
 	bool isRebooting() const;
 	bool isBeacon() const;
 	bool isActivating() const;
+	bool isQuarantined() const;
+	bool quarantineEnded(); // true once when quarantine expires
 	bool isFirmwareUpgrading() const;
 	bool isConfigSetting() const;
 
 	virtual QJsonObject moduleInfo(bool state, bool config) const;
+	QJsonObject cachedModuleInfo(bool state) const; // moduleInfo(state, true) cached until module changes
+	size_t version() const;
+	static size_t modulesVersion(); // version of the last change of any module
+	static size_t newVersion();
+	static void loadDvCacheConfig(const QJsonObject&);
+	// 'module_diag' request, lowPriority = MTBbus command is sent at low priority (daemon's own requests only)
+	void getDiag(QIODevice*, const QJsonObject &request, bool lowPriority);
+	// DV read by the daemon itself (e.g. health monitor): DV cache applies, low MTBbus priority
+	void readDv(uint8_t dvi, std::function<void(const std::vector<uint8_t>&)> onOk,
+	            std::function<void(Mtb::CmdError)> onError);
+	// Called on inputs change before the event is sent to clients (local rules react first)
+	static std::function<void(uint8_t addr, PortMask current)> onInputsChanged;
+	// Checks module state & 'outputs' of 'module_set_outputs' request, fills 'error' when invalid
+	virtual bool validateOutputs(const QJsonObject &outputs, QJsonObject &error) const;
 
 	virtual void mtbBusActivate(Mtb::ModuleInfo);
 	virtual void mtbBusLost();
 	virtual void mtbBusInputsChanged(const std::vector<uint8_t>&);
+	// Current inputs packed to bit mask (bit i = port i), nullopt if the module does not support it
+	virtual std::optional<PortMask> inputsPacked() const;
 	virtual void mtbBusDiagStateChanged(const std::vector<uint8_t>&);
 	virtual void mtbUsbDisconnected();
+	// Module kept active through short MTB-USB disconnection is present again, returns false
+	// when full activation is needed (module changed)
+	bool mtbUsbWarmReconnect(Mtb::ModuleInfo);
+	// MTB-USB reported the module on the bus (e.g. rebooted module is ready)
+	void mtbUsbNewModule();
+	// MTB-USB reported module failure: counted for flapping detection (quarantine), then mtbBusLost()
+	void mtbUsbModuleFail();
 
-	virtual void jsonCommand(QTcpSocket*, const QJsonObject&, bool hasWriteAccess);
-	virtual void jsonSetConfig(QTcpSocket*, const QJsonObject&);
-	virtual void jsonSetAddress(QTcpSocket*, const QJsonObject&);
+	virtual void jsonCommand(QIODevice*, const QJsonObject&, bool hasWriteAccess);
+	virtual void jsonSetConfig(QIODevice*, const QJsonObject&);
+	virtual void jsonSetAddress(QIODevice*, const QJsonObject&);
 
 	virtual void loadConfig(const QJsonObject&);
 	virtual void saveConfig(QJsonObject&) const;
 
-	virtual std::vector<QTcpSocket*> outputSetters() const;
-	virtual void resetOutputsOfClient(QTcpSocket*);
+	virtual void resetOutputsOfClient(QIODevice*);
 	virtual void allOutputsReset();
-	virtual void clientDisconnected(QTcpSocket*);
+	void cancelOutputSequences(const QIODevice*);
+	virtual void clientDisconnected(QIODevice*);
 	virtual bool fwDeprecated() const;
 
-	virtual void reactivateCheck();
+	void reactivateCheck();
 
 	virtual QString DVToStr(uint8_t dv) const;
+	virtual std::vector<uint8_t> knownDVs() const; // all DVs with known name
 	virtual std::optional<uint8_t> StrToDV(const QString&) const;
 
 private:
@@ -1,5 +1,6 @@
 #include <QJsonArray>
 #include <QJsonObject>
+#include <algorithm>
 #include "utils.h"
 #include "rc.h"
 #include "mtbusb.h"
@@ -23,20 +24,37 @@ QJsonObject MtbRc::moduleInfo(bool state, bool config) const {
 	return response;
 }
 
+static QJsonArray addrsToJson(const std::vector<DccAddr> &addrs) {
+	QJsonArray result;
+	for (const DccAddr addr : addrs)
+		result.push_back(addr);
+	return result;
+}
+
 QJsonObject MtbRc::inputsToJson() const {
 	QJsonArray arrayOfInputs;
-	for (const auto& input : this->inputs) {
-		QJsonArray addrsPerInput;
-		for (const DccAddr addr : input)
-			addrsPerInput.push_back(addr);
-		arrayOfInputs.push_back(addrsPerInput);
-	}
+	for (const auto& input : this->inputs)
+		arrayOfInputs.push_back(addrsToJson(input));
 	return {{"ports", arrayOfInputs}};
 }
 
+QJsonObject MtbRc::inputsDeltaJson(PortMask changed) const {
+	// Only addresses added/removed by the last change
+	QJsonObject changedInputs;
+	for (size_t i = 0; i < RC_IN_CNT; i++) {
+		if (changed & (1U << i)) {
+			changedInputs[QString::number(i)] = QJsonObject{
+				{"added", addrsToJson(this->inputsAdded[i])},
+				{"removed", addrsToJson(this->inputsRemoved[i])},
+			};
+		}
+	}
+	return {{"ports", changedInputs}};
+}
+
 /* Json Set Config ---------------------------------------------------------- */
 
-void MtbRc::jsonSetConfig(QTcpSocket *socket, const QJsonObject &request) {
+void MtbRc::jsonSetConfig(QIODevice *socket, const QJsonObject &request) {
 	// Just set general MtbModule configuration (e.g. name of the module)
 
 	if (this->isFirmwareUpgrading()) {
@@ -53,7 +71,7 @@ void MtbRc::jsonSetConfig(QTcpSocket *socket, const QJsonObject &request) {
 
 /* Json Upgrade Firmware ---------------------------------------------------- */
 
-void MtbRc::jsonUpgradeFw(QTcpSocket *socket, const QJsonObject &request) {
+void MtbRc::jsonUpgradeFw(QIODevice *socket, const QJsonObject &request) {
 	if (this->isFirmwareUpgrading()) {
 		sendError(socket, request, MTB_MODULE_UPGRADING_FW, "Firmware is already being upgraded!");
 		return;
@@ -85,6 +103,7 @@ void MtbRc::mtbBusActivate(Mtb::ModuleInfo info) {
 	if (info.inBootloader()) {
 		// In bootloader → mark as active, don't do anything else
 		this->mlog("Module is in bootloader!", Mtb::LogLevel::Info);
+		this->bumpVersion();
 		this->active = true;
 		return;
 	}
@@ -93,6 +112,7 @@ void MtbRc::mtbBusActivate(Mtb::ModuleInfo info) {
 }
 
 void MtbRc::activate() {
+	this->bumpVersion();
 	this->activating = true;
 
 	if (this->busModuleInfo.warning || this->busModuleInfo.error)
@@ -114,41 +134,83 @@ void MtbRc::activate() {
 
 void MtbRc::inputsRead(const std::vector<uint8_t> &data) {
 	// Mtb module activation: got info & config set & inputs read → mark module as active
-	this->storeInputsState(data);
+	this->setInputs(data);
 	this->fullyActivated();
 }
 
 void MtbRc::storeInputsState(const std::vector<uint8_t> &data) {
 	for (auto& input : this->inputs)
-		input.clear();
+		input.clear(); // keeps capacity
 
 	for (size_t i = 0; i+1 < data.size(); i += 2) {
 		size_t input = (data[i] >> 5);
 		DccAddr addr = data[i+1] | ((data[i] & 0x1F) << 8);
-		this->inputs[input].insert(addr);
+		this->inputs[input].push_back(addr);
+	}
+
+	for (auto& input : this->inputs) {
+		std::sort(input.begin(), input.end());
+		input.erase(std::unique(input.begin(), input.end()), input.end());
 	}
 }
 
+PortMask MtbRc::inputsDiff() {
+	// this->inputsPrevious vs this->inputs → this->inputsAdded & this->inputsRemoved (all sorted)
+	PortMask changed = 0;
+	for (size_t i = 0; i < RC_IN_CNT; i++) {
+		const std::vector<DccAddr> &previous = this->inputsPrevious[i];
+		const std::vector<DccAddr> &current = this->inputs[i];
+		this->inputsAdded[i].clear();
+		this->inputsRemoved[i].clear();
+		if (previous == current)
+			continue;
+		changed |= (1U << i);
+		std::set_difference(current.begin(), current.end(), previous.begin(), previous.end(),
+		                    std::back_inserter(this->inputsAdded[i]));
+		std::set_difference(previous.begin(), previous.end(), current.begin(), current.end(),
+		                    std::back_inserter(this->inputsRemoved[i]));
+	}
+	return changed;
+}
+
+PortMask MtbRc::setInputs(const std::vector<uint8_t> &data) {
+	std::swap(this->inputs, this->inputsPrevious);
+	this->storeInputsState(data);
+	const PortMask changed = this->inputsDiff();
+	if (changed != 0)
+		dccIndex.update(this->address, this->inputsAdded, this->inputsRemoved);
+	return changed;
+}
+
+/* Warm reconnect ----------------------------------------------------------- */
+
+void MtbRc::warmInputsRead(const std::vector<uint8_t> &data) {
+	const PortMask changed = this->setInputs(data);
+	if (changed != 0)
+		this->sendInputsChanged(this->inputsToJson(), changed);
+	this->warmActivated();
+}
+
 /* Inputs changed ----------------------------------------------------------- */
 
 void MtbRc::mtbBusInputsChanged(const std::vector<uint8_t> &data) {
 	if (this->active || this->activating) {
-		this->storeInputsState(data);
-		this->sendInputsChanged(this->inputsToJson());
+		const PortMask changed = this->setInputs(data);
+		this->sendInputsChanged(this->inputsToJson(), changed);
 	}
 }
 
-void MtbRc::mtbUsbDisconnected() {
-	MtbModule::mtbUsbDisconnected();
-	for (auto& input : this->inputs)
-		input.clear();
+void MtbRc::mtbBusLost() {
+	// Addresses are no longer detected by the module
+	const PortMask changed = this->setInputs({});
+	if (changed != 0)
+		this->sendInputsChanged(this->inputsToJson(), changed);
+	MtbModule::mtbBusLost();
 }
 
-/* -------------------------------------------------------------------------- */
-
-void MtbRc::reactivateCheck() {
-	if ((!this->activating) && (this->activationsRemaining > 0) && (!this->active))
-		this->activate();
+void MtbRc::mtbUsbDisconnected() {
+	MtbModule::mtbUsbDisconnected();
+	this->setInputs({});
 }
 
 /* Diagnostic Values -------------------------------------------------------- */
@@ -173,6 +235,13 @@ QString MtbRc::DVToStr(uint8_t dv) const {
 	return MtbModule::DVToStr(dv);
 }
 
+std::vector<uint8_t> MtbRc::knownDVs() const {
+	std::vector<uint8_t> result = MtbModule::knownDVs();
+	for (const uint8_t dv : dvsRC.keys())
+		result.push_back(dv);
+	return result;
+}
+
 std::optional<uint8_t> MtbRc::StrToDV(const QString &str) const {
 	if (dvsCommonRC.contains(str))
 		return dvsCommonRC[str];
@@ -1,13 +1,14 @@
 #ifndef _MODULE_MTB_RC_H_
 #define _MODULE_MTB_RC_H_
 
-#include <set>
+#include <vector>
 #include <QMap>
 #include "module.h"
 #include "server.h"
 
 constexpr size_t RC_IN_CNT = 8;
 using DccAddr = uint16_t;
+using RcAddrs = std::array<std::vector<DccAddr>, RC_IN_CNT>; // sorted addresses per port
 
 const QMap<uint8_t, QString> dvsRC {
 	{32, "cutouts_started"},
@@ -107,14 +108,22 @@ const QMap<uint8_t, QString> dvsRC {
 
 class MtbRc : public MtbModule {
 protected:
-	std::array<std::set<DccAddr>, RC_IN_CNT> inputs;
+	RcAddrs inputs;
+	// Previous state (kept to reuse allocated memory) & difference of the last inputs change
+	RcAddrs inputsPrevious;
+	RcAddrs inputsAdded;
+	RcAddrs inputsRemoved;
 
 	void storeInputsState(const std::vector<uint8_t>&);
+	PortMask inputsDiff();
+	PortMask setInputs(const std::vector<uint8_t>&); // returns mask of changed ports
 	void inputsRead(const std::vector<uint8_t>&);
+	void warmInputsRead(const std::vector<uint8_t>&) override;
 	QJsonObject inputsToJson() const;
+	QJsonObject inputsDeltaJson(PortMask changed) const override;
 
-	void jsonUpgradeFw(QTcpSocket*, const QJsonObject&) override;
-	void activate();
+	void jsonUpgradeFw(QIODevice*, const QJsonObject&) override;
+	void activate() override;
 
 	QJsonObject dvRepr(uint8_t dvi, const std::vector<uint8_t> &data) const override;
 
@@ -125,12 +134,13 @@ public:
 
 	void mtbBusActivate(Mtb::ModuleInfo) override;
 	void mtbBusInputsChanged(const std::vector<uint8_t>&) override;
+	void mtbBusLost() override;
 	void mtbUsbDisconnected() override;
 
-	void jsonSetConfig(QTcpSocket*, const QJsonObject&) override;
-	void reactivateCheck() override;
+	void jsonSetConfig(QIODevice*, const QJsonObject&) override;
 
 	QString DVToStr(uint8_t dv) const override;
+	std::vector<uint8_t> knownDVs() const override;
 	std::optional<uint8_t> StrToDV(const QString&) const override;
 };
 
@@ -57,43 +57,43 @@ QJsonObject MtbUni::moduleInfo(bool state, bool config) const {
 
 /* Json Set Outputs --------------------------------------------------------- */
 
-void MtbUni::jsonSetOutput(QTcpSocket *socket, const QJsonObject &request) {
-	if (!this->active) {
-		sendError(socket, request, MTB_MODULE_FAILED, "Cannot set output of inactive module!");
-		return;
-	}
-	if (this->isFirmwareUpgrading()) {
-		sendError(socket, request, MTB_MODULE_UPGRADING_FW, "Firmware of module is being upgraded!");
-		return;
-	}
-	if (this->busModuleInfo.inBootloader()) {
-		sendError(socket, request, MTB_MODULE_IN_BOOTLOADER, "Module is in bootloader!");
-		return;
-	}
-	if (this->isConfigSetting()) {
-		sendError(socket, request, MTB_MODULE_CONFIG_SETTING, "Configuration of module is being changed!");
-		return;
-	}
-
-	QJsonObject outputs = QJsonSafe::safeObject(request, "outputs");
-	QMap<size_t, uint8_t> ports; // code per port
+bool MtbUni::validateOutputs(const QJsonObject &outputs, QJsonObject &error) const {
+	if (!this->outputsSettable(error))
+		return false;
 
-	// Validate ports
 	bool ok;
 	for (const auto &key : outputs.keys()) {
 		int port = key.toInt(&ok);
 		if ((!ok) || (port < 0) || (port >= static_cast<int>(UNI_IO_CNT))) {
-			sendError(socket, request, MTB_MODULE_INVALID_PORT, "Invalid port: "+key);
-			return;
+			error = DaemonServer::error(MTB_MODULE_INVALID_PORT, "Invalid port: "+key);
+			return false;
 		}
 
 		try {
-			ports[port] = jsonOutputToByte(QJsonSafe::safeObject(outputs[key]));
+			jsonOutputToByte(QJsonSafe::safeObject(outputs[key]));
 		} catch (const JsonParseError& e) {
-			sendError(socket, request, MTB_MODULE_INVALID_PORT, "Invalid port "+key+" content: "+e.what());
-			return;
+			error = DaemonServer::error(MTB_MODULE_INVALID_PORT, "Invalid port "+key+" content: "+e.what());
+			return false;
 		}
 	}
+	return true;
+}
+
+void MtbUni::jsonSetOutput(QIODevice *socket, const QJsonObject &request) {
+	QJsonObject error;
+	if (!this->outputsSettable(error)) {
+		sendError(socket, request, error);
+		return;
+	}
+	QJsonObject outputs = QJsonSafe::safeObject(request, "outputs");
+	if (!this->validateOutputs(outputs, error)) {
+		sendError(socket, request, error);
+		return;
+	}
+
+	QMap<size_t, uint8_t> ports; // code per port
+	for (const auto &key : outputs.keys())
+		ports[key.toInt()] = jsonOutputToByte(QJsonSafe::safeObject(outputs[key]));
 
 	bool send = (this->outputsWant == this->outputsConfirmed);
 	bool changed = false;
@@ -105,7 +105,7 @@ void MtbUni::jsonSetOutput(QTcpSocket *socket, const QJsonObject &request) {
 			if ((this->whoSetOutput[port] != nullptr) && (this->whoSetOutput[port] != socket))
 				this->mlog("Multiple clients set same output: "+QString::number(port),
 				           Mtb::LogLevel::Warning);
-			this->whoSetOutput[port] = socket;
+			this->setOutputOwner(this->whoSetOutput[port], socket, port);
 		}
 		this->outputsWant[port] = ports[port];
 	}
@@ -127,17 +127,18 @@ void MtbUni::jsonSetOutput(QTcpSocket *socket, const QJsonObject &request) {
 uint8_t MtbUni::jsonOutputToByte(const QJsonObject &json) {
 	unsigned int value = QJsonSafe::safeUInt(json, "value");
 
-	if (json["type"] == "plain") {
+	switch (jsonOutputType(json)) {
+	case MtbOutputType::Plain:
 		if ((value != 0) && (value != 1))
 			throw JsonParseError("'value' can only be 0/1!");
 		return (value > 0) ? 1 : 0;
-	}
-	if (json["type"] == "s-com") {
+
+	case MtbOutputType::SCom:
 		if (value > 127)
 			throw JsonParseError("'value' can only be 0-127!");
 		return value | 0x80;
-	}
-	if (json["type"] == "flicker") {
+
+	case MtbOutputType::Flicker:
 		uint8_t flick = flickPerMinToMtbUniValue(value);
 		if (flick == 0)
 			throw JsonParseError("'value' is not a valid flicker frequency!");
@@ -163,12 +164,13 @@ void MtbUni::setOutputs() {
 }
 
 void MtbUni::mtbBusOutputsSet(const std::vector<uint8_t>& data) {
+	const auto previous = this->outputsConfirmed;
 	this->outputsConfirmed = this->moduleOutputsData(data);
 
 	// TODO: check if output really set?
 
 	// Report ok callback to clients
-	std::vector<QTcpSocket*> ignore;
+	std::vector<QIODevice*> ignore;
 	for (const ServerRequest &sr : this->setOutputsSent) {
 		QJsonObject response{
 			{"command", "module_set_outputs"},
@@ -185,7 +187,7 @@ void MtbUni::mtbBusOutputsSet(const std::vector<uint8_t>& data) {
 	this->setOutputsSent.clear();
 
 	// Report outputs changed event to other clients
-	this->sendOutputsChanged(outputsToJson(this->outputsConfirmed), ignore);
+	this->sendOutputsChanged(outputsToJson(this->outputsConfirmed), diffMask(previous, this->outputsConfirmed), ignore);
 
 	// Send next outputs
 	if (this->setOutputsWaiting.empty()) {
@@ -196,27 +198,43 @@ void MtbUni::mtbBusOutputsSet(const std::vector<uint8_t>& data) {
 	}
 }
 
+QJsonObject MtbUni::outputToJson(uint8_t output) {
+	if ((output & 0x80) > 0)
+		return {{"type", "s-com"}, {"value", output & 0x7F}};
+	if ((output & 0x40) > 0)
+		return {{"type", "flicker"}, {"value", static_cast<int>(flickMtbUniToPerMin(output & 0xF))}};
+	return {{"type", "plain"}, {"value", output & 1}};
+}
+
 QJsonObject MtbUni::outputsToJson(const std::array<uint8_t, UNI_IO_CNT> &outputs) {
 	QJsonObject result;
-	for (size_t i = 0; i < UNI_IO_CNT; i++) {
-		QJsonObject output;
-
-		if ((outputs[i] & 0x80) > 0) {
-			output["type"] = "s-com";
-			output["value"] = outputs[i] & 0x7F;
-		} else if ((outputs[i] & 0x40) > 0) {
-			output["type"] = "flicker";
-			output["value"] = static_cast<int>(flickMtbUniToPerMin(outputs[i] & 0xF));
-		} else {
-			output["type"] = "plain";
-			output["value"] = outputs[i] & 1;
-		}
+	for (size_t i = 0; i < UNI_IO_CNT; i++)
+		result[QString::number(i)] = outputToJson(outputs[i]);
+	return result;
+}
 
-		result[QString::number(i)] = output;
+QJsonObject MtbUni::outputsDeltaJson(PortMask changed) const {
+	QJsonObject result;
+	for (size_t i = 0; i < UNI_IO_CNT; i++)
+		if (changed & (1U << i))
+			result[QString::number(i)] = outputToJson(this->outputsConfirmed[i]);
+	return result;
+}
+
+QJsonObject MtbUni::outputsWantJson(const QJsonObject &ports) const {
+	QJsonObject result;
+	for (const auto &key : ports.keys()) {
+		const size_t port = key.toInt();
+		if (port < this->outputsWant.size())
+			result[key] = outputToJson(this->outputsWant[port]);
 	}
 	return result;
 }
 
+QJsonObject MtbUni::inputsDeltaJson(PortMask) const {
+	return {{"packed", static_cast<qint64>(this->inputs)}};
+}
+
 QJsonObject MtbUni::inputsToJson(uint16_t inputs) {
 	QJsonArray json;
 	uint16_t _inputs = inputs;
@@ -244,6 +262,7 @@ void MtbUni::mtbBusOutputsNotSet(Mtb::CmdError error) {
 
 	// TODO: mark module as failed? Do anything else?
 	this->outputsConfirmed = this->outputsWant;
+	this->bumpVersion(true);
 
 	// Send next outputs
 	if (this->setOutputsWaiting.empty()) {
@@ -256,7 +275,7 @@ void MtbUni::mtbBusOutputsNotSet(Mtb::CmdError error) {
 
 /* Json Set Config ---------------------------------------------------------- */
 
-void MtbUni::jsonSetConfig(QTcpSocket *socket, const QJsonObject &request) {
+void MtbUni::jsonSetConfig(QIODevice *socket, const QJsonObject &request) {
 	if (this->configWriting.has_value()) {
 		sendError(socket, request, MTB_MODULE_ALREADY_WRITING, "Another client is writing config now!");
 		return;
@@ -295,6 +314,7 @@ void MtbUni::jsonSetConfig(QTcpSocket *socket, const QJsonObject &request) {
 }
 
 void MtbUni::mtbBusConfigWritten() {
+	this->bumpVersion();
 	this->config = this->configToWrite;
 	const ServerRequest request = this->configWriting.value();
 	this->configWriting.reset();
@@ -335,7 +355,7 @@ void MtbUni::mtbBusConfigNotWritten(Mtb::CmdError error) {
 
 /* Json Upgrade Firmware ---------------------------------------------------- */
 
-void MtbUni::jsonUpgradeFw(QTcpSocket *socket, const QJsonObject &request) {
+void MtbUni::jsonUpgradeFw(QIODevice *socket, const QJsonObject &request) {
 	if (this->isFirmwareUpgrading()) {
 		sendError(socket, request, MTB_MODULE_UPGRADING_FW, "Firmware is already being upgraded!");
 		return;
@@ -351,7 +371,7 @@ void MtbUni::jsonUpgradeFw(QTcpSocket *socket, const QJsonObject &request) {
 
 /* -------------------------------------------------------------------------- */
 
-void MtbUni::resetOutputsOfClient(QTcpSocket *socket) {
+void MtbUni::resetOutputsOfClient(QIODevice *socket) {
 	MtbModule::resetOutputsOfClient(socket);
 
 	bool send = false;
@@ -359,7 +379,7 @@ void MtbUni::resetOutputsOfClient(QTcpSocket *socket) {
 		for (size_t i = 0; i < UNI_IO_CNT; i++) {
 			if (this->whoSetOutput[i] == socket) {
 				this->outputsWant[i] = this->config.value().outputsSafe[i];
-				this->whoSetOutput[i] = nullptr;
+				this->setOutputOwner(this->whoSetOutput[i], nullptr, i);
 				send = true;
 			}
 		}
@@ -372,14 +392,6 @@ void MtbUni::resetOutputsOfClient(QTcpSocket *socket) {
 	}
 }
 
-std::vector<QTcpSocket*> MtbUni::outputSetters() const {
-	std::vector<QTcpSocket*> result;
-	for (QTcpSocket* socket : this->whoSetOutput)
-		if ((socket != nullptr) && (std::find(result.begin(), result.end(), socket) == result.end()))
-			result.push_back(socket);
-	return result;
-}
-
 std::vector<uint8_t> MtbUni::mtbBusOutputsData() const {
 	// Set outputs data based on diff in this->outputsWant
 	const std::array<uint8_t, UNI_IO_CNT> &outputs = this->outputsWant;
@@ -431,12 +443,13 @@ std::array<uint8_t, UNI_IO_CNT> MtbUni::moduleOutputsData(const std::vector<uint
 }
 
 void MtbUni::allOutputsReset() {
+	const auto previous = this->outputsConfirmed;
 	for (size_t i = 0; i < UNI_IO_CNT; i++) {
 		this->outputsWant[i] = this->config.has_value() ? this->config.value().outputsSafe[i] : 0;
 		this->outputsConfirmed[i] = this->outputsWant[i];
-		this->whoSetOutput[i] = nullptr;
+		this->setOutputOwner(this->whoSetOutput[i], nullptr, i);
 	}
-	this->sendOutputsChanged(outputsToJson(this->outputsConfirmed), {});
+	this->sendOutputsChanged(outputsToJson(this->outputsConfirmed), diffMask(previous, this->outputsConfirmed), {});
 }
 
 /* MTB-UNI activation ---------------------------------------------------------
@@ -467,6 +480,7 @@ void MtbUni::mtbBusActivate(Mtb::ModuleInfo info) {
 }
 
 void MtbUni::activate() {
+	this->bumpVersion();
 	this->activating = true;
 
 	if (this->busModuleInfo.warning || this->busModuleInfo.error)
@@ -520,6 +534,7 @@ void MtbUni::configSet() {
 void MtbUni::inputsRead(const std::vector<uint8_t> &data) {
 	// Mtb module activation: got info & config set & inputs read → mark module as active
 	this->storeInputsState(data);
+	this->inputsUpdated();
 
 	mtbusb.send(
 		Mtb::CmdMtbModuleResetOutputs(
@@ -546,24 +561,44 @@ void MtbUni::outputsReset() {
 	}
 
 	for (size_t i = 0; i < UNI_IO_CNT; i++)
-		this->whoSetOutput[i] = nullptr;
+		this->setOutputOwner(this->whoSetOutput[i], nullptr, i);
 
 	this->fullyActivated();
 }
 
+/* Warm reconnect ----------------------------------------------------------- */
+
+void MtbUni::warmInputsRead(const std::vector<uint8_t> &data) {
+	const uint16_t previous = this->inputs;
+	this->storeInputsState(data);
+	const PortMask changed = previous ^ this->inputs;
+	if (changed != 0)
+		this->sendInputsChanged(inputsToJson(this->inputs), changed);
+
+	if (this->setOutputsSent.empty())
+		this->setOutputs();
+	this->warmActivated();
+}
+
 /* Inputs changed ----------------------------------------------------------- */
 
 void MtbUni::mtbBusInputsChanged(const std::vector<uint8_t> &data) {
 	if (this->active || this->activating) {
+		const uint16_t previous = this->inputs;
 		this->storeInputsState(data);
-		this->sendInputsChanged(inputsToJson(this->inputs));
+		this->sendInputsChanged(inputsToJson(this->inputs), previous ^ this->inputs);
 	}
 }
 
+std::optional<PortMask> MtbUni::inputsPacked() const {
+	return this->inputs;
+}
+
 void MtbUni::mtbUsbDisconnected() {
 	MtbModule::mtbUsbDisconnected();
 	this->allOutputsReset();
 	this->inputs = 0;
+	this->inputsUpdated();
 }
 
 /* MtbUniConfig ------------------------------------------------------------- */
@@ -691,11 +726,6 @@ size_t MtbUni::flickMtbUniToPerMin(uint8_t mtbUniFlick) {
 	}
 }
 
-void MtbUni::reactivateCheck() {
-	if ((!this->activating) && (this->activationsRemaining > 0) && (!this->active))
-		this->activate();
-}
-
 /* Configuration ------------------------------------------------------------ */
 
 void MtbUni::loadConfig(const QJsonObject &json) {
@@ -41,7 +41,7 @@ protected:
 	std::array<uint8_t, UNI_IO_CNT> outputsConfirmed;
 	std::optional<MtbUniConfig> config;
 	std::optional<MtbUniConfig> configToWrite;
-	std::array<QTcpSocket*, UNI_IO_CNT> whoSetOutput;
+	std::array<QIODevice*, UNI_IO_CNT> whoSetOutput;
 
 	std::vector<ServerRequest> setOutputsWaiting;
 	std::vector<ServerRequest> setOutputsSent;
@@ -54,13 +54,18 @@ protected:
 
 	void storeInputsState(const std::vector<uint8_t>&);
 	void inputsRead(const std::vector<uint8_t>&);
+	void warmInputsRead(const std::vector<uint8_t>&) override;
 	void outputsReset();
 	void outputsSet(uint8_t, const std::vector<uint8_t>&);
+	static QJsonObject outputToJson(uint8_t output);
 	static QJsonObject outputsToJson(const std::array<uint8_t, UNI_IO_CNT>&);
+	QJsonObject outputsDeltaJson(PortMask changed) const override;
+	QJsonObject outputsWantJson(const QJsonObject &ports) const override;
+	QJsonObject inputsDeltaJson(PortMask changed) const override;
 	static QJsonObject inputsToJson(uint16_t inputs);
 
-	void jsonSetOutput(QTcpSocket*, const QJsonObject&) override;
-	void jsonUpgradeFw(QTcpSocket*, const QJsonObject&) override;
+	void jsonSetOutput(QIODevice*, const QJsonObject&) override;
+	void jsonUpgradeFw(QIODevice*, const QJsonObject&) override;
 
 	void setOutputs();
 	void mtbBusOutputsSet(const std::vector<uint8_t> &data);
@@ -68,7 +73,7 @@ protected:
 	void mtbBusConfigWritten();
 	void mtbBusConfigNotWritten(Mtb::CmdError);
 
-	void activate();
+	void activate() override;
 
 	std::vector<uint8_t> mtbBusOutputsData() const;
 	static std::array<uint8_t, UNI_IO_CNT> moduleOutputsData(const std::vector<uint8_t>& mtbBusData);
@@ -84,20 +89,20 @@ public:
 	MtbUni(uint8_t addr);
 	~MtbUni() override = default;
 	QJsonObject moduleInfo(bool state, bool config) const override;
+	bool validateOutputs(const QJsonObject &outputs, QJsonObject &error) const override;
 
 	void mtbBusActivate(Mtb::ModuleInfo) override;
 	void mtbBusInputsChanged(const std::vector<uint8_t>&) override;
+	std::optional<PortMask> inputsPacked() const override;
 	void mtbUsbDisconnected() override;
 
-	void jsonSetConfig(QTcpSocket*, const QJsonObject&) override;
+	void jsonSetConfig(QIODevice*, const QJsonObject&) override;
 
 	void loadConfig(const QJsonObject&) override;
 	void saveConfig(QJsonObject&) const override;
 
-	std::vector<QTcpSocket*> outputSetters() const override;
-	void resetOutputsOfClient(QTcpSocket*) override;
+	void resetOutputsOfClient(QIODevice*) override;
 	void allOutputsReset() override;
-	void reactivateCheck() override;
 
 	static uint8_t jsonOutputToByte(const QJsonObject&);
 
@@ -4,6 +4,7 @@
 #include "mtbusb.h"
 #include "main.h"
 #include "errors.h"
+#include "utils.h"
 
 MtbUnis::MtbUnis(uint8_t addr) : MtbModule(addr) {
 	std::fill(this->whoSetOutput.begin(), this->whoSetOutput.end(), nullptr);
@@ -37,43 +38,43 @@ QJsonObject MtbUnis::moduleInfo(bool state, bool config) const {
 
 /* Json Set Outputs --------------------------------------------------------- */
 
-void MtbUnis::jsonSetOutput(QTcpSocket *socket, const QJsonObject &request) {
-	if (!this->active) {
-		sendError(socket, request, MTB_MODULE_FAILED, "Cannot set output of inactive module!");
-		return;
-	}
-	if (this->isFirmwareUpgrading()) {
-		sendError(socket, request, MTB_MODULE_UPGRADING_FW, "Firmware of module is being upgraded!");
-		return;
-	}
-	if (this->busModuleInfo.inBootloader()) {
-		sendError(socket, request, MTB_MODULE_IN_BOOTLOADER, "Module is in bootloader!");
-		return;
-	}
-	if (this->isConfigSetting()) {
-		sendError(socket, request, MTB_MODULE_CONFIG_SETTING, "Configuration of module is being changed!");
-		return;
-	}
-
-	QJsonObject outputs = QJsonSafe::safeObject(request, "outputs");
-	QMap<size_t, uint8_t> ports; // code per port
+bool MtbUnis::validateOutputs(const QJsonObject &outputs, QJsonObject &error) const {
+	if (!this->outputsSettable(error))
+		return false;
 
-	// Validate ports
 	bool ok;
 	for (const auto &key : outputs.keys()) {
 		int port = key.toInt(&ok);
 		if ((!ok) || (port < 0) || (port >= static_cast<int>(UNIS_OUT_CNT))) {
-			sendError(socket, request, MTB_MODULE_INVALID_PORT, "Invalid port: "+key);
-			return;
+			error = DaemonServer::error(MTB_MODULE_INVALID_PORT, "Invalid port: "+key);
+			return false;
 		}
 
 		try {
-			ports[port] = jsonOutputToByte(QJsonSafe::safeObject(outputs[key]));
+			jsonOutputToByte(QJsonSafe::safeObject(outputs[key]));
 		} catch (const JsonParseError& e) {
-			sendError(socket, request, MTB_MODULE_INVALID_PORT, "Invalid port "+key+" content: "+e.what());
-			return;
+			error = DaemonServer::error(MTB_MODULE_INVALID_PORT, "Invalid port "+key+" content: "+e.what());
+			return false;
 		}
 	}
+	return true;
+}
+
+void MtbUnis::jsonSetOutput(QIODevice *socket, const QJsonObject &request) {
+	QJsonObject error;
+	if (!this->outputsSettable(error)) {
+		sendError(socket, request, error);
+		return;
+	}
+	QJsonObject outputs = QJsonSafe::safeObject(request, "outputs");
+	if (!this->validateOutputs(outputs, error)) {
+		sendError(socket, request, error);
+		return;
+	}
+
+	QMap<size_t, uint8_t> ports; // code per port
+	for (const auto &key : outputs.keys())
+		ports[key.toInt()] = jsonOutputToByte(QJsonSafe::safeObject(outputs[key]));
 
 	bool send = (this->outputsWant == this->outputsConfirmed);
 	bool changed = false;
@@ -84,7 +85,7 @@ void MtbUnis::jsonSetOutput(QTcpSocket *socket, const QJsonObject &request) {
 			changed = true;
 			if ((this->whoSetOutput[port] != nullptr) && (this->whoSetOutput[port] != socket))
 				this->mlog("Multiple clients set same output: "+QString::number(port), Mtb::LogLevel::Warning);
-			this->whoSetOutput[port] = socket;
+			this->setOutputOwner(this->whoSetOutput[port], socket, port);
 		}
 		this->outputsWant[port] = ports[port];
 	}
@@ -106,17 +107,18 @@ void MtbUnis::jsonSetOutput(QTcpSocket *socket, const QJsonObject &request) {
 uint8_t MtbUnis::jsonOutputToByte(const QJsonObject &json) {
 	unsigned int value = QJsonSafe::safeUInt(json, "value");
 
-	if (json["type"] == "plain") {
+	switch (jsonOutputType(json)) {
+	case MtbOutputType::Plain:
 		if ((value != 0) && (value != 1))
 			throw JsonParseError("'value' can only be 0/1!");
 		return (value > 0) ? 1 : 0;
-	}
-	if (json["type"] == "s-com") {
+
+	case MtbOutputType::SCom:
 		if (value > 127)
 			throw JsonParseError("'value' can only be 0-127!");
 		return value | 0x80;
-	}
-	if (json["type"] == "flicker") {
+
+	case MtbOutputType::Flicker:
 		uint8_t flick = flickPerMinToMtbUnisValue(value);
 		if (flick == 0)
 			throw JsonParseError("'value' is not a valid flicker frequency!");
@@ -142,12 +144,13 @@ void MtbUnis::setOutputs() {
 }
 
 void MtbUnis::mtbBusOutputsSet(const std::vector<uint8_t>& data) {
+	const auto previous = this->outputsConfirmed;
 	this->outputsConfirmed = this->moduleOutputsData(data);
 
 	// TODO: check if output really set?
 
 	// Report ok callback to clients
-	std::vector<QTcpSocket*> ignore;
+	std::vector<QIODevice*> ignore;
 	for (const ServerRequest &sr : this->setOutputsSent) {
 		QJsonObject response{
 			{"command", "module_set_outputs"},
@@ -164,7 +167,7 @@ void MtbUnis::mtbBusOutputsSet(const std::vector<uint8_t>& data) {
 	this->setOutputsSent.clear();
 
 	// Report outputs changed event to other clients
-	this->sendOutputsChanged(outputsToJson(this->outputsConfirmed), ignore);
+	this->sendOutputsChanged(outputsToJson(this->outputsConfirmed), diffMask(previous, this->outputsConfirmed), ignore);
 
 	// Send next outputs
 	if (this->setOutputsWaiting.empty()) {
@@ -175,27 +178,43 @@ void MtbUnis::mtbBusOutputsSet(const std::vector<uint8_t>& data) {
 	}
 }
 
+QJsonObject MtbUnis::outputToJson(uint8_t output) {
+	if ((output & 0x80) > 0)
+		return {{"type", "s-com"}, {"value", output & 0x7F}};
+	if ((output & 0x40) > 0)
+		return {{"type", "flicker"}, {"value", static_cast<int>(flickMtbUnisToPerMin(output & 0xF))}};
+	return {{"type", "plain"}, {"value", output & 1}};
+}
+
 QJsonObject MtbUnis::outputsToJson(const std::array<uint8_t, UNIS_OUT_CNT> &outputs) {
 	QJsonObject result;
-	for (size_t i = 0; i < UNIS_OUT_CNT; i++) {
-		QJsonObject output;
-
-		if ((outputs[i] & 0x80) > 0) {
-			output["type"] = "s-com";
-			output["value"] = outputs[i] & 0x7F;
-		} else if ((outputs[i] & 0x40) > 0) {
-			output["type"] = "flicker";
-			output["value"] = static_cast<int>(flickMtbUnisToPerMin(outputs[i] & 0xF));
-		} else {
-			output["type"] = "plain";
-			output["value"] = outputs[i] & 1;
-		}
+	for (size_t i = 0; i < UNIS_OUT_CNT; i++)
+		result[QString::number(i)] = outputToJson(outputs[i]);
+	return result;
+}
 
-		result[QString::number(i)] = output;
+QJsonObject MtbUnis::outputsDeltaJson(PortMask changed) const {
+	QJsonObject result;
+	for (size_t i = 0; i < UNIS_OUT_CNT; i++)
+		if (changed & (1U << i))
+			result[QString::number(i)] = outputToJson(this->outputsConfirmed[i]);
+	return result;
+}
+
+QJsonObject MtbUnis::outputsWantJson(const QJsonObject &ports) const {
+	QJsonObject result;
+	for (const auto &key : ports.keys()) {
+		const size_t port = key.toInt();
+		if (port < this->outputsWant.size())
+			result[key] = outputToJson(this->outputsWant[port]);
 	}
 	return result;
 }
 
+QJsonObject MtbUnis::inputsDeltaJson(PortMask) const {
+	return {{"packed", static_cast<qint64>(this->inputs)}};
+}
+
 QJsonObject MtbUnis::inputsToJson(uint32_t inputs) {
 	QJsonArray json;
 	uint32_t _inputs = inputs;
@@ -223,6 +242,7 @@ void MtbUnis::mtbBusOutputsNotSet(Mtb::CmdError error) {
 
 	// TODO: mark module as failed? Do anything else?
 	this->outputsConfirmed = this->outputsWant;
+	this->bumpVersion(true);
 
 	// Send next outputs
 	if (this->setOutputsWaiting.empty()) {
@@ -235,7 +255,7 @@ void MtbUnis::mtbBusOutputsNotSet(Mtb::CmdError error) {
 
 /* Json Set Config ---------------------------------------------------------- */
 
-void MtbUnis::jsonSetConfig(QTcpSocket *socket, const QJsonObject &request) {
+void MtbUnis::jsonSetConfig(QIODevice *socket, const QJsonObject &request) {
 	if (this->configWriting.has_value()) {
 		sendError(socket, request, MTB_MODULE_ALREADY_WRITING, "Another client is writing config now!");
 		return;
@@ -274,6 +294,7 @@ void MtbUnis::jsonSetConfig(QTcpSocket *socket, const QJsonObject &request) {
 }
 
 void MtbUnis::mtbBusConfigWritten() {
+	this->bumpVersion();
 	this->config = this->configToWrite;
 	const ServerRequest request = this->configWriting.value();
 	this->configWriting.reset();
@@ -314,7 +335,7 @@ void MtbUnis::mtbBusConfigNotWritten(Mtb::CmdError error) {
 
 /* Json Upgrade Firmware ---------------------------------------------------- */
 
-void MtbUnis::jsonUpgradeFw(QTcpSocket *socket, const QJsonObject &request) {
+void MtbUnis::jsonUpgradeFw(QIODevice *socket, const QJsonObject &request) {
 	if (this->isFirmwareUpgrading()) {
 		sendError(socket, request, MTB_MODULE_UPGRADING_FW, "Firmware is already being upgraded!");
 		return;
@@ -330,7 +351,7 @@ void MtbUnis::jsonUpgradeFw(QTcpSocket *socket, const QJsonObject &request) {
 
 /* -------------------------------------------------------------------------- */
 
-void MtbUnis::resetOutputsOfClient(QTcpSocket *socket) {
+void MtbUnis::resetOutputsOfClient(QIODevice *socket) {
 	MtbModule::resetOutputsOfClient(socket);
 
 	bool send = false;
@@ -338,7 +359,7 @@ void MtbUnis::resetOutputsOfClient(QTcpSocket *socket) {
 		for (size_t i = 0; i < UNIS_OUT_CNT; i++) {
 			if (this->whoSetOutput[i] == socket) {
 				this->outputsWant[i] = this->config.value().outputsSafe[i];
-				this->whoSetOutput[i] = nullptr;
+				this->setOutputOwner(this->whoSetOutput[i], nullptr, i);
 				send = true;
 			}
 		}
@@ -351,14 +372,6 @@ void MtbUnis::resetOutputsOfClient(QTcpSocket *socket) {
 	}
 }
 
-std::vector<QTcpSocket*> MtbUnis::outputSetters() const {
-	std::vector<QTcpSocket*> result;
-	for (QTcpSocket* socket : this->whoSetOutput)
-		if ((socket != nullptr) && (std::find(result.begin(), result.end(), socket) == result.end()))
-			result.push_back(socket);
-	return result;
-}
-
 std::vector<uint8_t> MtbUnis::mtbBusOutputsData() const {
 	// Set outputs data based on diff in this->outputsWant
 	const std::array<uint8_t, UNIS_OUT_CNT> &outputs = this->outputsWant;
@@ -407,12 +420,13 @@ std::array<uint8_t, UNIS_OUT_CNT> MtbUnis::moduleOutputsData(const std::vector<u
 }
 
 void MtbUnis::allOutputsReset() {
+	const auto previous = this->outputsConfirmed;
 	for (size_t i = 0; i < UNIS_OUT_CNT; i++) {
 		this->outputsWant[i] = this->config.has_value() ? this->config.value().outputsSafe[i] : 0;
 		this->outputsConfirmed[i] = this->outputsWant[i];
-		this->whoSetOutput[i] = nullptr;
+		this->setOutputOwner(this->whoSetOutput[i], nullptr, i);
 	}
-	this->sendOutputsChanged(outputsToJson(this->outputsConfirmed), {});
+	this->sendOutputsChanged(outputsToJson(this->outputsConfirmed), diffMask(previous, this->outputsConfirmed), {});
 }
 
 /* MTB-UNI activation ---------------------------------------------------------
@@ -443,6 +457,7 @@ void MtbUnis::mtbBusActivate(Mtb::ModuleInfo info) {
 }
 
 void MtbUnis::activate() {
+	this->bumpVersion();
 	this->activating = true;
 
 	if (this->busModuleInfo.warning || this->busModuleInfo.error)
@@ -496,6 +511,7 @@ void MtbUnis::configSet() {
 void MtbUnis::inputsRead(const std::vector<uint8_t> &data) {
 	// Mtb module activation: got info & config set & inputs read → mark module as active
 	this->storeInputsState(data);
+	this->inputsUpdated();
 
 	mtbusb.send(
 		Mtb::CmdMtbModuleResetOutputs(
@@ -521,24 +537,44 @@ void MtbUnis::outputsReset() {
 	}
 
 	for (size_t i = 0; i < UNIS_OUT_CNT; i++)
-		this->whoSetOutput[i] = nullptr;
+		this->setOutputOwner(this->whoSetOutput[i], nullptr, i);
 
 	this->fullyActivated();
 }
 
+/* Warm reconnect ----------------------------------------------------------- */
+
+void MtbUnis::warmInputsRead(const std::vector<uint8_t> &data) {
+	const uint32_t previous = this->inputs;
+	this->storeInputsState(data);
+	const PortMask changed = previous ^ this->inputs;
+	if (changed != 0)
+		this->sendInputsChanged(inputsToJson(this->inputs), changed);
+
+	if (this->setOutputsSent.empty())
+		this->setOutputs();
+	this->warmActivated();
+}
+
 /* Inputs changed ----------------------------------------------------------- */
 
 void MtbUnis::mtbBusInputsChanged(const std::vector<uint8_t> &data) {
 	if (this->active || this->activating) {
+		const uint32_t previous = this->inputs;
 		this->storeInputsState(data);
-		this->sendInputsChanged(inputsToJson(this->inputs));
+		this->sendInputsChanged(inputsToJson(this->inputs), previous ^ this->inputs);
 	}
 }
 
+std::optional<PortMask> MtbUnis::inputsPacked() const {
+	return this->inputs;
+}
+
 void MtbUnis::mtbUsbDisconnected() {
 	MtbModule::mtbUsbDisconnected();
 	this->allOutputsReset();
 	this->inputs = 0;
+	this->inputsUpdated();
 }
 
 /* MtbUnisConfig ------------------------------------------------------------ */
@@ -685,11 +721,6 @@ size_t MtbUnis::flickMtbUnisToPerMin(uint8_t MtbUnisFlick) {
 	}
 }
 
-void MtbUnis::reactivateCheck() {
-	if ((!this->activating) && (this->activationsRemaining > 0) && (!this->active))
-		this->activate();
-}
-
 /* Configuration ------------------------------------------------------------ */
 
 void MtbUnis::loadConfig(const QJsonObject &json) {
@@ -53,7 +53,7 @@ protected:
 	std::array<uint8_t, UNIS_OUT_CNT> outputsConfirmed;
 	std::optional<MtbUnisConfig> config;
 	std::optional<MtbUnisConfig> configToWrite;
-	std::array<QTcpSocket*, UNIS_OUT_CNT> whoSetOutput;
+	std::array<QIODevice*, UNIS_OUT_CNT> whoSetOutput;
 
 	std::vector<ServerRequest> setOutputsWaiting;
 	std::vector<ServerRequest> setOutputsSent;
@@ -63,13 +63,18 @@ protected:
 
 	void storeInputsState(const std::vector<uint8_t>&);
 	void inputsRead(const std::vector<uint8_t>&);
+	void warmInputsRead(const std::vector<uint8_t>&) override;
 	void outputsReset();
 	void outputsSet(uint8_t, const std::vector<uint8_t>&);
+	static QJsonObject outputToJson(uint8_t output);
 	static QJsonObject outputsToJson(const std::array<uint8_t, UNIS_OUT_CNT>&);
+	QJsonObject outputsDeltaJson(PortMask changed) const override;
+	QJsonObject outputsWantJson(const QJsonObject &ports) const override;
+	QJsonObject inputsDeltaJson(PortMask changed) const override;
 	static QJsonObject inputsToJson(uint32_t inputs);
 
-	void jsonSetOutput(QTcpSocket*, const QJsonObject&) override;
-	void jsonUpgradeFw(QTcpSocket*, const QJsonObject&) override;
+	void jsonSetOutput(QIODevice*, const QJsonObject&) override;
+	void jsonUpgradeFw(QIODevice*, const QJsonObject&) override;
 
 	void setOutputs();
 	void mtbBusOutputsSet(const std::vector<uint8_t> &data);
@@ -77,7 +82,7 @@ protected:
 	void mtbBusConfigWritten();
 	void mtbBusConfigNotWritten(Mtb::CmdError);
 
-	void activate();
+	void activate() override;
 
 	std::vector<uint8_t> mtbBusOutputsData() const;
 	static std::array<uint8_t, UNIS_OUT_CNT> moduleOutputsData(const std::vector<uint8_t>& mtbBusData);
@@ -91,20 +96,20 @@ public:
 	MtbUnis(uint8_t addr);
 	~MtbUnis() override = default;
 	QJsonObject moduleInfo(bool state, bool config) const override;
+	bool validateOutputs(const QJsonObject &outputs, QJsonObject &error) const override;
 
 	void mtbBusActivate(Mtb::ModuleInfo) override;
 	void mtbBusInputsChanged(const std::vector<uint8_t>&) override;
+	std::optional<PortMask> inputsPacked() const override;
 	void mtbUsbDisconnected() override;
 
-	void jsonSetConfig(QTcpSocket*, const QJsonObject&) override;
+	void jsonSetConfig(QIODevice*, const QJsonObject&) override;
 
 	void loadConfig(const QJsonObject&) override;
 	void saveConfig(QJsonObject&) const override;
 
-	std::vector<QTcpSocket*> outputSetters() const override;
-	void resetOutputsOfClient(QTcpSocket*) override;
+	void resetOutputsOfClient(QIODevice*) override;
 	void allOutputsReset() override;
-	void reactivateCheck() override;
 
 	static uint8_t jsonOutputToByte(const QJsonObject&);
 
@@ -644,6 +644,11 @@ struct CmdMtbModuleGetDiagValue : public CmdMtbUsbForward {
 	}
 	std::vector<uint8_t> getBytes() const override { return {usbCommandCode, module, _busCommandCode, dvi}; }
 	QString msg() const override { return "Module "+QString::number(module)+" get DV "+QString::number(dvi); }
+	// DiagValue response is paired with request by module address only -> single DV read per module pending
+	bool conflict(const Cmd &cmd) const override {
+		return (is<CmdMtbModuleGetDiagValue>(cmd)) &&
+		       (dynamic_cast<const CmdMtbModuleGetDiagValue&>(cmd).module == this->module);
+	}
 
 	bool processBusResponse(MtbBusRecvCommand busCommand, const std::vector<uint8_t> &data) const override {
 		if ((busCommand == MtbBusRecvCommand::DiagValue) && (data.size() >= 1)) {
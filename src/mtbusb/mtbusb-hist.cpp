@@ -30,8 +30,7 @@ void MtbUsb::pendingResend() {
 	if (this->conflictWithOut(*(pending.cmd))) {
 		log("Not sending again, conflict: " + pending.cmd->msg(), LogLevel::Warning);
 		pending.cmd->callError(CmdError::PendingConflict);
-		if (!m_out.empty())
-			this->sendNextOut();
+		this->sendNextQueued();
 		return;
 	}
 
@@ -36,6 +36,7 @@ void MtbUsb::spHandleReadyRead() {
 		++begin;
 
 		std::vector<uint8_t> data(begin, begin + length - 1);
+		m_lastReceived = QDateTime::currentDateTime();
 		try {
 			parseMtbUsbMessage(m_readData[3], data); // without 0x2A 0x42 length; just command code & data
 		} catch (const std::logic_error& err) {
@@ -132,8 +133,7 @@ void MtbUsb::parseMtbUsbMessage(uint8_t command_code, const std::vector<uint8_t>
 			for (auto it = m_pending.begin(); it != m_pending.end(); ++it) {
 				if (it->cmd.get() == cmd) {
 					m_pending.erase(it);
-					if (!m_out.empty())
-						this->sendNextOut();
+					this->sendNextQueued();
 					return;
 				}
 			}
@@ -212,8 +212,7 @@ void MtbUsb::parseMtbBusMessage(uint8_t module, uint8_t attempts, uint8_t comman
 				for (auto it = m_pending.begin(); it != m_pending.end(); ++it) {
 					if (it->cmd.get() == m_pending[i].cmd.get()) {
 						m_pending.erase(it);
-						if (!m_out.empty())
-							this->sendNextOut();
+						this->sendNextQueued();
 						return;
 					}
 				}
@@ -292,10 +291,11 @@ void MtbUsb::pendingTimeoutError(CmdError cmdError, size_t i) {
 	assert(m_pending[i].cmd != nullptr);
 	std::unique_ptr<const Cmd> cmd = std::move(m_pending[i].cmd);
 	m_pending.erase(it);
+	if ((cmdError == CmdError::UsbNoResponse) || (cmdError == CmdError::BusNoResponse))
+		m_stats.timeouts++;
 	cmd->callError(cmdError);
 
-	if (!m_out.empty())
-		this->sendNextOut();
+	this->sendNextQueued();
 }
 
 } // namespace Mtb
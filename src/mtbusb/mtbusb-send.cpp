@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "mtbusb.h"
 
 namespace Mtb {
@@ -29,6 +30,10 @@ void MtbUsb::write(std::unique_ptr<const Cmd> cmd, size_t no_sent) {
 			QDateTime::currentDateTime().addMSecs(_PENDING_TIMEOUT),
 			no_sent
 		);
+		if (no_sent > 1)
+			m_stats.resent++;
+		else
+			m_stats.sent++;
 	} catch (std::exception &) {
 		log("Fatal error when writing command: " + cmd->msg(), LogLevel::Error);
 		cmd->callError(CmdError::SerialPortClosed);
@@ -36,6 +41,11 @@ void MtbUsb::write(std::unique_ptr<const Cmd> cmd, size_t no_sent) {
 }
 
 void MtbUsb::send(std::unique_ptr<const Cmd> &cmd, bool bypass_m_out_emptiness) {
+	if ((m_burstDepth > 0) && (!bypass_m_out_emptiness)) {
+		m_burst.emplace_back(std::move(cmd));
+		return;
+	}
+
 	// Sends or queues
 	if ((m_pending.size() >= _MAX_PENDING) || (!m_out.empty() && !bypass_m_out_emptiness) ||
 	    conflictWithPending(*cmd)) {
@@ -48,6 +58,24 @@ void MtbUsb::send(std::unique_ptr<const Cmd> &cmd, bool bypass_m_out_emptiness)
 	}
 }
 
+void MtbUsb::beginBurst() {
+	m_burstDepth++;
+}
+
+void MtbUsb::endBurst() {
+	assert(m_burstDepth > 0);
+	m_burstDepth--;
+	if ((m_burstDepth > 0) || (m_burst.empty()))
+		return;
+
+	log("BURST: " + QString::number(m_burst.size()) + " commands", LogLevel::Debug);
+	m_out.insert(m_out.begin(), std::make_move_iterator(m_burst.begin()), std::make_move_iterator(m_burst.end()));
+	m_burst.clear();
+
+	while ((!m_out.empty()) && (m_pending.size() < _MAX_PENDING) && (!conflictWithPending(*m_out.front())))
+		this->sendNextOut();
+}
+
 void MtbUsb::sendNextOut() {
 	std::unique_ptr<const Cmd> out = std::move(m_out.front());
 	log("DEQUEUE: " + out->msg(), LogLevel::Debug);
@@ -55,4 +83,28 @@ void MtbUsb::sendNextOut() {
 	send(out, true);
 }
 
+void MtbUsb::sendNextLow() {
+	if ((!m_out.empty()) || (m_burstDepth > 0))
+		return;
+
+	while (m_pending.size() < _MAX_PENDING_LOW) {
+		// First command without conflict, so commands of different modules could be pipelined
+		auto it = std::find_if(m_low.begin(), m_low.end(),
+		                       [this](const auto &cmd) { return !this->conflictWithPending(*cmd); });
+		if (it == m_low.end())
+			return;
+		std::unique_ptr<const Cmd> cmd = std::move(*it);
+		m_low.erase(it);
+		log("DEQUEUE LOW: " + cmd->msg(), LogLevel::Debug);
+		write(std::move(cmd));
+	}
+}
+
+void MtbUsb::sendNextQueued() {
+	if (!m_out.empty())
+		this->sendNextOut();
+	else
+		this->sendNextLow();
+}
+
 } // namespace Mtb
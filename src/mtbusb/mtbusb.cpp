@@ -34,6 +34,10 @@ void MtbUsb::spAboutToClose() {
 		m_out.front()->callError(CmdError::SerialPortClosed);
 		m_out.pop_front();
 	}
+	while (!m_low.empty()) {
+		m_low.front()->callError(CmdError::SerialPortClosed);
+		m_low.pop_front();
+	}
 	m_mtbUsbInfo.reset();
 	m_activeModules.reset();
 
@@ -61,6 +65,9 @@ QString flowControlToStr(QSerialPort::FlowControl fc) {
 
 void MtbUsb::pingTimerTick() {
 	if (this->connected() && this->ping) {
+		if ((m_lastReceived.isValid()) &&
+		    (m_lastReceived.addMSecs(_PING_SEND_PERIOD_MS) > QDateTime::currentDateTime()))
+			return;
 		this->send(
 			Mtb::CmdMtbUsbPing(
 				{[](void*) {}},
@@ -22,6 +22,7 @@ constexpr size_t _PENDING_TIMEOUT = 300; // ms
 constexpr size_t _PENDING_RESEND_MAX = 3;
 constexpr size_t _BUF_IN_TIMEOUT = 50; // ms
 constexpr size_t _MAX_PENDING = 3; // maximum number of commands waiting for response
+constexpr size_t _MAX_PENDING_LOW = 2; // low-priority commands are sent only when fewer commands are pending
 constexpr size_t _PING_SEND_PERIOD_MS = 5000;
 
 struct EOpenError : public MtbUsbError {
@@ -92,6 +93,13 @@ struct MtbUsbInfo {
 	bool fw_deprecated() const { return (fw_raw() < 0x0103); }
 };
 
+// Cumulative counters of MTB-USB traffic (never reset, compare deltas)
+struct TrafficStats {
+	size_t sent = 0; // commands written for the first time
+	size_t resent = 0; // commands written again because of no response from MTB-USB
+	size_t timeouts = 0; // commands failed because of no response (from MTB-USB or from module)
+};
+
 
 class MtbUsb : public QObject {
 	Q_OBJECT
@@ -109,8 +117,19 @@ public:
 	template <typename T>
 	void send(const T &&cmd);
 
+	// Commands sent between beginBurst() and endBurst() are queued together in front
+	// of all other waiting commands -> they reach the bus in the shortest possible time
+	void beginBurst();
+	void endBurst();
+
+	// Low-priority commands (e.g. bulk diagnostics) are sent only when no other command
+	// is waiting, one pending slot is always left for other traffic
+	template <typename T>
+	void sendLowPriority(const T &&cmd);
+
 	std::optional<MtbUsbInfo> mtbUsbInfo() const { return m_mtbUsbInfo; }
 	std::optional<std::array<bool, _MAX_MODULES>> activeModules() const { return m_activeModules; }
+	const TrafficStats& trafficStats() const { return m_stats; }
 
 	void changeSpeed(MtbBusSpeed, std::function<void()> onOk, std::function<void(Mtb::CmdError)> onError);
 
@@ -140,7 +159,12 @@ private:
 	QTimer m_pingTimer;
 	std::deque<PendingCmd> m_pending;
 	std::deque<std::unique_ptr<const Cmd>> m_out;
+	std::deque<std::unique_ptr<const Cmd>> m_burst;
+	std::deque<std::unique_ptr<const Cmd>> m_low;
+	size_t m_burstDepth = 0;
+	TrafficStats m_stats;
 	QDateTime m_receiveTimeout;
+	QDateTime m_lastReceived; // any message from MTB-USB confirms the link, no ping needed
 	std::optional<MtbUsbInfo> m_mtbUsbInfo;
 	std::optional<std::array<bool, _MAX_MODULES>> m_activeModules;
 
@@ -150,6 +174,8 @@ private:
 	void parseMtbBusMessage(uint8_t module, uint8_t attempts, uint8_t command_code, const std::vector<uint8_t> &data);
 	void send(std::vector<uint8_t>);
 	void sendNextOut();
+	void sendNextLow();
+	void sendNextQueued();
 
 	void write(std::unique_ptr<const Cmd> cmd, size_t no_sent = 1);
 	void send(std::unique_ptr<const Cmd> &cmd, bool bypass_m_out_emptiness = false);
@@ -171,6 +197,13 @@ void MtbUsb::send(const T &&cmd) {
 	send(cmd2);
 }
 
+template <typename T>
+void MtbUsb::sendLowPriority(const T &&cmd) {
+	log("ENQUEUE LOW: " + cmd.msg(), LogLevel::Debug);
+	m_low.emplace_back(std::make_unique<const T>(cmd));
+	this->sendNextLow();
+}
+
 } // namespace Mtb
 
 #endif
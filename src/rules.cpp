@@ -0,0 +1,155 @@
+#include "rules.h"
+#include "main.h"
+#include "logging.h"
+#include "mtbusb-common.h"
+#include "qjsonsafe.h"
+
+void RulesEngine::load(const QJsonArray &json) {
+	std::vector<Rule> rules;
+	for (int i = 0; i < json.size(); i++) {
+		try {
+			rules.push_back(RulesEngine::parse(QJsonSafe::safeObject(json[i])));
+		} catch (const JsonParseError &e) {
+			throw JsonParseError("Rule "+QString::number(i)+": "+e.what());
+		}
+	}
+
+	this->m_rules = std::move(rules);
+	for (std::vector<size_t> &indexes : this->m_byModule)
+		indexes.clear();
+	for (size_t i = 0; i < this->m_rules.size(); i++)
+		this->m_byModule[this->m_rules[i].module].push_back(i);
+	this->m_stats = {};
+
+	if (!this->m_rules.empty())
+		log("Loaded "+QString::number(this->m_rules.size())+" local rules", Mtb::LogLevel::Info);
+}
+
+RulesEngine::Rule RulesEngine::parse(const QJsonObject &json) {
+	Rule rule;
+	rule.name = json.contains("name") ? QJsonSafe::safeString(json, "name") : QString();
+
+	const unsigned int module = QJsonSafe::safeUInt(json, "module");
+	if (!Mtb::isValidModuleAddress(module))
+		throw JsonParseError("Invalid module address: "+QString::number(module));
+	rule.module = module;
+
+	const QJsonObject inputs = QJsonSafe::safeObject(json, "inputs");
+	const PortMask active = RulesEngine::parsePorts(inputs, "active");
+	const PortMask inactive = RulesEngine::parsePorts(inputs, "inactive");
+	if (active & inactive)
+		throw JsonParseError("Port cannot be both active & inactive!");
+	rule.mask = active | inactive;
+	rule.value = active;
+	if (rule.mask == 0)
+		throw JsonParseError("Rule must have at least one input!");
+
+	// Outputs are prebuilt to 'module_set_outputs' requests, their content is validated by target
+	// module when the rule fires (module type could be unknown when config is loaded)
+	const QJsonObject outputs = QJsonSafe::safeObject(json, "outputs");
+	for (const QString &key : outputs.keys()) {
+		bool ok;
+		const unsigned int addr = key.toUInt(&ok);
+		if ((!ok) || (!Mtb::isValidModuleAddress(addr)))
+			throw JsonParseError("Invalid output module address: "+key);
+		rule.outputs.push_back({static_cast<uint8_t>(addr), QJsonObject{
+			{"command", "module_set_outputs"},
+			{"type", "request"},
+			{"address", static_cast<int>(addr)},
+			{"outputs", QJsonSafe::safeObject(outputs, key)},
+		}});
+	}
+	if (rule.outputs.empty())
+		throw JsonParseError("Rule must have at least one output!");
+
+	return rule;
+}
+
+PortMask RulesEngine::parsePorts(const QJsonObject &json, const QString &key) {
+	if (!json.contains(key))
+		return 0;
+	PortMask mask = 0;
+	for (const QJsonValue &value : QJsonSafe::safeArray(json, key)) {
+		const unsigned int port = QJsonSafe::safeUInt(value);
+		if (port >= 32)
+			throw JsonParseError("Invalid port: "+QString::number(port));
+		mask |= (1U << port);
+	}
+	return mask;
+}
+
+void RulesEngine::inputsChanged(uint8_t module, PortMask previous, PortMask current,
+                                std::chrono::steady_clock::time_point received) {
+	std::vector<size_t> &indexes = this->m_byModule[module];
+	if ((indexes.empty()) || (previous == current))
+		return;
+
+	this->m_stats.evaluations++;
+	bool fired = false;
+	for (const size_t i : indexes) {
+		Rule &rule = this->m_rules[i];
+		if ((rule.matches(current)) && (!rule.matches(previous))) {
+			if (!fired)
+				mtbusb.beginBurst();
+			fired = true;
+			this->fire(rule);
+		}
+	}
+	if (!fired)
+		return;
+	mtbusb.endBurst();
+
+	// Latency = inputs change received from MTB-USB -> outputs queued for MTBbus
+	const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - received);
+	this->m_stats.latencyLast = latency;
+	this->m_stats.latencyMax = std::max(this->m_stats.latencyMax, latency);
+	this->m_stats.latencySum += latency;
+	this->m_stats.latencyCount++;
+}
+
+void RulesEngine::fire(Rule &rule) {
+	rule.fired++;
+	this->m_stats.fired++;
+
+	for (const auto &[addr, request] : rule.outputs) {
+		const QString prefix = "Rule '"+rule.name+"': module "+QString::number(addr)+": ";
+		if (modules[addr] == nullptr) {
+			log(prefix+"module not present, outputs not set", Mtb::LogLevel::Warning);
+			continue;
+		}
+		QJsonObject error;
+		if (!modules[addr]->validateOutputs(request["outputs"].toObject(), error)) {
+			log(prefix+"outputs not set: "+error["message"].toString(), Mtb::LogLevel::Warning);
+			continue;
+		}
+		try {
+			modules[addr]->jsonCommand(nullptr, request, true);
+		} catch (const JsonParseError &e) {
+			log(prefix+"outputs not set: "+e.what(), Mtb::LogLevel::Warning);
+		}
+	}
+}
+
+QJsonObject RulesEngine::json() const {
+	QJsonArray rules;
+	for (const Rule &rule : this->m_rules)
+		rules.push_back(QJsonObject{
+			{"name", rule.name},
+			{"module", rule.module},
+			{"fired", static_cast<qint64>(rule.fired)},
+		});
+
+	const Stats &stats = this->m_stats;
+	const qint64 avg = (stats.latencyCount > 0) ? stats.latencySum.count() / stats.latencyCount : 0;
+	return {
+		{"rules", rules},
+		{"evaluations", static_cast<qint64>(stats.evaluations)},
+		{"fired", static_cast<qint64>(stats.fired)},
+		{"latency_us", QJsonObject{
+			{"last", static_cast<qint64>(stats.latencyLast.count())},
+			{"avg", avg},
+			{"max", static_cast<qint64>(stats.latencyMax.count())},
+		}},
+	};
+}
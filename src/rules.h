@@ -0,0 +1,59 @@
+#ifndef _RULES_H_
+#define _RULES_H_
+
+/* Local reaction rules (input-to-output reflexes) configured in mtb-daemon.json.
+ * Each rule is precompiled into a bitmask predicate over packed inputs of
+ * a single module: (inputs & mask) == value. Rules are indexed by module
+ * address, so inputs change of a module without rules costs a single lookup.
+ * Rule fires on edge (predicate false -> true), its outputs are set directly
+ * by the daemon (no owning client), in front of other MTBbus traffic.
+ */
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <array>
+#include <chrono>
+#include <vector>
+#include "mtbusb.h"
+#include "subscriptions.h"
+
+class RulesEngine {
+public:
+	// Throws JsonParseError on invalid rules, previous rules are kept in such case
+	void load(const QJsonArray&);
+	void inputsChanged(uint8_t module, PortMask previous, PortMask current,
+	                   std::chrono::steady_clock::time_point received);
+	QJsonObject json() const;
+	size_t count() const { return this->m_rules.size(); }
+
+private:
+	struct Rule {
+		QString name;
+		uint8_t module;
+		PortMask mask;
+		PortMask value;
+		std::vector<std::pair<uint8_t, QJsonObject>> outputs; // module -> 'module_set_outputs' request
+		size_t fired = 0;
+
+		bool matches(PortMask inputs) const { return (inputs & this->mask) == this->value; }
+	};
+
+	struct Stats {
+		size_t evaluations = 0;
+		size_t fired = 0;
+		std::chrono::microseconds latencyLast{0};
+		std::chrono::microseconds latencyMax{0};
+		std::chrono::microseconds latencySum{0};
+		size_t latencyCount = 0;
+	};
+
+	std::vector<Rule> m_rules;
+	std::array<std::vector<size_t>, Mtb::_MAX_MODULES> m_byModule; // module address -> indexes to m_rules
+	Stats m_stats;
+
+	static Rule parse(const QJsonObject&);
+	static PortMask parsePorts(const QJsonObject&, const QString &key);
+	void fire(Rule&);
+};
+
+#endif
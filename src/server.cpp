@@ -1,18 +1,30 @@
 #include <QTcpSocket>
+#include <QLocalSocket>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QJsonArray>
 #include "server.h"
 #include "mtbusb.h"
 #include "main.h"
 #include "logging.h"
+#include "errors.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 DaemonServer::DaemonServer(QObject *parent) : QObject(parent) {
 	QObject::connect(&m_server, SIGNAL(newConnection()), this, SLOT(serverNewConnection()));
+	QObject::connect(&m_localServer, SIGNAL(newConnection()), this, SLOT(localServerNewConnection()));
 	QObject::connect(&this->m_tKeepAlive, SIGNAL(timeout()), this, SLOT(tKeepAliveTick()));
 }
 
 void DaemonServer::listen(const QHostAddress &addr, quint16 port, bool keepAlive) {
 	this->clients.clear();
+	this->m_lastSocket = nullptr;
+	this->m_lastSession = nullptr;
 	if (!m_server.listen(addr, port))
 		throw std::logic_error(m_server.errorString().toStdString());
 
@@ -20,38 +32,169 @@ void DaemonServer::listen(const QHostAddress &addr, quint16 port, bool keepAlive
 		this->m_tKeepAlive.start(SERVER_KEEP_ALIVE_SEND_PERIOD_MS);
 }
 
+void DaemonServer::listenLocal(const QString &name) {
+	// Remove stale socket file (e.g. after crash), otherwise listen fails
+	QLocalServer::removeServer(name);
+	// Everyone can connect (and read), write access is determined by peer credentials
+	m_localServer.setSocketOptions(QLocalServer::WorldAccessOption);
+	if (!m_localServer.listen(name))
+		throw std::logic_error(m_localServer.errorString().toStdString());
+}
+
+void DaemonServer::setOutBuffer(size_t limit, OutBufferPolicy policy) {
+	this->outBufferLimit = limit;
+	this->outBufferPolicy = policy;
+}
+
 void DaemonServer::serverNewConnection() {
-	QTcpSocket *client = m_server.nextPendingConnection();
-	log("New client: "+client->peerAddress().toString(), Mtb::LogLevel::Info);
-	QObject::connect(client, SIGNAL(disconnected()), this, SLOT(clientDisconnected()));
-	QObject::connect(client, SIGNAL(readyRead()), this, SLOT(clientReadyRead()));
-	this->clients.insert_or_assign(client, true);
+	QTcpSocket *socket = m_server.nextPendingConnection();
+	ClientSession client;
+	client.address = socket->peerAddress().toString();
+	client.port = socket->peerPort();
+	this->clientConnected(socket, std::move(client));
+}
+
+void DaemonServer::localServerNewConnection() {
+	QLocalSocket *socket = m_localServer.nextPendingConnection();
+	ClientSession client;
+	client.uid = DaemonServer::localPeerUid(socket);
+	client.address = "local:"+m_localServer.serverName();
+	this->clientConnected(socket, std::move(client));
+}
+
+void DaemonServer::clientConnected(QIODevice *socket, ClientSession &&client) {
+	log("New client: "+client.peer(), Mtb::LogLevel::Info);
+	QObject::connect(socket, SIGNAL(disconnected()), this, SLOT(clientDisconnected()));
+	QObject::connect(socket, SIGNAL(readyRead()), this, SLOT(clientReadyRead()));
+	QObject::connect(socket, SIGNAL(bytesWritten(qint64)), this, SLOT(clientBytesWritten()));
+	client.id = this->nextConnectionId++;
+	if (this->m_writeAccessPolicy)
+		client.writeAccess = this->m_writeAccessPolicy(socket, client);
+	this->clients.insert_or_assign(socket, std::move(client));
+}
+
+/* Sessions ----------------------------------------------------------------- */
+
+ClientSession *DaemonServer::session(const QIODevice *socket) {
+	if ((socket == this->m_lastSocket) && (socket != nullptr))
+		return this->m_lastSession;
+	auto it = this->clients.find(const_cast<QIODevice*>(socket));
+	if (it == this->clients.end())
+		return nullptr;
+	this->m_lastSocket = socket;
+	this->m_lastSession = &it->second;
+	return this->m_lastSession;
+}
+
+uint64_t DaemonServer::connectionId(const QIODevice *socket) {
+	const ClientSession *session = this->session(socket);
+	return (session != nullptr) ? session->id : 0;
+}
+
+void DaemonServer::setWriteAccessPolicy(WriteAccessPolicy policy) {
+	this->m_writeAccessPolicy = std::move(policy);
+	this->refreshWriteAccess();
+}
+
+void DaemonServer::refreshWriteAccess() {
+	for (auto &pair : this->clients)
+		pair.second.writeAccess = (this->m_writeAccessPolicy) ? this->m_writeAccessPolicy(pair.first, pair.second)
+		                                                       : false;
+}
+
+/* Output ownership index: modules report each change of output owner, so
+ * resetting outputs of a client costs O(modules owned by the client). */
+
+void DaemonServer::outputOwned(const QIODevice *socket, uint8_t addr, size_t port) {
+	ClientSession *session = this->session(socket);
+	if ((session != nullptr) && (port < MAX_PORTS))
+		session->ownedOutputs[addr] |= (PortMask(1) << port);
+}
+
+void DaemonServer::outputReleased(const QIODevice *socket, uint8_t addr, size_t port) {
+	ClientSession *session = this->session(socket);
+	if ((session == nullptr) || (port >= MAX_PORTS))
+		return;
+	auto it = session->ownedOutputs.find(addr);
+	if (it == session->ownedOutputs.end())
+		return;
+	it->second &= ~(PortMask(1) << port);
+	if (it->second == 0)
+		session->ownedOutputs.erase(it);
+}
+
+void DaemonServer::moduleRemoved(uint8_t addr) {
+	for (auto &pair : this->clients)
+		pair.second.ownedOutputs.erase(addr);
+}
+
+std::vector<QIODevice*> DaemonServer::outputSetters() const {
+	std::vector<QIODevice*> result;
+	for (const auto &pair : this->clients)
+		if (!pair.second.ownedOutputs.empty())
+			result.push_back(pair.first);
+	return result;
+}
+
+std::optional<uint32_t> DaemonServer::localPeerUid(const QLocalSocket *socket) {
+#if defined(Q_OS_LINUX)
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	if (getsockopt(socket->socketDescriptor(), SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0)
+		return cred.uid;
+#elif defined(Q_OS_UNIX)
+	uid_t uid;
+	gid_t gid;
+	if (getpeereid(socket->socketDescriptor(), &uid, &gid) == 0)
+		return uid;
+#else
+	(void)socket; // no peer credentials on this platform (named pipes)
+#endif
+	return std::nullopt;
+}
+
+std::optional<uint32_t> DaemonServer::peerUid(const QIODevice *socket) const {
+	auto it = this->clients.find(const_cast<QIODevice*>(socket));
+	return (it != this->clients.end()) ? it->second.uid : std::nullopt;
 }
 
 void DaemonServer::clientDisconnected() {
-	auto client = dynamic_cast<QTcpSocket*>(QObject::sender());
-	log("Client disconnected: "+client->peerAddress().toString(), Mtb::LogLevel::Info);
-	client->deleteLater();
+	auto socket = dynamic_cast<QIODevice*>(QObject::sender());
+	socket->deleteLater();
+
+	// Session is still available (e.g. owned outputs) when handling the disconnect, nothing is sent to the client
+	ClientSession *session = this->session(socket);
+	if (session != nullptr) {
+		log("Client disconnected: "+session->peer(), Mtb::LogLevel::Info);
+		session->disconnecting = true;
+	}
 
-	if (this->clients.find(client) != this->clients.end())
-		this->clients.erase(client);
+	emit clientDisconnected(socket);
 
-	emit clientDisconnected(client);
+	this->clients.erase(socket);
+	if (this->m_lastSocket == socket) {
+		this->m_lastSocket = nullptr;
+		this->m_lastSession = nullptr;
+	}
 }
 
 void DaemonServer::clientReadyRead() {
-	auto client = dynamic_cast<QTcpSocket*>(QObject::sender());
+	auto client = dynamic_cast<QIODevice*>(QObject::sender());
 	while (client->canReadLine()) {
+		// Session is looked-up for each message, client could be disconnected when processing previous message
+		ClientSession *session = this->session(client);
+		if (session == nullptr)
+			return;
 		QByteArray data = client->readLine();
 		if (data.trimmed().size() > 0) {
 			QJsonParseError parseError;
 			QJsonDocument doc = QJsonDocument::fromJson(data.trimmed(), &parseError);
 			if (doc.isNull()) {
-				log("Invalid json received from client "+client->peerAddress().toString()+"!",
-				    Mtb::LogLevel::Warning);
+				log("Invalid json received from client "+session->peer()+"!", Mtb::LogLevel::Warning);
 				return;
 			}
 
+			session->requestsReceived++;
 			QJsonObject json = doc.object();
 			try {
 				emit jsonReceived(client, json);
@@ -64,23 +207,340 @@ void DaemonServer::clientReadyRead() {
 	}
 }
 
-void DaemonServer::send(QTcpSocket &socket, const QJsonObject &jsonObj) {
+void DaemonServer::send(QIODevice &socket, const QJsonObject &jsonObj) {
+	this->send(&socket, jsonObj);
+}
+
+void DaemonServer::send(QIODevice *socket, const QJsonObject &jsonObj) {
+	// Prevent disconnected clients who started an ongoing operation (e.g. module reboot) to crash the server
+	if (socket == nullptr)
+		return;
+	ClientSession *session = this->session(socket);
+	if ((session != nullptr) && (!this->batchCapture(*socket, *session, jsonObj)))
+		this->write(*socket, *session, jsonObj);
+}
+
+void DaemonServer::broadcast(const QJsonObject &json) {
+	for (auto &pair : this->clients)
+		this->write(*pair.first, pair.second, json);
+}
+
+/* Batch requests ------------------------------------------------------------
+ * Sub-requests of a 'batch' request are dispatched with internal (negative)
+ * ids. Responses with these ids are not sent to the client, they are collected
+ * and a single 'batch' response is sent once all of them are available.
+ */
+
+std::vector<int> DaemonServer::beginBatch(QIODevice *socket, const QJsonObject &request,
+                                          const QJsonArray &subrequests, BatchCombine combine, size_t timeoutMs) {
+	ClientSession *session = this->session(socket);
+	if (session == nullptr)
+		return {};
+	ClientSession &client = *session;
+
+	auto batch = std::make_shared<ServerBatch>();
+	const size_t count = subrequests.size();
+	batch->request = request;
+	batch->subrequests = subrequests;
+	batch->responses.resize(count);
+	batch->pending = count;
+	batch->combine = std::move(combine);
+
+	if (count == 0) {
+		this->batchFinish(*socket, client, *batch);
+		return {};
+	}
+
+	std::vector<int> ids;
+	ids.reserve(count);
+	for (size_t i = 0; i < count; i++) {
+		if (this->nextBatchId < SERVER_BATCH_MIN_ID)
+			this->nextBatchId = -1;
+		ids.push_back(this->nextBatchId);
+		client.batchExpired.erase(this->nextBatchId);
+		client.batchSlots.insert_or_assign(this->nextBatchId, ServerBatchSlot{batch, i});
+		this->nextBatchId--;
+	}
+
+	// Timer is bound to the socket -> not fired after the client disconnects
+	std::weak_ptr<ServerBatch> weak = batch;
+	QTimer::singleShot(timeoutMs, socket, [this, socket, weak]() { this->batchTimeout(socket, weak); });
+	return ids;
+}
+
+bool DaemonServer::batchCapture(QIODevice &socket, ClientSession &client, const QJsonObject &json) {
+	if ((json["type"].toString() != "response") || (!json.contains("id")))
+		return false;
+	const int id = json["id"].toInt();
+	if ((id >= 0) || (id < SERVER_BATCH_MIN_ID))
+		return false;
+	auto it = client.batchSlots.find(id);
+	if (it == client.batchSlots.end())
+		return (client.batchExpired.erase(id) > 0); // late response is dropped, client's own id is kept
+
+	const std::shared_ptr<ServerBatch> batch = it->second.batch;
+	const size_t index = it->second.index;
+	client.batchSlots.erase(it);
+
+	QJsonObject response = json;
+	const QJsonObject subrequest = batch->subrequests[index].toObject();
+	if (subrequest.contains("id"))
+		response["id"] = subrequest["id"];
+	else
+		response.remove("id");
+	batch->responses[index] = response;
+	batch->pending--;
+
+	if (batch->pending == 0)
+		this->batchFinish(socket, client, *batch);
+	return true;
+}
+
+void DaemonServer::batchFinish(QIODevice &socket, ClientSession &client, const ServerBatch &batch) {
+	QJsonObject response = jsonOkResponse(batch.request);
+	if (batch.combine) {
+		batch.combine(response, batch.responses);
+	} else {
+		QJsonArray responses;
+		for (const QJsonObject &subresponse : batch.responses)
+			responses.push_back(subresponse);
+		response["responses"] = responses;
+	}
+	this->write(socket, client, response);
+}
+
+void DaemonServer::batchTimeout(QIODevice *socket, const std::weak_ptr<ServerBatch> &weak) {
+	const std::shared_ptr<ServerBatch> batch = weak.lock();
+	if (batch == nullptr)
+		return; // already finished
+	ClientSession *session = this->session(socket);
+	if (session == nullptr)
+		return;
+	ClientSession &client = *session;
+
+	const QJsonArray &subrequests = batch->subrequests;
+	for (auto it = client.batchSlots.begin(); it != client.batchSlots.end(); ) {
+		if (it->second.batch != batch) {
+			++it;
+			continue;
+		}
+		const QJsonObject subrequest = subrequests[it->second.index].toObject();
+		QJsonObject response {
+			{"command", subrequest["command"]},
+			{"type", "response"},
+			{"status", "error"},
+			{"error", DaemonServer::error(MTB_BATCH_TIMEOUT, "No response to sub-request in time")},
+		};
+		if (subrequest.contains("id"))
+			response["id"] = subrequest["id"];
+		batch->responses[it->second.index] = response;
+		client.batchExpired.insert(it->first); // late response is dropped by batchCapture
+		it = client.batchSlots.erase(it);
+	}
+
+	log("Client "+client.peer()+": batch request timed out", Mtb::LogLevel::Warning);
+	this->batchFinish(*socket, client, *batch);
+}
+
+/* Outgoing buffer limiting --------------------------------------------------
+ * Responses are always written. Events (and keep-alive messages) are held back
+ * once client's outgoing buffer exceeds the limit. What happens with them
+ * depends on the policy. When the buffer drains below half of the limit,
+ * held-back events (or 'resync_needed' event) are sent to the client.
+ */
+
+void DaemonServer::write(QIODevice &socket, ClientSession &client, const QJsonObject &jsonObj) {
+	if (client.disconnecting)
+		return;
+
 	QByteArray data = QJsonDocument(jsonObj).toJson(QJsonDocument::Compact);
 	data.push_back('\n');
+
+	const size_t queued = socket.bytesToWrite();
+	if (queued+data.size() > this->outBufferLimit*SERVER_OUT_BUFFER_HARD_FACTOR)
+		return this->disconnectSlow(socket, client);
+
+	const bool response = (jsonObj["type"].toString() == "response");
+	if ((!response) && ((client.overflow) || (queued+data.size() > this->outBufferLimit)))
+		return this->holdBack(socket, client, jsonObj, data);
+
 	socket.write(data);
+	if (response)
+		client.responsesSent++;
+	else if (jsonObj.contains("command"))
+		client.eventsSent++;
+	client.outQueuePeak = std::max(client.outQueuePeak, static_cast<size_t>(socket.bytesToWrite()));
 }
 
-void DaemonServer::send(QTcpSocket *socket, const QJsonObject &jsonObj) {
-	// Prevent disconnected clients who started an ongoing operation (e.g. module reboot) to crash the server
-	if ((socket != nullptr) && (this->clients.find(socket) != this->clients.end()))
-		this->send(*socket, jsonObj);
+void DaemonServer::holdBack(QIODevice &socket, ClientSession &client, const QJsonObject &json,
+                            const QByteArray &data) {
+	if (!client.overflow) {
+		client.overflow = true;
+		log("Client "+client.peer()+": outgoing buffer full ("+
+		    QString::number(socket.bytesToWrite())+" bytes), holding back events",
+		    Mtb::LogLevel::Warning);
+	}
+
+	if (!json.contains("command"))
+		return; // keep-alive, client does not read anyway
+
+	switch (this->outBufferPolicy) {
+	case OutBufferPolicy::Disconnect:
+		return this->disconnectSlow(socket, client);
+
+	case OutBufferPolicy::Coalesce: {
+		const std::optional<QString> key = DaemonServer::coalesceKey(json);
+		if (key.has_value()) {
+			// Newer state replaces the held one & moves to the end (it is the newest held event now)
+			auto it = client.coalescedIndex.find(key.value());
+			if (it != client.coalescedIndex.end()) {
+				client.coalescedSize -= it->second->second.size();
+				client.coalesced.erase(it->second);
+				client.eventsCoalesced++;
+			}
+			client.coalescedIndex[key.value()] = client.coalesced.insert(client.coalesced.end(), {key.value(), data});
+			client.coalescedSize += data.size();
+			if (client.coalescedSize <= this->outBufferLimit)
+				return;
+
+			// Too many different events held back -> fall back to resync
+			client.eventsDropped += client.coalesced.size();
+			client.coalesced.clear();
+			client.coalescedIndex.clear();
+			client.coalescedSize = 0;
+			client.resyncNeeded = true;
+			return;
+		}
+		[[fallthrough]];
+	}
+
+	case OutBufferPolicy::Resync:
+		client.eventsDropped++;
+		client.resyncNeeded = true;
+		return;
+	}
 }
 
-void DaemonServer::broadcast(const QJsonObject &json) {
+void DaemonServer::clientBytesWritten() {
+	auto socket = dynamic_cast<QIODevice*>(QObject::sender());
+	ClientSession *session = this->session(socket);
+	if (session == nullptr)
+		return;
+	ClientSession &client = *session;
+	if ((!client.overflow) || (client.disconnecting) ||
+	    (static_cast<size_t>(socket->bytesToWrite()) > this->outBufferLimit/2))
+		return;
+
+	client.overflow = false;
+	for (const auto &pair : client.coalesced) // order of generation
+		socket->write(pair.second);
+	client.coalesced.clear();
+	client.coalescedIndex.clear();
+	client.coalescedSize = 0;
+
+	if (client.resyncNeeded) {
+		client.resyncNeeded = false;
+		QJsonObject event{
+			{"command", "resync_needed"},
+			{"type", "event"},
+			{"events_dropped", static_cast<int>(client.eventsDropped)},
+		};
+		journal.record(event, EventScope::None); // concerns this connection only, never replayed
+		QByteArray data = QJsonDocument(event).toJson(QJsonDocument::Compact);
+		data.push_back('\n');
+		socket->write(data);
+	}
+
+	log("Client "+client.peer()+": outgoing buffer drained", Mtb::LogLevel::Info);
+}
+
+void DaemonServer::disconnectSlow(QIODevice &socket, ClientSession &client) {
+	if (client.disconnecting)
+		return;
+	client.disconnecting = true;
+	log("Client "+client.peer()+": outgoing buffer limit exceeded ("+
+	    QString::number(socket.bytesToWrite())+" bytes), disconnecting...", Mtb::LogLevel::Warning);
+
+	// Abort asynchronously: disconnect handlers must not be run in the middle of events sending
+	QTimer::singleShot(0, &socket, [&socket]() {
+		if (auto tcpSocket = dynamic_cast<QTcpSocket*>(&socket))
+			tcpSocket->abort();
+		else if (auto localSocket = dynamic_cast<QLocalSocket*>(&socket))
+			localSocket->abort();
+	});
+}
+
+std::optional<QString> DaemonServer::coalesceKey(const QJsonObject &json) {
+	// Only events carrying full state of something could be coalesced
+	const QString command = json["command"].toString();
+	if (((command == "module_inputs_changed") || (command == "module_outputs_changed")) &&
+	    (json[command].toObject()["delta"].toBool()))
+		return std::nullopt; // deltas cannot be merged
+	if ((command == "module_inputs_changed") || (command == "module_outputs_changed") || (command == "module"))
+		return command+":"+QString::number(json[command].toObject()["address"].toInt());
+	if (command == "mtbusb")
+		return command;
+	return std::nullopt;
+}
+
+OutBufferPolicy outBufferPolicyFromStr(const QString &str) {
+	if (str == "coalesce")
+		return OutBufferPolicy::Coalesce;
+	if (str == "resync")
+		return OutBufferPolicy::Resync;
+	if (str == "disconnect")
+		return OutBufferPolicy::Disconnect;
+	throw std::logic_error("Unknown outgoing buffer policy: "+str.toStdString());
+}
+
+QString outBufferPolicyToStr(OutBufferPolicy policy) {
+	switch (policy) {
+	case OutBufferPolicy::Coalesce: return "coalesce";
+	case OutBufferPolicy::Resync: return "resync";
+	case OutBufferPolicy::Disconnect: return "disconnect";
+	}
+	return "unknown";
+}
+
+QJsonObject DaemonServer::clientsJson() const {
+	QJsonArray jsonClients;
 	for (const auto &pair : this->clients) {
-		QTcpSocket *const socket = pair.first;
-		this->send(*socket, json);
+		const QIODevice *socket = pair.first;
+		const ClientSession &client = pair.second;
+		QJsonObject jsonClient{
+			{"address", client.address},
+			{"out_queue", static_cast<int>(socket->bytesToWrite())},
+			{"out_queue_peak", static_cast<int>(client.outQueuePeak)},
+			{"events_held", static_cast<int>(client.coalesced.size())},
+			{"events_coalesced", static_cast<int>(client.eventsCoalesced)},
+			{"events_dropped", static_cast<int>(client.eventsDropped)},
+			{"overflow", client.overflow},
+			{"write_access", client.writeAccess},
+			{"requests_received", static_cast<int>(client.requestsReceived)},
+			{"responses_sent", static_cast<int>(client.responsesSent)},
+			{"events_sent", static_cast<int>(client.eventsSent)},
+		};
+		QJsonObject jsonOwned;
+		for (const auto &owned : client.ownedOutputs) {
+			QJsonArray ports;
+			for (size_t port = 0; port < MAX_PORTS; port++)
+				if (owned.second & (PortMask(1) << port))
+					ports.append(static_cast<int>(port));
+			jsonOwned[QString::number(owned.first)] = ports;
+		}
+		jsonClient["owned_outputs"] = jsonOwned;
+		if (client.port.has_value())
+			jsonClient["port"] = client.port.value();
+		if (client.uid.has_value())
+			jsonClient["uid"] = static_cast<qint64>(client.uid.value());
+		jsonClients.push_back(jsonClient);
 	}
+
+	return {
+		{"out_buffer_limit", static_cast<int>(this->outBufferLimit)},
+		{"out_buffer_policy", outBufferPolicyToStr(this->outBufferPolicy)},
+		{"clients", jsonClients},
+	};
 }
 
 QJsonObject DaemonServer::error(size_t code, const QString &message) {
@@ -88,8 +548,8 @@ QJsonObject DaemonServer::error(size_t code, const QString &message) {
 }
 
 void DaemonServer::tKeepAliveTick() {
-	for (const auto& pair : this->clients)
-		this->send(pair.first, {});
+	for (auto &pair : this->clients)
+		this->write(*pair.first, pair.second, {});
 }
 
 QJsonObject jsonError(size_t code, const QString &msg) {
@@ -103,7 +563,7 @@ QJsonObject jsonError(Mtb::CmdError error) {
 	return jsonError(static_cast<int>(error)+0x1000, Mtb::cmdErrorToStr(error));
 }
 
-void sendError(QTcpSocket *socket, const QJsonObject &request, const QJsonObject &error) {
+void sendError(QIODevice *socket, const QJsonObject &request, const QJsonObject &error) {
 	QJsonObject response {
 		{"command", request["command"]},
 		{"type", "response"},
@@ -117,16 +577,16 @@ void sendError(QTcpSocket *socket, const QJsonObject &request, const QJsonObject
 	server.send(*socket, response);
 }
 
-void sendError(QTcpSocket *socket, const QJsonObject &request, size_t code,
+void sendError(QIODevice *socket, const QJsonObject &request, size_t code,
                const QString& message) {
 	sendError(socket, request, jsonError(code, message));
 }
 
-void sendError(QTcpSocket *socket, const QJsonObject &request, Mtb::CmdError cmdError) {
+void sendError(QIODevice *socket, const QJsonObject &request, Mtb::CmdError cmdError) {
 	sendError(socket, request, jsonError(cmdError));
 }
 
-void sendAccessDenied(QTcpSocket *socket, const QJsonObject &request) {
+void sendAccessDenied(QIODevice *socket, const QJsonObject &request) {
 	sendError(socket, request, jsonError(403, "Forbidden"));
 }
 
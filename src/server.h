@@ -3,19 +3,94 @@
 
 #include <QObject>
 #include <QTcpServer>
+#include <QTcpSocket>
+#include <QLocalServer>
+#include <QLocalSocket>
 #include <QJsonObject>
+#include <QJsonArray>
 #include <QTimer>
+#include <list>
+#include <memory>
+#include <set>
+#include <functional>
 #include "mtbusb.h"
+#include "subscriptions.h"
 
 constexpr size_t SERVER_DEFAULT_PORT = 3841;
 constexpr size_t SERVER_KEEP_ALIVE_SEND_PERIOD_MS = 5000;
+constexpr size_t SERVER_DEFAULT_OUT_BUFFER_LIMIT = 1 << 20; // 1 MiB
+// Client is disconnected when its outgoing buffer exceeds limit*SERVER_OUT_BUFFER_HARD_FACTOR
+// regardless of policy (responses are never held back, this bounds them)
+constexpr size_t SERVER_OUT_BUFFER_HARD_FACTOR = 4;
+constexpr size_t SERVER_BATCH_MAX_REQUESTS = 256;
+constexpr size_t SERVER_BATCH_TIMEOUT_MS = 5000; // sub-requests not answered in this time are reported as errors
+constexpr int SERVER_BATCH_MIN_ID = -(1 << 30); // sub-requests get internal ids from -1 down to this value
+
+// What to do with events for a client, which does not read its data fast enough
+// (outgoing buffer of the client exceeds the limit)
+enum class OutBufferPolicy {
+	Coalesce = 0, // keep only the newest state event of each kind & module, send them when buffer drains
+	Resync = 1, // drop events, send 'resync_needed' event when buffer drains
+	Disconnect = 2, // disconnect the client
+};
+
+OutBufferPolicy outBufferPolicyFromStr(const QString&);
+QString outBufferPolicyToStr(OutBufferPolicy);
+
+// Builds combined response from responses to sub-requests (default: 'responses' array)
+using BatchCombine = std::function<void(QJsonObject &response, const std::vector<QJsonObject> &responses)>;
+
+// Pending 'batch' request, responses to its sub-requests are collected here
+struct ServerBatch {
+	QJsonObject request;
+	QJsonArray subrequests;
+	std::vector<QJsonObject> responses;
+	size_t pending;
+	BatchCombine combine;
+};
+
+struct ServerBatchSlot {
+	std::shared_ptr<ServerBatch> batch;
+	size_t index;
+};
+
+// State of a single client connection, lives from connect to disconnect
+struct ClientSession {
+	uint64_t id = 0; // connection id, unique for the whole run of the daemon (unlike socket pointer)
+	QString address;
+	std::optional<quint16> port; // TCP clients only
+	std::optional<uint32_t> uid; // peer credentials of local (unix socket) clients
+	bool writeAccess = false; // cached result of write access policy
+	std::map<uint8_t, PortMask> ownedOutputs; // module address -> ports with outputs currently set by the client
+	size_t requestsReceived = 0;
+	size_t responsesSent = 0;
+	size_t eventsSent = 0;
+	size_t outQueuePeak = 0;
+	size_t eventsDropped = 0;
+	size_t eventsCoalesced = 0;
+	bool overflow = false; // events are being held back until the outgoing buffer drains
+	bool resyncNeeded = false;
+	bool disconnecting = false;
+	// Newest state events held back during overflow (coalesce key -> data), ordered by their last
+	// update, so flushing keeps the order the events were generated in
+	std::list<std::pair<QString, QByteArray>> coalesced;
+	std::map<QString, std::list<std::pair<QString, QByteArray>>::iterator> coalescedIndex;
+	size_t coalescedSize = 0;
+	std::map<int, ServerBatchSlot> batchSlots; // internal sub-request id -> slot
+	std::set<int> batchExpired; // internal ids of timed-out sub-requests, late responses are dropped
+
+	QString peer() const { // for logging
+		return this->uid.has_value() ? this->address+" (uid "+QString::number(this->uid.value())+")"
+		                             : this->address;
+	}
+};
 
 struct ServerRequest {
-	QTcpSocket *socket;
+	QIODevice *socket;
 	std::optional<size_t> id;
 
-	ServerRequest(QTcpSocket *socket, std::optional<size_t> id = std::nullopt) : socket(socket), id(id) {}
-	ServerRequest(QTcpSocket *socket, const QJsonObject& request) : socket(socket) {
+	ServerRequest(QIODevice *socket, std::optional<size_t> id = std::nullopt) : socket(socket), id(id) {}
+	ServerRequest(QIODevice *socket, const QJsonObject& request) : socket(socket) {
 		if (request.contains("id"))
 			this->id = request["id"].toInt();
 	}
@@ -27,35 +102,74 @@ class DaemonServer : public QObject {
 public:
 	DaemonServer(QObject *parent = nullptr);
 	void listen(const QHostAddress&, quint16 port, bool keepAlive=true);
-	void send(QTcpSocket&, const QJsonObject&);
-	void send(QTcpSocket*, const QJsonObject&);
+	void listenLocal(const QString &name);
+	void setOutBuffer(size_t limit, OutBufferPolicy);
+	void send(QIODevice&, const QJsonObject&);
+	void send(QIODevice*, const QJsonObject&);
 	void broadcast(const QJsonObject&);
 
+	ClientSession *session(const QIODevice*);
+	uint64_t connectionId(const QIODevice*); // 0 = unknown client
+	using WriteAccessPolicy = std::function<bool(const QIODevice*, const ClientSession&)>;
+	void setWriteAccessPolicy(WriteAccessPolicy);
+	void refreshWriteAccess();
+	void outputOwned(const QIODevice*, uint8_t addr, size_t port);
+	void outputReleased(const QIODevice*, uint8_t addr, size_t port);
+	void moduleRemoved(uint8_t addr);
+	std::vector<QIODevice*> outputSetters() const;
+
+	std::vector<int> beginBatch(QIODevice*, const QJsonObject &request, const QJsonArray &subrequests,
+	                            BatchCombine combine = nullptr, size_t timeoutMs = SERVER_BATCH_TIMEOUT_MS);
+
+	QJsonObject clientsJson() const;
+	std::optional<uint32_t> peerUid(const QIODevice*) const;
+
 	static QJsonObject error(size_t code, const QString& message);
 
 private slots:
 	void serverNewConnection();
+	void localServerNewConnection();
 	void clientDisconnected();
 	void clientReadyRead();
+	void clientBytesWritten();
 	void tKeepAliveTick();
 
 private:
 	QTcpServer m_server;
+	QLocalServer m_localServer;
 	QTimer m_tKeepAlive;
-	std::map<QTcpSocket*, bool> clients;
+	std::unordered_map<QIODevice*, ClientSession> clients;
+	// Last looked-up session: most lookups are for the same client (request -> access check -> response)
+	const QIODevice *m_lastSocket = nullptr;
+	ClientSession *m_lastSession = nullptr;
+	WriteAccessPolicy m_writeAccessPolicy;
+	size_t outBufferLimit = SERVER_DEFAULT_OUT_BUFFER_LIMIT;
+	OutBufferPolicy outBufferPolicy = OutBufferPolicy::Coalesce;
+	int nextBatchId = -1;
+	uint64_t nextConnectionId = 1;
+
+	void write(QIODevice&, ClientSession&, const QJsonObject&);
+	void holdBack(QIODevice&, ClientSession&, const QJsonObject&, const QByteArray&);
+	void disconnectSlow(QIODevice&, ClientSession&);
+	void clientConnected(QIODevice*, ClientSession&&);
+	bool batchCapture(QIODevice&, ClientSession&, const QJsonObject&);
+	void batchFinish(QIODevice&, ClientSession&, const ServerBatch&);
+	void batchTimeout(QIODevice*, const std::weak_ptr<ServerBatch>&);
+	static std::optional<uint32_t> localPeerUid(const QLocalSocket*);
+	static std::optional<QString> coalesceKey(const QJsonObject&);
 
 signals:
-	void jsonReceived(QTcpSocket*, const QJsonObject&);
-	void clientDisconnected(QTcpSocket*);
+	void jsonReceived(QIODevice*, const QJsonObject&);
+	void clientDisconnected(QIODevice*);
 
 };
 
 QJsonObject jsonError(size_t code, const QString &msg);
 QJsonObject jsonError(Mtb::CmdError);
 QJsonObject jsonOkResponse(const QJsonObject &request);
-void sendError(QTcpSocket*, const QJsonObject&, size_t code, const QString&);
-void sendError(QTcpSocket*, const QJsonObject&, Mtb::CmdError);
-void sendError(QTcpSocket*, const QJsonObject &request, const QJsonObject &error);
-void sendAccessDenied(QTcpSocket*, const QJsonObject&);
+void sendError(QIODevice*, const QJsonObject&, size_t code, const QString&);
+void sendError(QIODevice*, const QJsonObject&, Mtb::CmdError);
+void sendError(QIODevice*, const QJsonObject &request, const QJsonObject &error);
+void sendAccessDenied(QIODevice*, const QJsonObject&);
 
 #endif
@@ -0,0 +1,352 @@
+#include <algorithm>
+#include "speedtuner.h"
+#include "main.h"
+#include "logging.h"
+#include "utils.h"
+#include "qjsonsafe.h"
+
+SpeedTuner::SpeedTuner() {
+	this->m_timer.setSingleShot(true);
+	QObject::connect(&this->m_timer, &QTimer::timeout, [this]() {
+		if (this->m_state == State::Settling)
+			this->settled();
+		else if (this->m_state == State::Trial)
+			this->trialEnd();
+	});
+	QObject::connect(&this->m_loadTimer, &QTimer::timeout, [this]() { this->loadTick(); });
+}
+
+SpeedTuner::Options SpeedTuner::parseOptions(const QJsonObject &json, const Options &defaults) {
+	Options options = defaults;
+	if (json.contains("trial"))
+		options.trialMs = QJsonSafe::safeUInt(json, "trial");
+	if (json.contains("budget"))
+		options.budget = QJsonSafe::safeDouble(json, "budget");
+	if (json.contains("load"))
+		options.load = QJsonSafe::safeBool(json, "load");
+	if (options.trialMs == 0)
+		throw JsonParseError("'trial' must be positive!");
+	if ((options.budget < 0) || (options.budget > 1))
+		throw JsonParseError("'budget' must be in range 0–1!");
+	return options;
+}
+
+void SpeedTuner::loadConfig(const QJsonObject &json) {
+	this->m_config = SpeedTuner::parseOptions(json, Options());
+}
+
+void SpeedTuner::start(const QJsonObject &options) {
+	this->m_options = SpeedTuner::parseOptions(options, this->m_config);
+	if (!SpeedTuner::connected())
+		return;
+
+	const Mtb::MtbUsbInfo info = mtbusb.mtbUsbInfo().value();
+	this->m_speeds.clear();
+	for (const int speed : {38400, 57600, 115200, 230400})
+		if ((Mtb::mtbBusSpeedValid(speed, info.fw_raw())) && (speed >= Mtb::mtbBusSpeedToInt(info.speed)))
+			this->m_speeds.push_back(Mtb::intToMtbBusSpeed(speed));
+
+	this->m_run++;
+	this->m_next = 0;
+	this->m_initial = info.speed;
+	this->m_good.reset();
+	this->m_trials.clear();
+	this->m_reading = 0;
+	this->m_loadPending = false;
+	this->m_rolledBack = false;
+	this->m_error.clear();
+	// Captured before the first speed change: module lost right after a speed change (before
+	// the trial starts) must count as lost, not silently disappear from the trial
+	this->m_modules = SpeedTuner::activeModules();
+
+	log("MTBbus speed auto-tune started at "+QString::number(Mtb::mtbBusSpeedToInt(info.speed))+" baud",
+	    Mtb::LogLevel::Info);
+	if (this->m_modules.empty())
+		return this->finish("No active modules on MTBbus!");
+	this->nextTrial();
+}
+
+void SpeedTuner::nextTrial() {
+	if (!SpeedTuner::connected())
+		return this->finish("Disconnected from MTB-USB!");
+	if (this->m_next >= this->m_speeds.size())
+		return this->finish();
+
+	const Mtb::MtbBusSpeed speed = this->m_speeds[this->m_next++];
+	this->m_trials.emplace_back(speed);
+
+	if (speed == mtbusb.mtbUsbInfo().value().speed) { // baseline trial
+		this->m_state = State::Settling;
+		this->m_timer.start(0);
+		return;
+	}
+
+	log("MTBbus speed auto-tune: trying "+QString::number(Mtb::mtbBusSpeedToInt(speed))+" baud",
+	    Mtb::LogLevel::Info);
+	this->m_state = State::ChangingSpeed;
+	const size_t run = this->m_run;
+	mtbusb.changeSpeed(
+		speed,
+		{[this, run]() {
+			if (run != this->m_run)
+				return;
+			if (this->onSpeedChanged)
+				this->onSpeedChanged();
+			this->m_state = State::Settling;
+			this->m_timer.start(TUNER_SETTLE_MS);
+		}},
+		{[this, run](Mtb::CmdError error) {
+			if (run != this->m_run)
+				return;
+			log("MTBbus speed auto-tune: unable to change speed: "+Mtb::cmdErrorToStr(error),
+			    Mtb::LogLevel::Warning);
+			this->m_trials.back().evaluated = true;
+			this->rollback();
+		}}
+	);
+}
+
+void SpeedTuner::settled() {
+	this->m_trials.back().modules = this->m_modules;
+	this->m_state = State::ReadingBefore;
+	this->readBadCrc(false);
+}
+
+void SpeedTuner::readBadCrc(bool after) {
+	const std::vector<uint8_t> &addrs = this->m_trials.back().modules;
+	const size_t run = this->m_run;
+	this->m_reading = addrs.size();
+
+	for (const uint8_t addr : addrs) {
+		mtbusb.sendLowPriority(
+			Mtb::CmdMtbModuleGetDiagValue(
+				addr, Mtb::DVCommon::MtbBusBadCrc,
+				{[this, run, after](uint8_t addr, uint8_t, const std::vector<uint8_t> &data, void*) {
+					if (run != this->m_run)
+						return;
+					if (data.size() == sizeof(uint32_t)) {
+						Trial &trial = this->m_trials.back();
+						(after ? trial.badCrcAfter : trial.badCrcBefore)[addr] = pack<uint32_t>(data);
+					}
+					this->badCrcRead();
+				}},
+				{[this, run](Mtb::CmdError, void*) {
+					if (run != this->m_run)
+						return;
+					this->badCrcRead();
+				}}
+			)
+		);
+	}
+}
+
+void SpeedTuner::badCrcRead() {
+	if (this->m_reading > 0)
+		this->m_reading--;
+	if (this->m_reading > 0)
+		return;
+
+	Trial &trial = this->m_trials.back();
+	if (this->m_state == State::ReadingBefore) {
+		trial.before = mtbusb.trafficStats();
+		this->m_state = State::Trial;
+		this->m_timer.start(this->m_options.trialMs);
+		if (this->m_options.load) {
+			this->m_loadTimer.start(TUNER_LOAD_PERIOD_MS);
+			this->loadTick();
+		}
+
+	} else if (this->m_state == State::ReadingAfter) {
+		this->evaluate(trial);
+		if (trial.ok) {
+			this->m_good = trial.speed;
+			this->nextTrial();
+		} else {
+			this->rollback();
+		}
+	}
+}
+
+void SpeedTuner::trialEnd() {
+	this->m_loadTimer.stop();
+	this->m_trials.back().after = mtbusb.trafficStats();
+	this->m_state = State::ReadingAfter;
+	this->readBadCrc(true);
+}
+
+void SpeedTuner::evaluate(Trial &trial) {
+	for (const uint8_t addr : trial.modules)
+		if ((modules[addr] == nullptr) || (!modules[addr]->isActive()))
+			trial.lost.push_back(addr);
+
+	trial.badCrc = 0;
+	for (const auto &[addr, before] : trial.badCrcBefore) {
+		auto after = trial.badCrcAfter.find(addr);
+		if ((after != trial.badCrcAfter.end()) && (after->second >= before)) // skip counters reset by reboot
+			trial.badCrc += after->second - before;
+	}
+
+	const size_t sent = trial.after.sent - trial.before.sent;
+	const size_t errors = (trial.after.resent - trial.before.resent) +
+		(trial.after.timeouts - trial.before.timeouts) + trial.badCrc;
+	trial.errorRate = (sent+errors > 0) ? static_cast<double>(errors) / (sent+errors) : 0.0;
+	trial.ok = (trial.lost.empty()) && (sent > 0) && (trial.errorRate <= this->m_options.budget);
+	trial.evaluated = true;
+
+	QString message = "MTBbus speed auto-tune: "+QString::number(Mtb::mtbBusSpeedToInt(trial.speed))+" baud: "+
+		QString::number(sent)+" commands, "+QString::number(errors)+" errors, error rate "+
+		QString::number(trial.errorRate*100, 'f', 3)+" %";
+	if (!trial.lost.empty())
+		message += ", "+QString::number(trial.lost.size())+" modules lost";
+	if (sent == 0)
+		message += ", no traffic";
+	log(message+(trial.ok ? ", ok" : ", failed"), trial.ok ? Mtb::LogLevel::Info : Mtb::LogLevel::Warning);
+}
+
+void SpeedTuner::loadTick() {
+	if ((this->m_state != State::Trial) || (this->m_loadPending))
+		return;
+
+	const std::vector<uint8_t> &addrs = this->m_trials.back().modules;
+	std::optional<uint8_t> addr;
+	for (size_t i = 1; i <= Mtb::_MAX_MODULES; i++) {
+		const uint8_t candidate = (this->m_loadAddr + i) % Mtb::_MAX_MODULES;
+		if ((modules[candidate] != nullptr) && (modules[candidate]->isActive()) &&
+		    (std::find(addrs.begin(), addrs.end(), candidate) != addrs.end())) {
+			addr = candidate;
+			break;
+		}
+	}
+	if (!addr.has_value())
+		return;
+
+	this->m_loadAddr = addr.value();
+	this->m_loadPending = true;
+	const size_t run = this->m_run;
+	auto done = [this, run]() {
+		if (run != this->m_run)
+			return;
+		this->m_loadPending = false;
+		this->loadTick(); // keep the bus busy
+	};
+	mtbusb.sendLowPriority(
+		Mtb::CmdMtbModuleGetDiagValue(
+			addr.value(), Mtb::DVCommon::MtbBusReceived,
+			{[done](uint8_t, uint8_t, const std::vector<uint8_t>&, void*) { done(); }},
+			{[done](Mtb::CmdError, void*) { done(); }}
+		)
+	);
+}
+
+void SpeedTuner::rollback() {
+	if (!SpeedTuner::connected())
+		return this->finish("Disconnected from MTB-USB!");
+	if ((!this->m_good.has_value()) || (mtbusb.mtbUsbInfo().value().speed == this->m_good.value()))
+		return this->finish();
+
+	const Mtb::MtbBusSpeed good = this->m_good.value();
+	log("MTBbus speed auto-tune: rolling back to "+QString::number(Mtb::mtbBusSpeedToInt(good))+" baud",
+	    Mtb::LogLevel::Warning);
+	this->m_state = State::RollingBack;
+	this->m_rolledBack = true;
+	const size_t run = this->m_run;
+	mtbusb.changeSpeed(
+		good,
+		{[this, run]() {
+			if (run != this->m_run)
+				return;
+			if (this->onSpeedChanged)
+				this->onSpeedChanged();
+			this->finish();
+		}},
+		{[this, run, good](Mtb::CmdError) {
+			if (run != this->m_run)
+				return;
+			// Speed is forced on reconnect
+			log("MTBbus speed auto-tune: unable to roll back, disconnecting...", Mtb::LogLevel::Error);
+			if (this->onSpeedSettled)
+				this->onSpeedSettled(good);
+			this->finish("Unable to roll back MTBbus speed!");
+			mtbusb.disconnect();
+		}}
+	);
+}
+
+void SpeedTuner::finish(const QString &error) {
+	this->m_timer.stop();
+	this->m_loadTimer.stop();
+	this->m_state = State::Idle;
+	this->m_run++;
+	this->m_error = error;
+
+	if (!error.isEmpty()) {
+		log("MTBbus speed auto-tune aborted: "+error, Mtb::LogLevel::Warning);
+		return;
+	}
+
+	const Mtb::MtbBusSpeed speed = mtbusb.mtbUsbInfo().value().speed;
+	log("MTBbus speed auto-tune finished at "+QString::number(Mtb::mtbBusSpeedToInt(speed))+" baud",
+	    Mtb::LogLevel::Info);
+	if ((this->m_initial.has_value()) && (speed != this->m_initial.value()) && (this->onSpeedSettled))
+		this->onSpeedSettled(speed);
+}
+
+void SpeedTuner::abort(const QString &reason) {
+	if (this->running())
+		this->finish(reason);
+}
+
+bool SpeedTuner::connected() {
+	return (mtbusb.connected()) && (mtbusb.mtbUsbInfo().has_value());
+}
+
+std::vector<uint8_t> SpeedTuner::activeModules() {
+	std::vector<uint8_t> result;
+	for (size_t i = 0; i < Mtb::_MAX_MODULES; i++)
+		if ((modules[i] != nullptr) && (modules[i]->isActive()))
+			result.push_back(i);
+	return result;
+}
+
+QJsonObject SpeedTuner::Trial::json() const {
+	QJsonObject json{
+		{"speed", Mtb::mtbBusSpeedToInt(this->speed)},
+		{"modules", static_cast<int>(this->modules.size())},
+	};
+	if (!this->evaluated)
+		return json;
+
+	QJsonArray lost;
+	for (const uint8_t addr : this->lost)
+		lost.push_back(addr);
+	json["sent"] = static_cast<qint64>(this->after.sent - this->before.sent);
+	json["resent"] = static_cast<qint64>(this->after.resent - this->before.resent);
+	json["timeouts"] = static_cast<qint64>(this->after.timeouts - this->before.timeouts);
+	json["bad_crc"] = static_cast<qint64>(this->badCrc);
+	json["error_rate"] = this->errorRate;
+	json["modules_lost"] = lost;
+	json["ok"] = this->ok;
+	return json;
+}
+
+QJsonObject SpeedTuner::json() const {
+	QJsonArray trials;
+	for (const Trial &trial : this->m_trials)
+		trials.push_back(trial.json());
+
+	QJsonObject json{
+		{"running", this->running()},
+		{"trial", static_cast<qint64>(this->m_options.trialMs)},
+		{"budget", this->m_options.budget},
+		{"load", this->m_options.load},
+		{"trials", trials},
+		{"rolled_back", this->m_rolledBack},
+	};
+	if (this->m_initial.has_value())
+		json["initial_speed"] = Mtb::mtbBusSpeedToInt(this->m_initial.value());
+	if ((!this->running()) && (this->m_good.has_value()))
+		json["result_speed"] = Mtb::mtbBusSpeedToInt(this->m_good.value());
+	if (!this->m_error.isEmpty())
+		json["error"] = this->m_error;
+	return json;
+}
@@ -0,0 +1,113 @@
+#ifndef _SPEED_TUNER_H_
+#define _SPEED_TUNER_H_
+
+/* MTBbus speed auto-tuning.
+ * Trials run from the current speed upwards over all speeds supported by
+ * MTB-USB firmware. Each trial measures over a time window: commands sent,
+ * resent & timed out by MTB-USB (MtbUsb::trafficStats deltas) and bad CRC
+ * counters of all active modules (MtbBusBadCrc DV deltas). Optional synthetic
+ * load (DV reads at low MTBbus priority) keeps the bus busy when real traffic
+ * is low. Trial succeeds when error rate is within budget and no module got
+ * lost. Tuning stops at the first failed trial and rolls back to the last
+ * successful speed.
+ */
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QTimer>
+#include <functional>
+#include <map>
+#include <optional>
+#include <vector>
+#include "mtbusb.h"
+#include "mtbusb-common.h"
+
+constexpr size_t TUNER_DEFAULT_TRIAL = 10000; // ms
+constexpr double TUNER_DEFAULT_BUDGET = 0.001;
+constexpr size_t TUNER_SETTLE_MS = 500; // wait after speed change before measuring
+constexpr size_t TUNER_LOAD_PERIOD_MS = 5;
+
+class SpeedTuner {
+public:
+	// Called after each MTBbus speed change done by the tuner
+	std::function<void()> onSpeedChanged;
+	// Called when MTBbus speed was changed by the tuner and should be kept
+	std::function<void(Mtb::MtbBusSpeed)> onSpeedSettled;
+
+	SpeedTuner();
+	void loadConfig(const QJsonObject&);
+	bool running() const { return this->m_state != State::Idle; }
+	// Overrides of config in 'options', throws JsonParseError, MTB-USB must be connected
+	void start(const QJsonObject &options);
+	void abort(const QString &reason);
+	QJsonObject json() const;
+
+private:
+	enum class State {
+		Idle,
+		ChangingSpeed,
+		Settling,
+		ReadingBefore,
+		Trial,
+		ReadingAfter,
+		RollingBack,
+	};
+
+	struct Options {
+		size_t trialMs = TUNER_DEFAULT_TRIAL;
+		double budget = TUNER_DEFAULT_BUDGET;
+		bool load = true; // synthetic load
+	};
+
+	struct Trial {
+		explicit Trial(Mtb::MtbBusSpeed speed) : speed(speed) {}
+
+		Mtb::MtbBusSpeed speed;
+		Mtb::TrafficStats before;
+		Mtb::TrafficStats after;
+		std::vector<uint8_t> modules; // active before the first speed change
+		std::map<uint8_t, uint32_t> badCrcBefore;
+		std::map<uint8_t, uint32_t> badCrcAfter;
+		std::vector<uint8_t> lost;
+		size_t badCrc = 0;
+		double errorRate = 0;
+		bool evaluated = false;
+		bool ok = false;
+
+		QJsonObject json() const;
+	};
+
+	Options m_config;
+	Options m_options; // of current/last run
+
+	State m_state = State::Idle;
+	size_t m_run = 0; // callbacks of previous (aborted) runs are ignored
+	QTimer m_timer; // settle & trial window
+	QTimer m_loadTimer;
+	std::vector<Mtb::MtbBusSpeed> m_speeds; // speeds to try, ascending
+	size_t m_next = 0; // index to m_speeds
+	std::optional<Mtb::MtbBusSpeed> m_initial;
+	std::optional<Mtb::MtbBusSpeed> m_good; // last speed with successful trial
+	std::vector<uint8_t> m_modules; // active before the first speed change
+	std::vector<Trial> m_trials;
+	size_t m_reading = 0; // number of bad CRC reads on the bus
+	bool m_loadPending = false;
+	uint8_t m_loadAddr = 0;
+	bool m_rolledBack = false;
+	QString m_error;
+
+	void nextTrial();
+	void settled();
+	static Options parseOptions(const QJsonObject&, const Options &defaults);
+	void readBadCrc(bool after);
+	void badCrcRead();
+	void trialEnd();
+	void evaluate(Trial&);
+	void loadTick();
+	void rollback();
+	void finish(const QString &error = {});
+	static bool connected();
+	static std::vector<uint8_t> activeModules();
+};
+
+#endif
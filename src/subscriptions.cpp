@@ -0,0 +1,117 @@
+#include <algorithm>
+#include "subscriptions.h"
+
+void Subscriptions::subscribe(QIODevice *socket, uint8_t addr, PortFilter ports, std::optional<bool> delta) {
+	Client &client = this->m_clients[socket];
+	if (client.modules[addr]) {
+		for (Subscriber &subscriber : this->m_modules[addr]) {
+			if (subscriber.socket == socket) {
+				subscriber.ports = ports;
+				if (delta.has_value())
+					subscriber.delta = delta.value();
+			}
+		}
+		return;
+	}
+	client.modules[addr] = true;
+	this->m_modules[addr].push_back({socket, ports, delta.value_or(false)});
+}
+
+void Subscriptions::unsubscribe(QIODevice *socket, uint8_t addr) {
+	auto it = this->m_clients.find(socket);
+	if ((it == this->m_clients.end()) || (!it->second.modules[addr]))
+		return;
+	it->second.modules[addr] = false;
+	Subscriptions::vectorRemove(this->m_modules[addr], socket);
+	this->removeIfEmpty(socket);
+}
+
+void Subscriptions::setSubscribed(QIODevice *socket, const ModuleSet &modules) {
+	const ModuleSet current = this->subscribed(socket);
+	if (current == modules)
+		return;
+	for (size_t addr = 0; addr < Mtb::_MAX_MODULES; addr++) {
+		if ((modules[addr]) && (!current[addr]))
+			this->subscribe(socket, addr);
+		else if ((!modules[addr]) && (current[addr]))
+			this->unsubscribe(socket, addr);
+	}
+}
+
+void Subscriptions::subscribeTopology(QIODevice *socket) {
+	Client &client = this->m_clients[socket];
+	if (client.topology)
+		return;
+	client.topology = true;
+	this->m_topology.push_back(socket);
+}
+
+void Subscriptions::unsubscribeTopology(QIODevice *socket) {
+	auto it = this->m_clients.find(socket);
+	if ((it == this->m_clients.end()) || (!it->second.topology))
+		return;
+	it->second.topology = false;
+	Subscriptions::vectorRemove(this->m_topology, socket);
+	this->removeIfEmpty(socket);
+}
+
+void Subscriptions::clientDisconnected(QIODevice *socket) {
+	auto it = this->m_clients.find(socket);
+	if (it == this->m_clients.end())
+		return;
+
+	const Client &client = it->second;
+	for (size_t addr = 0; addr < Mtb::_MAX_MODULES; addr++)
+		if (client.modules[addr])
+			Subscriptions::vectorRemove(this->m_modules[addr], socket);
+	if (client.topology)
+		Subscriptions::vectorRemove(this->m_topology, socket);
+
+	this->m_clients.erase(it);
+}
+
+bool Subscriptions::isSubscribed(const QIODevice *socket, uint8_t addr) const {
+	auto it = this->m_clients.find(socket);
+	return ((it != this->m_clients.end()) && (it->second.modules[addr]));
+}
+
+bool Subscriptions::isTopologySubscribed(const QIODevice *socket) const {
+	auto it = this->m_clients.find(socket);
+	return ((it != this->m_clients.end()) && (it->second.topology));
+}
+
+ModuleSet Subscriptions::subscribed(const QIODevice *socket) const {
+	auto it = this->m_clients.find(socket);
+	return (it != this->m_clients.end()) ? it->second.modules : ModuleSet();
+}
+
+std::optional<Subscriber> Subscriptions::subscriber(const QIODevice *socket, uint8_t addr) const {
+	for (const Subscriber &subscriber : this->m_modules[addr])
+		if (subscriber.socket == socket)
+			return subscriber;
+	return std::nullopt;
+}
+
+void Subscriptions::removeIfEmpty(const QIODevice *socket) {
+	auto it = this->m_clients.find(socket);
+	if ((it != this->m_clients.end()) && (it->second.modules.none()) && (!it->second.topology))
+		this->m_clients.erase(it);
+}
+
+void Subscriptions::vectorRemove(std::vector<QIODevice*> &sockets, const QIODevice *socket) {
+	// Order of subscribers does not matter -> swap & pop
+	auto it = std::find(sockets.begin(), sockets.end(), socket);
+	if (it != sockets.end()) {
+		*it = sockets.back();
+		sockets.pop_back();
+	}
+}
+
+void Subscriptions::vectorRemove(std::vector<Subscriber> &subscribers, const QIODevice *socket) {
+	auto it = std::find_if(subscribers.begin(), subscribers.end(),
+	                       [socket](const Subscriber &subscriber) { return subscriber.socket == socket; });
+	if (it != subscribers.end()) {
+		*it = subscribers.back();
+		subscribers.pop_back();
+	}
+}
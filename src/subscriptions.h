@@ -0,0 +1,87 @@
+#ifndef _SUBSCRIPTIONS_H_
+#define _SUBSCRIPTIONS_H_
+
+/* Registry of clients' event subscriptions.
+ * Each client holds a bitset of its subscribed modules, each module address
+ * holds a compact vector of its subscribers. Subscribe & unsubscribe cost
+ * O(changed addresses), events fan-out costs O(subscribers).
+ * Each module subscription could be limited to specific input & output ports.
+ */
+
+#include <QIODevice>
+#include <bitset>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "mtbusb.h"
+
+using ModuleSet = std::bitset<Mtb::_MAX_MODULES>;
+using PortMask = uint32_t; // bit i = port i
+constexpr PortMask ALL_PORTS = 0xFFFFFFFF;
+constexpr size_t MAX_PORTS = 32;
+
+struct PortFilter {
+	PortMask inputs = ALL_PORTS;
+	PortMask outputs = ALL_PORTS;
+
+	bool all() const { return (this->inputs == ALL_PORTS) && (this->outputs == ALL_PORTS); }
+	// Unfiltered subscribers get all events (even events without any port changed)
+	bool inputsMatch(PortMask changed) const { return (this->inputs == ALL_PORTS) || (this->inputs & changed); }
+	bool outputsMatch(PortMask changed) const { return (this->outputs == ALL_PORTS) || (this->outputs & changed); }
+};
+
+struct Subscriber {
+	QIODevice *socket;
+	PortFilter ports;
+	bool delta = false; // send only changed ports in inputs/outputs changed events
+	// Inputs/outputs changed events delivered to the client ('seq' of the events)
+	size_t inputsSeq = 0;
+	size_t outputsSeq = 0;
+};
+
+class Subscriptions {
+public:
+	// delta=nullopt: keep delta mode of existing subscription (new subscription: no delta)
+	void subscribe(QIODevice*, uint8_t addr, PortFilter = {}, std::optional<bool> delta = std::nullopt);
+	void unsubscribe(QIODevice*, uint8_t addr);
+	void setSubscribed(QIODevice*, const ModuleSet&);
+	void subscribeTopology(QIODevice*);
+	void unsubscribeTopology(QIODevice*);
+	void clientDisconnected(QIODevice*);
+
+	bool isSubscribed(const QIODevice*, uint8_t addr) const;
+	bool isTopologySubscribed(const QIODevice*) const;
+	ModuleSet subscribed(const QIODevice*) const;
+	std::optional<Subscriber> subscriber(const QIODevice*, uint8_t addr) const;
+
+	const std::vector<Subscriber> &moduleSubscribers(uint8_t addr) const { return this->m_modules[addr]; }
+	std::vector<Subscriber> &moduleSubscribers(uint8_t addr) { return this->m_modules[addr]; }
+	const std::vector<QIODevice*> &topologySubscribers() const { return this->m_topology; }
+
+	// Call f for each client subscribed to module 'addr' or to topology changes
+	// (each client exactly once)
+	template <typename F>
+	void forModuleOrTopology(uint8_t addr, F f) const {
+		for (QIODevice *socket : this->m_topology)
+			f(socket);
+		for (const Subscriber &subscriber : this->m_modules[addr])
+			if (!this->m_clients.at(subscriber.socket).topology)
+				f(subscriber.socket);
+	}
+
+private:
+	struct Client {
+		ModuleSet modules;
+		bool topology = false;
+	};
+
+	std::unordered_map<const QIODevice*, Client> m_clients;
+	std::array<std::vector<Subscriber>, Mtb::_MAX_MODULES> m_modules;
+	std::vector<QIODevice*> m_topology;
+
+	void removeIfEmpty(const QIODevice*);
+	static void vectorRemove(std::vector<QIODevice*>&, const QIODevice*);
+	static void vectorRemove(std::vector<Subscriber>&, const QIODevice*);
+};
+
+#endif
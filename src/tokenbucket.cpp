@@ -0,0 +1,42 @@
+#include <algorithm>
+#include "tokenbucket.h"
+#include "qjsonsafe.h"
+
+void TokenBucket::loadConfig(const QJsonObject &json) {
+	const double rate = json.contains("rate") ? QJsonSafe::safeDouble(json, "rate") : BACKGROUND_DEFAULT_RATE;
+	const double burst = json.contains("burst") ? QJsonSafe::safeDouble(json, "burst") : BACKGROUND_DEFAULT_BURST;
+	if ((rate <= 0) || (burst < 1))
+		throw JsonParseError("background_budget: 'rate' must be positive & 'burst' at least 1!");
+
+	this->refill();
+	this->m_rate = rate;
+	this->m_burst = burst;
+	this->m_tokens = std::min(this->m_tokens, this->m_burst);
+}
+
+void TokenBucket::refill() {
+	const Clock::time_point now = Clock::now();
+	const std::chrono::duration<double> elapsed = now - this->m_refilled;
+	this->m_tokens = std::min(this->m_burst, this->m_tokens + elapsed.count()*this->m_rate);
+	this->m_refilled = now;
+}
+
+bool TokenBucket::take() {
+	this->refill();
+	if (this->m_tokens < 1) {
+		this->m_denied++;
+		return false;
+	}
+	this->m_tokens -= 1;
+	this->m_taken++;
+	return true;
+}
+
+QJsonObject TokenBucket::json() const {
+	return {
+		{"rate", this->m_rate},
+		{"burst", this->m_burst},
+		{"sent", static_cast<qint64>(this->m_taken)},
+		{"deferred", static_cast<qint64>(this->m_denied)},
+	};
+}
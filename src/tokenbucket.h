@@ -0,0 +1,36 @@
+#ifndef _TOKEN_BUCKET_H_
+#define _TOKEN_BUCKET_H_
+
+/* Token bucket limiting background MTBbus traffic (reactivation of inactive
+ * modules, activation retries, health polling). Tokens are refilled
+ * continuously at 'rate' per second up to 'burst'. Background command is sent
+ * only when a token is available, so the bus load caused by broken modules is
+ * bounded regardless of their count.
+ */
+
+#include <QJsonObject>
+#include <chrono>
+
+constexpr double BACKGROUND_DEFAULT_RATE = 10; // commands per second
+constexpr double BACKGROUND_DEFAULT_BURST = 10;
+
+class TokenBucket {
+public:
+	void loadConfig(const QJsonObject&);
+	bool take(); // true = token taken, command could be sent
+	QJsonObject json() const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	double m_rate = BACKGROUND_DEFAULT_RATE;
+	double m_burst = BACKGROUND_DEFAULT_BURST;
+	double m_tokens = BACKGROUND_DEFAULT_BURST;
+	Clock::time_point m_refilled = Clock::now();
+	size_t m_taken = 0;
+	size_t m_denied = 0;
+
+	void refill();
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define _UTILS_H_
 
 #include <QMap>
+#include <array>
 #include <vector>
 #include <QString>
 
@@ -19,6 +20,17 @@ QMap<V, K> invertQMap(const QMap<K, V>& inMap) {
 	return outMap;
 }
 
+// bit i of the result is set iff a[i] != b[i]
+template<typename T, size_t N>
+uint32_t diffMask(const std::array<T, N> &a, const std::array<T, N> &b) {
+	static_assert(N <= 32, "diffMask supports at most 32 items");
+	uint32_t result = 0;
+	for (size_t i = 0; i < N; i++)
+		if (a[i] != b[i])
+			result |= (1U << i);
+	return result;
+}
+
 template<typename T>
 T pack(std::vector<uint8_t> data) {
 	// Uses little-endian (data[3] == most significant byte)
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <bitset>
+#include "virtualinputs.h"
+#include "main.h"
+#include "logging.h"
+#include "mtbusb-common.h"
+#include "qjsonsafe.h"
+
+size_t VirtualInputs::Term::active(PortMask inputs) const {
+	return std::bitset<32>((inputs ^ this->inverted) & this->mask).count();
+}
+
+void VirtualInputs::load(const QJsonObject &json) {
+	std::vector<VirtualInput> inputs;
+	std::map<QString, size_t> byName;
+	std::array<std::vector<Term>, Mtb::_MAX_MODULES> byModule;
+
+	for (const QString &name : json.keys()) {
+		try {
+			const QJsonObject definition = QJsonSafe::safeObject(json, name);
+			const QString op = QJsonSafe::safeString(definition, "op");
+			if ((op != "or") && (op != "and"))
+				throw JsonParseError("'op' must be 'or' or 'and'!");
+
+			VirtualInput input;
+			input.name = name;
+			input.all = (op == "and");
+			const size_t index = inputs.size();
+
+			std::map<uint8_t, Term> terms; // single term per module
+			for (const QJsonValue &value : QJsonSafe::safeArray(definition, "inputs")) {
+				const QJsonObject jsonInput = QJsonSafe::safeObject(value);
+				const unsigned int module = QJsonSafe::safeUInt(jsonInput, "module");
+				const unsigned int port = QJsonSafe::safeUInt(jsonInput, "port");
+				if (!Mtb::isValidModuleAddress(module))
+					throw JsonParseError("Invalid module address: "+QString::number(module));
+				if (port >= 32)
+					throw JsonParseError("Invalid port: "+QString::number(port));
+
+				auto it = terms.try_emplace(module, Term{index, 0, 0}).first;
+				if (it->second.mask & (1U << port))
+					continue; // duplicate input
+				it->second.mask |= (1U << port);
+				if ((jsonInput.contains("inverted")) && (QJsonSafe::safeBool(jsonInput, "inverted")))
+					it->second.inverted |= (1U << port);
+				input.total++;
+			}
+			if (input.total == 0)
+				throw JsonParseError("Virtual input must have at least one input!");
+
+			for (const auto &[module, term] : terms) {
+				input.active += term.active(this->m_modulesInputs[module]);
+				byModule[module].push_back(term);
+			}
+			input.state = input.evaluate();
+			byName[name] = index;
+			inputs.push_back(input);
+		} catch (const JsonParseError &e) {
+			throw JsonParseError("Virtual input "+name+": "+e.what());
+		}
+	}
+
+	// Keep subscriptions of virtual inputs present in the new definition
+	for (VirtualInput &input : this->m_inputs) {
+		auto it = byName.find(input.name);
+		if (it != byName.end()) {
+			VirtualInput &newInput = inputs[it->second];
+			newInput.subscribers = std::move(input.subscribers);
+			if (newInput.state != input.state)
+				this->notify(newInput);
+		} else {
+			for (QIODevice *socket : input.subscribers) {
+				std::set<QString> &names = this->m_clients[socket];
+				names.erase(input.name);
+				if (names.empty())
+					this->m_clients.erase(socket);
+			}
+		}
+	}
+
+	this->m_inputs = std::move(inputs);
+	this->m_byName = std::move(byName);
+	this->m_byModule = std::move(byModule);
+
+	if (!this->m_inputs.empty())
+		log("Loaded "+QString::number(this->m_inputs.size())+" virtual inputs", Mtb::LogLevel::Info);
+}
+
+void VirtualInputs::update(uint8_t module, PortMask inputs) {
+	const PortMask previous = this->m_modulesInputs[module];
+	const PortMask changed = previous ^ inputs;
+	if (changed == 0)
+		return;
+	this->m_modulesInputs[module] = inputs;
+
+	for (const Term &term : this->m_byModule[module]) {
+		if ((term.mask & changed) == 0)
+			continue;
+		VirtualInput &input = this->m_inputs[term.input];
+		input.active = input.active + term.active(inputs) - term.active(previous);
+		const bool state = input.evaluate();
+		if (state != input.state) {
+			input.state = state;
+			this->notify(input);
+		}
+	}
+}
+
+void VirtualInputs::notify(const VirtualInput &input) const {
+	// Recorded even without subscribers: reconnecting client could replay it by 'resume'
+	QJsonObject json{
+		{"command", "virtual_input_changed"},
+		{"type", "event"},
+		{"virtual_input_changed", QJsonObject{
+			{"name", input.name},
+			{"state", input.state},
+		}},
+	};
+	journal.record(json, EventScope::VirtualInput, 0, input.name);
+	for (QIODevice *socket : input.subscribers)
+		server.send(socket, json);
+}
+
+bool VirtualInputs::state(const QString &name) const {
+	auto it = this->m_byName.find(name);
+	return (it != this->m_byName.end()) ? this->m_inputs[it->second].state : false;
+}
+
+QJsonObject VirtualInputs::json() const {
+	QJsonObject result;
+	for (const VirtualInput &input : this->m_inputs)
+		result[input.name] = input.state;
+	return result;
+}
+
+void VirtualInputs::subscribe(QIODevice *socket, const QString &name) {
+	auto it = this->m_byName.find(name);
+	if (it == this->m_byName.end())
+		return;
+	if (!this->m_clients[socket].insert(name).second)
+		return;
+	this->m_inputs[it->second].subscribers.push_back(socket);
+}
+
+void VirtualInputs::unsubscribe(QIODevice *socket, const QString &name) {
+	auto client = this->m_clients.find(socket);
+	if ((client == this->m_clients.end()) || (client->second.erase(name) == 0))
+		return;
+	if (client->second.empty())
+		this->m_clients.erase(client);
+
+	auto it = this->m_byName.find(name);
+	if (it == this->m_byName.end())
+		return;
+	std::vector<QIODevice*> &subscribers = this->m_inputs[it->second].subscribers;
+	subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), socket), subscribers.end());
+}
+
+void VirtualInputs::clientDisconnected(QIODevice *socket) {
+	const std::set<QString> names = this->subscribed(socket);
+	for (const QString &name : names)
+		this->unsubscribe(socket, name);
+}
+
+std::set<QString> VirtualInputs::subscribed(const QIODevice *socket) const {
+	auto it = this->m_clients.find(socket);
+	return (it != this->m_clients.end()) ? it->second : std::set<QString>();
+}
@@ -0,0 +1,70 @@
+#ifndef _VIRTUAL_INPUTS_H_
+#define _VIRTUAL_INPUTS_H_
+
+/* Virtual inputs defined in mtb-daemon.json: OR/AND of (module, port) inputs,
+ * e.g. "section occupied" from several track circuit inputs.
+ * Each virtual input keeps number of its currently active inputs, inputs change
+ * of a module updates only virtual inputs containing changed ports (popcount
+ * of masked packed inputs per module), so evaluation cost does not depend on
+ * number of virtual inputs. Clients could subscribe virtual inputs, they get
+ * 'virtual_input_changed' event only when the aggregated state changes.
+ */
+
+#include <QIODevice>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <array>
+#include <set>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "mtbusb.h"
+#include "subscriptions.h"
+
+class VirtualInputs {
+public:
+	// Throws JsonParseError on invalid definition, previous definitions are kept in such case
+	void load(const QJsonObject&);
+	// Called with current packed inputs of a module whenever they could have changed
+	void update(uint8_t module, PortMask inputs);
+
+	bool exists(const QString &name) const { return this->m_byName.find(name) != this->m_byName.end(); }
+	bool state(const QString &name) const;
+	QJsonObject json() const; // name -> state of all virtual inputs
+
+	void subscribe(QIODevice*, const QString &name);
+	void unsubscribe(QIODevice*, const QString &name);
+	void clientDisconnected(QIODevice*);
+	std::set<QString> subscribed(const QIODevice*) const;
+
+private:
+	struct VirtualInput {
+		QString name;
+		bool all; // true = AND, false = OR
+		size_t total = 0; // number of inputs
+		size_t active = 0; // number of currently active inputs (after inversion)
+		bool state = false;
+		std::vector<QIODevice*> subscribers;
+
+		bool evaluate() const { return this->all ? (this->active == this->total) : (this->active > 0); }
+	};
+
+	// Inputs of a single module used by a single virtual input
+	struct Term {
+		size_t input; // index to m_inputs
+		PortMask mask;
+		PortMask inverted;
+
+		size_t active(PortMask inputs) const;
+	};
+
+	std::vector<VirtualInput> m_inputs;
+	std::map<QString, size_t> m_byName;
+	std::array<std::vector<Term>, Mtb::_MAX_MODULES> m_byModule;
+	std::array<PortMask, Mtb::_MAX_MODULES> m_modulesInputs{}; // last known packed inputs of all modules
+	std::unordered_map<const QIODevice*, std::set<QString>> m_clients;
+
+	void notify(const VirtualInput&) const;
+};
+
+#endif
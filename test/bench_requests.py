@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+
+"""
+Benchmark of end-to-end request throughput of MTB Daemon.
+
+Sends a pipelined burst of requests (without waiting for responses) & measures
+time until all responses are received. Requests answered directly by the
+daemon (without MTBbus traffic) are used. The result includes socket I/O and
+JSON parsing & serialization on both sides. Use it to compare daemon builds
+against each other.
+
+Usage: bench_requests.py [-n COUNT] [-a MODULE_ADDRESS]
+"""
+
+from typing import Dict, Any, List
+import argparse
+import json
+import socket
+import time
+
+
+HOST = '127.0.0.1'
+PORT = 3841
+
+
+def run(sock: socket.socket, requests: List[Dict[str, Any]]) -> float:
+    data = ''.join(json.dumps(request)+'\n' for request in requests).encode('utf-8')
+    remaining = len(requests)
+    buf = b''
+
+    start = time.perf_counter()
+    sock.sendall(data)
+    while remaining > 0:
+        buf += sock.recv(0xFFFF)
+        lines = buf.split(b'\n')
+        buf = lines[-1]
+        for line in lines[:-1]:
+            message = json.loads(line) if line.strip() else {}
+            if message.get('type') == 'response':
+                remaining -= 1
+    return time.perf_counter() - start
+
+
+def bench(sock: socket.socket, name: str, request: Dict[str, Any], count: int) -> None:
+    requests = [dict(request, type='request', id=i) for i in range(count)]
+    run(sock, requests[:min(count, 100)])  # warm-up
+    elapsed = run(sock, requests)
+    print(f'{name:<28} {count:>7} requests {elapsed*1000:>9.1f} ms '
+          f'{elapsed/count*1e6:>8.2f} us/request')
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description='MTB Daemon request throughput benchmark')
+    parser.add_argument('-n', '--count', type=int, default=10000)
+    parser.add_argument('-a', '--address', type=int, default=1)
+    parser.add_argument('--host', default=HOST)
+    parser.add_argument('--port', type=int, default=PORT)
+    args = parser.parse_args()
+
+    with socket.create_connection((args.host, args.port)) as sock:
+        bench(sock, 'version', {'command': 'version'}, args.count)
+        bench(sock, 'unknown command', {'command': 'nonexisting_command'}, args.count)
+        bench(sock, 'module', {'command': 'module', 'address': args.address},
+              args.count)
+        bench(sock, 'module_diag',
+              {'command': 'module_diag', 'address': args.address, 'DVkey': 'nonexisting'},
+              args.count)
+        bench(sock, 'module_set_outputs (invalid)',
+              {'command': 'module_set_outputs', 'address': args.address,
+               'outputs': {'0': {'type': 'nonexisting', 'value': 0}}},
+              args.count)
+
+
+if __name__ == '__main__':
+    main()
@@ -28,9 +28,13 @@ class MtbDaemonError:
     INVALID_SPEED = 1105
     INVALID_DV = 1106
     MODULE_ACTIVE = 1107
+    MODULE_SEQUENCE_CANCELLED = 1108
     FILE_CANNOT_ACCESS = 1010
     MODULE_ALREADY_WRITING = 1110
     UNKNOWN_COMMAND = 1020
+    BATCH_TIMEOUT = 1021
+    INVALID_DCC_ADDR = 1022
+    UNKNOWN_VIRTUAL_INPUT = 1023
 
     DEVICE_DISCONNECTED = 2004
     ALREADY_STARTED = 2012
@@ -2,8 +2,13 @@
 Test common behavior of MTB Daemon TCP server using PyTest.
 """
 
+import copy
+import json
+import os
+import tempfile
+
 import common
-from mtbdaemonif import mtb_daemon
+from mtbdaemonif import mtb_daemon, MtbDaemonIFace
 
 
 def test_endpoint_present() -> None:
@@ -41,3 +46,122 @@ def test_unknown_command_module_prefix() -> None:
         ok=False
     )
     common.check_error(response, common.MtbDaemonError.UNKNOWN_COMMAND)
+
+
+def test_clients() -> None:
+    response = mtb_daemon.request_response({'command': 'clients'})
+    assert 'server' in response
+    server = response['server']
+    assert isinstance(server['out_buffer_limit'], int)
+    assert server['out_buffer_policy'] in ['coalesce', 'resync', 'disconnect']
+    assert len(server['clients']) >= 1
+
+    for client in server['clients']:
+        for key in ['out_queue', 'out_queue_peak', 'events_held', 'events_coalesced',
+                    'events_dropped', 'requests_received', 'responses_sent', 'events_sent']:
+            assert isinstance(client[key], int)
+        assert isinstance(client['overflow'], bool)
+        assert isinstance(client['write_access'], bool)
+        assert isinstance(client['owned_outputs'], dict)
+
+
+def test_rules() -> None:
+    response = mtb_daemon.request_response({'command': 'rules'})
+    assert isinstance(response['rules'], list)
+    for key in ['evaluations', 'fired']:
+        assert isinstance(response[key], int)
+    for key in ['last', 'avg', 'max']:
+        assert isinstance(response['latency_us'][key], int)
+    for rule in response['rules']:
+        assert isinstance(rule['module'], int)
+        assert isinstance(rule['fired'], int)
+
+
+def test_rules_fire() -> None:
+    # Rule 'bench' is loaded for this test only (it would set outputs in other tests):
+    # input 0 of test module active -> output 15 of test module (not used by other tests)
+    config = copy.deepcopy(common.CONFIG_JSON)
+    config['rules'] = [{
+        'name': 'bench',
+        'module': common.TEST_MODULE_ADDR,
+        'inputs': {'active': [0]},
+        'outputs': {str(common.TEST_MODULE_ADDR): {'15': {'type': 'plain', 'value': 1}}},
+    }]
+
+    def bench_fired() -> int:
+        response = mtb_daemon.request_response({'command': 'rules'})
+        rules = [rule for rule in response['rules'] if rule['name'] == 'bench']
+        assert len(rules) == 1
+        assert rules[0]['module'] == common.TEST_MODULE_ADDR
+        return rules[0]['fired']
+
+    with tempfile.TemporaryDirectory() as directory:
+        filename = os.path.join(directory, 'mtb-daemon-rules.json')
+        with open(filename, 'w') as file:
+            json.dump(config, file)
+        mtb_daemon.request_response({'command': 'load_config', 'filename': filename})
+
+    try:
+        fired = bench_fired()
+        with MtbDaemonIFace() as second_daemon, \
+                common.ModuleSubscription(second_daemon, [common.TEST_MODULE_ADDR]):
+            common.set_single_output(common.TEST_MODULE_ADDR, 0, 1)
+            second_daemon.expect_event('module_inputs_changed')
+            event = second_daemon.expect_event('module_outputs_changed')
+            common.validate_oc_event(event, common.TEST_MODULE_ADDR, 15, 1)
+            common.set_single_output(common.TEST_MODULE_ADDR, 0, 0)
+            second_daemon.expect_event('module_inputs_changed')
+        assert bench_fired() == fired+1  # fires on the rising edge only
+    finally:
+        common.set_single_output(common.TEST_MODULE_ADDR, 15, 0)
+        mtb_daemon.request_response({'command': 'load_config'})  # back to the daemon's config file
+
+
+def test_batch() -> None:
+    response = mtb_daemon.request_response({
+        'command': 'batch',
+        'requests': [
+            {'command': 'version', 'id': 1},
+            {'command': 'nonexisting_command', 'id': 2},
+            {'command': 'module', 'address': common.TEST_MODULE_ADDR},
+        ]
+    })
+    responses = response['responses']
+    assert len(responses) == 3
+
+    assert responses[0]['command'] == 'version'
+    assert responses[0]['id'] == 1
+    assert responses[0]['status'] == 'ok'
+    assert 'version' in responses[0]
+
+    assert responses[1]['id'] == 2
+    common.check_error(responses[1], common.MtbDaemonError.UNKNOWN_COMMAND)
+
+    assert responses[2]['command'] == 'module'
+    assert 'id' not in responses[2]
+    assert responses[2]['module']['address'] == common.TEST_MODULE_ADDR
+
+
+def test_batch_nested() -> None:
+    response = mtb_daemon.request_response(
+        {'command': 'batch', 'requests': [{'command': 'batch', 'requests': []}]},
+        ok=False
+    )
+    common.check_error(response, common.MtbDaemonError.INVALID_JSON)
+
+
+def test_batch_forbidden() -> None:
+    # Commands collecting own sub-responses would never fill the batch slot
+    for command in ['modules_diag', 'modules_set_outputs', 'module_output_pulse',
+                    'module_output_sequence', 'module_reboot', 'module_upgrade_fw']:
+        response = mtb_daemon.request_response(
+            {'command': 'batch', 'requests': [{'command': 'version'}, {'command': command}]},
+            ok=False
+        )
+        common.check_error(response, common.MtbDaemonError.INVALID_JSON)
+
+
+def test_negative_id() -> None:
+    # Negative ids are used internally for batch sub-requests, client's ones must be echoed
+    response = mtb_daemon.request_response({'command': 'version', 'id': -5})
+    assert response['id'] == -5
@@ -78,3 +78,75 @@ def test_dvkey_from_other_module() -> None:
         ok=False
     )
     common.check_error(response, common.MtbDaemonError.INVALID_DV)
+
+
+def test_dv_max_age_zero() -> None:
+    response = mtb_daemon.request_response({
+        'command': 'module_diag',
+        'address': common.TEST_MODULE_ADDR,
+        'DVkey': 'state',
+        'max_age_ms': 0,
+    })
+    check_dv_1(response, common.TEST_MODULE_ADDR)
+    assert response['DVage_ms'] == 0
+
+
+def test_dv_concurrent_requests() -> None:
+    for id_ in [100, 101]:
+        mtb_daemon.send_request({
+            'command': 'module_diag',
+            'id': id_,
+            'address': common.TEST_MODULE_ADDR,
+            'DVkey': 'state',
+            'max_age_ms': 0,
+        })
+
+    for id_ in [100, 101]:
+        response = mtb_daemon.expect_response('module_diag')
+        assert response['id'] == id_
+        check_dv_1(response, common.TEST_MODULE_ADDR)
+        assert isinstance(response['DVage_ms'], int)
+
+
+def test_modules_diag() -> None:
+    response = mtb_daemon.request_response({
+        'command': 'modules_diag',
+        'addresses': [common.TEST_MODULE_ADDR],
+        'DVkeys': ['state', 'blah'],
+    })
+    module = response['modules'][str(common.TEST_MODULE_ADDR)]
+    assert module['state']['DVvalue'] == {'errors': False, 'warnings': False}
+    assert module['state']['DVvalueRaw'] == [0]
+    assert module['blah']['error']['code'] == common.MtbDaemonError.INVALID_DV
+
+
+def test_modules_diag_all() -> None:
+    response = mtb_daemon.request_response({
+        'command': 'modules_diag',
+        'addresses': [common.TEST_MODULE_ADDR],
+        'DVkeys': 'all',
+    }, timeout=5)
+    module = response['modules'][str(common.TEST_MODULE_ADDR)]
+    for key in ['version', 'state', 'uptime', 'mcu_voltage']:
+        assert key in module
+
+
+def test_modules_diag_invalid_addr() -> None:
+    response = mtb_daemon.request_response(
+        {'command': 'modules_diag', 'addresses': [0], 'DVkeys': 'all'},
+        ok=False
+    )
+    common.check_error(response, common.MtbDaemonError.MODULE_INVALID_ADDR)
+
+
+def test_mtbbus_health() -> None:
+    response = mtb_daemon.request_response({
+        'command': 'mtbbus_health',
+        'addresses': [common.TEST_MODULE_ADDR],
+        'history': True,
+    })
+    module = response['modules'][str(common.TEST_MODULE_ADDR)]
+    assert module['address'] == common.TEST_MODULE_ADDR
+    assert module['state'] in ['ok', 'degraded']
+    assert isinstance(module['history'], list)
+    assert len(module['history']) == module['samples']
@@ -5,6 +5,7 @@ moc = module_output_changed
 mic = module_input_changed
 """
 
+from typing import List
 import time
 
 import common
@@ -37,6 +38,150 @@ def test_moc_event() -> None:
         common.validate_oc_event(ic_event, common.TEST_MODULE_ADDR, 1, 1)
 
 
+def test_mic_event_port_filter() -> None:
+    with MtbDaemonIFace() as second_daemon:
+        response = second_daemon.request_response({
+            'command': 'module_subscribe',
+            'addresses': [common.TEST_MODULE_ADDR],
+            'ports': {str(common.TEST_MODULE_ADDR): {'inputs': [0], 'outputs': []}},
+        })
+        assert 'ports' in response
+
+        common.set_single_output(common.TEST_MODULE_ADDR, 0, 1)
+        ic_event = second_daemon.expect_event('module_inputs_changed')
+        common.validate_ic_event(ic_event, common.TEST_MODULE_ADDR, 0, True)
+        common.set_single_output(common.TEST_MODULE_ADDR, 0, 0)
+        second_daemon.expect_event('module_inputs_changed')
+
+        second_daemon.request_response({
+            'command': 'module_subscribe',
+            'addresses': [common.TEST_MODULE_ADDR],
+            'ports': {str(common.TEST_MODULE_ADDR): {'inputs': [5], 'outputs': [5]}},
+        })
+        response = second_daemon.request_response({'command': 'my_module_subscribes'})
+        assert response['ports'] == \
+            {str(common.TEST_MODULE_ADDR): {'inputs': [5], 'outputs': [5]}}
+
+        common.set_single_output(common.TEST_MODULE_ADDR, 0, 1)
+        common.set_single_output(common.TEST_MODULE_ADDR, 0, 0)
+        second_daemon.expect_no_message()
+
+
+def test_mic_event_delta() -> None:
+    with MtbDaemonIFace() as second_daemon:
+        second_daemon.request_response({
+            'command': 'module_subscribe',
+            'addresses': [common.TEST_MODULE_ADDR],
+            'delta': True,
+        })
+
+        common.set_single_output(common.TEST_MODULE_ADDR, 0, 1)
+        event = second_daemon.expect_event('module_inputs_changed')['module_inputs_changed']
+        assert event['delta']
+        assert event['changed'] & 1
+        assert event['inputs']['packed'] & 1
+        seq = event['seq']
+
+        common.set_single_output(common.TEST_MODULE_ADDR, 0, 0)
+        event = second_daemon.expect_event('module_inputs_changed')['module_inputs_changed']
+        assert event['changed'] & 1
+        assert not event['inputs']['packed'] & 1
+        assert event['seq'] == seq+1
+
+        # Subscribing again without 'delta' keeps delta mode
+        second_daemon.request_response({
+            'command': 'module_subscribe',
+            'addresses': [common.TEST_MODULE_ADDR],
+        })
+        response = second_daemon.request_response({'command': 'my_module_subscribes'})
+        assert response['delta'] == [common.TEST_MODULE_ADDR]
+
+
+def test_mic_event_seq_port_filter() -> None:
+    # Events skipped by port filter do not make gaps in subscriber's 'seq'
+    def subscribe(daemon: MtbDaemonIFace, inputs: List[int]) -> None:
+        daemon.request_response({
+            'command': 'module_subscribe',
+            'addresses': [common.TEST_MODULE_ADDR],
+            'ports': {str(common.TEST_MODULE_ADDR): {'inputs': inputs, 'outputs': []}},
+        })
+
+    with MtbDaemonIFace() as second_daemon:
+        subscribe(second_daemon, [5])
+        common.set_single_output(common.TEST_MODULE_ADDR, 0, 1)  # filtered out
+        common.set_single_output(common.TEST_MODULE_ADDR, 0, 0)
+        second_daemon.expect_no_message()
+
+        subscribe(second_daemon, [0])  # filter changed, subscription kept
+        common.set_single_output(common.TEST_MODULE_ADDR, 0, 1)
+        event = second_daemon.expect_event('module_inputs_changed')['module_inputs_changed']
+        assert event['seq'] == 1
+        common.set_single_output(common.TEST_MODULE_ADDR, 0, 0)
+        event = second_daemon.expect_event('module_inputs_changed')['module_inputs_changed']
+        assert event['seq'] == 2
+
+
+def test_resume() -> None:
+    with MtbDaemonIFace() as first_daemon, \
+            common.ModuleSubscription(first_daemon, [common.TEST_MODULE_ADDR]):
+        common.set_single_output(common.TEST_MODULE_ADDR, 0, 1)
+        event = first_daemon.expect_event('module_inputs_changed')
+        last_seq = event['event_seq']
+
+    # Event missed by the disconnected client
+    common.set_single_output(common.TEST_MODULE_ADDR, 0, 0)
+    time.sleep(0.2)
+
+    with MtbDaemonIFace() as second_daemon, \
+            common.ModuleSubscription(second_daemon, [common.TEST_MODULE_ADDR]):
+        second_daemon.send_request({'command': 'resume', 'last_seq': last_seq, 'id': 1})
+        event = second_daemon.expect_event('module_inputs_changed')
+        common.validate_ic_event(event, common.TEST_MODULE_ADDR, 0, False)
+        assert event['event_seq'] > last_seq
+
+        response = second_daemon.expect_response('resume')
+        assert response['resumed']
+        assert response['replayed'] >= 1
+        assert response['last_seq'] >= event['event_seq']
+
+
+def test_resume_filtered() -> None:
+    # Replay uses the same delta encoding & port filter as live delivery
+    with MtbDaemonIFace() as first_daemon, \
+            common.ModuleSubscription(first_daemon, [common.TEST_MODULE_ADDR]):
+        common.set_single_output(common.TEST_MODULE_ADDR, 0, 1)
+        last_seq = first_daemon.expect_event('module_inputs_changed')['event_seq']
+
+    # Only output 0 is wired to input 0 on the bench, its outputs event is filtered out below
+    common.set_single_output(common.TEST_MODULE_ADDR, 0, 0)
+    time.sleep(0.2)
+
+    with MtbDaemonIFace() as second_daemon:
+        second_daemon.request_response({
+            'command': 'module_subscribe',
+            'addresses': [common.TEST_MODULE_ADDR],
+            'ports': {str(common.TEST_MODULE_ADDR): {'inputs': [0], 'outputs': []}},
+            'delta': True,
+        })
+        second_daemon.send_request({'command': 'resume', 'last_seq': last_seq, 'id': 1})
+        event = second_daemon.expect_event('module_inputs_changed')['module_inputs_changed']
+        assert event['delta']
+        assert event['changed'] & 1
+        assert event['seq'] == 1
+        response = second_daemon.expect_response('resume')
+        assert response['replayed'] == 1
+
+
+def test_resume_snapshot() -> None:
+    with MtbDaemonIFace() as second_daemon, \
+            common.ModuleSubscription(second_daemon, [common.TEST_MODULE_ADDR]):
+        response = second_daemon.request_response({'command': 'resume', 'last_seq': 0})
+        assert not response['resumed']
+        snapshot = response['snapshot']
+        assert 'mtbusb' in snapshot
+        assert list(snapshot['modules'].keys()) == [str(common.TEST_MODULE_ADDR)]
+
+
 def test_module_subscribe_inactive() -> None:
     with common.ModuleSubscription(mtb_daemon, [common.INACTIVE_MODULE_ADDR]):
         pass
@@ -134,6 +279,52 @@ def test_subscribe_all_addrs() -> None:
     assert response['addresses'] == []
 
 
+###############################################################################
+# DCC addresses (test bench has no MTB-RC module -> no locations)
+
+def test_find_dcc_address() -> None:
+    response = mtb_daemon.request_response({'command': 'find_dcc_address', 'address': 1234})
+    assert response['address'] == 1234
+    assert response['locations'] == []
+
+
+def test_find_dcc_address_invalid() -> None:
+    response = mtb_daemon.request_response(
+        {'command': 'find_dcc_address', 'address': 8192},
+        ok=False
+    )
+    common.check_error(response, common.MtbDaemonError.INVALID_DCC_ADDR)
+
+
+def test_dcc_subscribe() -> None:
+    response = mtb_daemon.request_response({'command': 'dcc_subscribe', 'addresses': [1234, 50]})
+    assert response['addresses'] == [50, 1234]
+    assert response['locations'] == {'50': [], '1234': []}
+
+    response = mtb_daemon.request_response({'command': 'dcc_unsubscribe', 'addresses': [1234]})
+    assert response['addresses'] == [50]
+
+    response = mtb_daemon.request_response({'command': 'dcc_unsubscribe', 'addresses': [50]})
+    assert response['addresses'] == []
+
+
+###############################################################################
+# Virtual inputs
+
+def test_virtual_inputs() -> None:
+    response = mtb_daemon.request_response({'command': 'virtual_inputs'})
+    for state in response['virtual_inputs'].values():
+        assert isinstance(state, bool)
+
+
+def test_virtual_inputs_subscribe_unknown() -> None:
+    response = mtb_daemon.request_response(
+        {'command': 'virtual_inputs_subscribe', 'names': ['nonexisting_virtual_input']},
+        ok=False
+    )
+    common.check_error(response, common.MtbDaemonError.UNKNOWN_VIRTUAL_INPUT)
+
+
 ###############################################################################
 # Topology
 
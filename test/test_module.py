@@ -97,6 +97,28 @@ def test_modules() -> None:
                            common.INACTIVE_MODULE_ADDR, 'inactive')
 
 
+def test_modules_since_version() -> None:
+    response = mtb_daemon.request_response({'command': 'modules'})
+    version = response['version']
+    assert isinstance(version, int)
+
+    response = mtb_daemon.request_response({'command': 'modules', 'since_version': version})
+    assert response['version'] == version
+    assert response['modules'] == {}
+    assert response['deleted'] == []
+
+    response = mtb_daemon.request_response(
+        {'command': 'module', 'address': common.TEST_MODULE_ADDR, 'since_version': version}
+    )
+    assert response['changed'] is False
+    assert 'module' not in response
+    assert response['version'] <= version
+
+    response = mtb_daemon.request_response({'command': 'modules', 'since_version': 0})
+    assert list(response['modules'].keys()) == \
+        [str(common.TEST_MODULE_ADDR), str(common.INACTIVE_MODULE_ADDR)]
+
+
 def test_unable_to_delete_active_module() -> None:
     response = mtb_daemon.request_response(
         {'command': 'module_delete', 'address': common.TEST_MODULE_ADDR},
@@ -117,6 +139,7 @@ def test_delete() -> None:
     response = mtb_daemon.request_response({'command': 'modules'})
     assert list(response['modules'].keys()) == \
         [str(common.TEST_MODULE_ADDR), str(common.INACTIVE_MODULE_ADDR)]
+    version = response['version']
 
     mtb_daemon.request_response(
         {'command': 'module_delete', 'address': common.INACTIVE_MODULE_ADDR}
@@ -125,6 +148,9 @@ def test_delete() -> None:
     response = mtb_daemon.request_response({'command': 'modules'})
     assert list(response['modules'].keys()) == [str(common.TEST_MODULE_ADDR)]
 
+    response = mtb_daemon.request_response({'command': 'modules', 'since_version': version})
+    assert response['deleted'] == [common.INACTIVE_MODULE_ADDR]
+
     response = mtb_daemon.request_response(
         {'command': 'module', 'address': common.INACTIVE_MODULE_ADDR},
         timeout=1,
@@ -182,6 +208,19 @@ def test_reboot() -> None:
     assert response['module']['state'] == 'active'
 
 
+def test_reboot_event_driven() -> None:
+    # Reboot finishes as soon as the module is ready, no fixed 1 s sleep
+    mtb_daemon.request_response(
+        {'command': 'module_reboot', 'address': common.TEST_MODULE_ADDR},
+        timeout=1
+    )
+
+    response = mtb_daemon.request_response({
+        'command': 'module', 'address': common.TEST_MODULE_ADDR
+    })
+    assert response['module']['state'] == 'active'
+
+
 def test_reboot_invalid_addr() -> None:
     common.check_invalid_addresses({'command': 'module_reboot'}, 'address')
 
@@ -209,6 +248,30 @@ def test_beacon() -> None:
     assert not response['module']['beacon']
 
 
+def test_beacon_since_version() -> None:
+    response = mtb_daemon.request_response({
+        'command': 'module', 'address': common.TEST_MODULE_ADDR
+    })
+    version = response['version']
+    assert not response['module']['beacon']
+
+    mtb_daemon.request_response({
+        'command': 'module_beacon', 'address': common.TEST_MODULE_ADDR, 'beacon': True
+    })
+    response = mtb_daemon.request_response(
+        {'command': 'module', 'address': common.TEST_MODULE_ADDR, 'since_version': version}
+    )
+    assert response['changed'] is True
+    assert response['module']['beacon']
+    assert response['version'] > version
+
+    mtb_daemon.request_response({
+        'command': 'module_beacon', 'address': common.TEST_MODULE_ADDR, 'beacon': False
+    })
+    response = mtb_daemon.request_response({'command': 'modules', 'since_version': version})
+    assert not response['modules'][str(common.TEST_MODULE_ADDR)]['beacon']
+
+
 def test_beacon_invalid_addr() -> None:
     common.check_invalid_addresses({'command': 'module_beacon'}, 'address')
 
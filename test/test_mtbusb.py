@@ -37,6 +37,20 @@ def validate_mtbusb_response(mtbusb: Dict[str, Any]) -> None:
     assert isinstance(mtbusb['protocol_version'], str)
     common.check_version_format(mtbusb['protocol_version'])
 
+    assert 'activation' in mtbusb
+    assert isinstance(mtbusb['activation'], dict)
+    assert isinstance(mtbusb['activation']['pending'], int)
+    if 'time_ms' in mtbusb['activation']:
+        assert isinstance(mtbusb['activation']['time_ms'], int)
+        assert mtbusb['activation']['modules'] >= 0
+
+    assert 'background_budget' in mtbusb
+    budget = mtbusb['background_budget']
+    assert budget['rate'] > 0
+    assert budget['burst'] >= 1
+    assert isinstance(budget['sent'], int)
+    assert isinstance(budget['deferred'], int)
+
 
 def test_common_response() -> None:
     response = mtb_daemon.request_response({'command': 'mtbusb'})
@@ -75,5 +89,52 @@ def test_invalid_speed() -> None:
     assert 'mtbusb' not in response
 
 
+def test_autotune() -> None:
+    initial_speed = mtb_daemon.request_response({'command': 'mtbusb'})['mtbusb']['speed']
+    try:
+        response = mtb_daemon.request_response(
+            {'command': 'mtbusb_autotune', 'start': True, 'trial': 500}
+        )
+        assert 'mtbusb_autotune' in response
+        assert response['mtbusb_autotune']['running']
+
+        response = mtb_daemon.request_response(
+            {'command': 'mtbusb_autotune', 'start': True},
+            timeout=1,
+            ok=False
+        )
+        common.check_error(response, common.MtbDaemonError.ALREADY_STARTED)
+
+        response = mtb_daemon.request_response(
+            {'command': 'mtbusb', 'mtbusb': {'speed': initial_speed}},
+            timeout=1,
+            ok=False
+        )
+        common.check_error(response, common.MtbDaemonError.ALREADY_STARTED)
+
+        for _ in range(30):
+            time.sleep(0.5)
+            response = mtb_daemon.request_response({'command': 'mtbusb_autotune'})
+            autotune = response['mtbusb_autotune']
+            if not autotune['running']:
+                break
+        assert not autotune['running']
+        assert 'error' not in autotune
+        assert autotune['trial'] == 500
+        assert len(autotune['trials']) > 0
+        for trial in autotune['trials']:
+            assert trial['speed'] in MTBBUS_SPEEDS
+            assert isinstance(trial['ok'], bool)
+            assert trial['modules'] >= 1
+
+        # 'result_speed' is present only when any trial succeeded
+        response = mtb_daemon.request_response({'command': 'mtbusb'})
+        if autotune.get('result_speed') is not None:
+            assert response['mtbusb']['speed'] == autotune['result_speed']
+    finally:
+        mtb_daemon.request_response({'command': 'mtbusb', 'mtbusb': {'speed': initial_speed}})
+        time.sleep(0.5)
+
+
 # TODO: save_config ?
 # TODO: load_config ?
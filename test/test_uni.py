@@ -193,6 +193,98 @@ def test_set_output_of_inactive_module() -> None:
     common.check_error(response, common.MtbDaemonError.MODULE_FAILED)
 
 
+def test_modules_set_outputs() -> None:
+    outputs = {'0': {'type': 'plain', 'value': 1}, '3': {'type': 'plain', 'value': 1}}
+    response = mtb_daemon.request_response({
+        'command': 'modules_set_outputs',
+        'modules': {str(common.TEST_MODULE_ADDR): outputs},
+    })
+    result = response['modules'][str(common.TEST_MODULE_ADDR)]
+    assert result['status'] == 'ok'
+    for outputstri, output in outputs.items():
+        assert result['outputs'][outputstri] == output
+
+    time.sleep(0.1)
+    check_uni_state(common.TEST_MODULE_ADDR, 0b1001)
+    reset_uni_outputs_and_validate(common.TEST_MODULE_ADDR)
+
+
+def test_modules_set_outputs_invalid() -> None:
+    # Invalid outputs of inactive module -> nothing is set
+    response = mtb_daemon.request_response(
+        {
+            'command': 'modules_set_outputs',
+            'modules': {
+                str(common.TEST_MODULE_ADDR): {'0': {'type': 'plain', 'value': 1}},
+                str(common.INACTIVE_MODULE_ADDR): {'0': {'type': 'plain', 'value': 1}},
+            },
+        },
+        ok=False
+    )
+    common.check_error(response, common.MtbDaemonError.MODULE_FAILED)
+    assert response['address'] == common.INACTIVE_MODULE_ADDR
+
+    time.sleep(0.1)
+    check_uni_state(common.TEST_MODULE_ADDR, 0)
+
+
+def test_output_pulse() -> None:
+    start = time.time()
+    response = mtb_daemon.request_response({
+        'command': 'module_output_pulse',
+        'address': common.TEST_MODULE_ADDR,
+        'outputs': {'0': {'type': 'plain', 'value': 1}},
+        'duration_ms': 300,
+    })
+    assert time.time() - start >= 0.3
+    assert response['address'] == common.TEST_MODULE_ADDR
+    assert [step['status'] for step in response['steps']] == ['ok', 'ok']
+    assert response['steps'][0]['outputs']['0'] == {'type': 'plain', 'value': 1}
+    assert response['steps'][1]['outputs']['0'] == {'type': 'plain', 'value': 0}
+
+    time.sleep(0.1)
+    check_uni_state(common.TEST_MODULE_ADDR, 0)
+
+
+def test_output_sequence() -> None:
+    with common.ModuleSubscription(mtb_daemon, [common.TEST_MODULE_ADDR]):
+        mtb_daemon.send_request({
+            'command': 'module_output_sequence',
+            'address': common.TEST_MODULE_ADDR,
+            'id': 42,
+            'steps': [
+                {'outputs': {'0': {'type': 'plain', 'value': 1}}, 'delay_ms': 300},
+                {'outputs': {'0': {'type': 'plain', 'value': 0}}},
+            ],
+        })
+        # Input 0 is connected to output 0
+        event = mtb_daemon.expect_event('module_inputs_changed')
+        assert event['module_inputs_changed']['inputs']['packed'] == 1
+        event = mtb_daemon.expect_event('module_inputs_changed')
+        assert event['module_inputs_changed']['inputs']['packed'] == 0
+
+        response = mtb_daemon.expect_response('module_output_sequence')
+        assert response['id'] == 42
+        assert len(response['steps']) == 2
+
+
+def test_output_sequence_invalid_step() -> None:
+    response = mtb_daemon.request_response(
+        {
+            'command': 'module_output_sequence',
+            'address': common.TEST_MODULE_ADDR,
+            'steps': [
+                {'outputs': {'0': {'type': 'plain', 'value': 1}}, 'delay_ms': 100},
+                {'outputs': {'16': {'type': 'plain', 'value': 0}}},
+            ],
+        },
+        ok=False
+    )
+    common.check_error(response, common.MtbDaemonError.MODULE_INVALID_PORT)
+    assert response['step'] == 1
+    check_uni_state(common.TEST_MODULE_ADDR, 0)
+
+
 ###############################################################################
 
 
@@ -203,6 +295,23 @@ def test_reset_my_outputs() -> None:
     check_uni_state(common.TEST_MODULE_ADDR, 0)
 
 
+def owned_outputs() -> Dict[str, Any]:
+    # Union of outputs owned by connected clients (the test is the only client setting outputs)
+    result: Dict[str, Any] = {}
+    response = mtb_daemon.request_response({'command': 'clients'})
+    for client in response['server']['clients']:
+        result.update(client['owned_outputs'])
+    return result
+
+
+def test_reset_my_outputs_owned() -> None:
+    addr = str(common.TEST_MODULE_ADDR)
+    set_uni_outputs_and_validate(common.TEST_MODULE_ADDR, {'1': {'type': 'plain', 'value': 1}})
+    assert owned_outputs()[addr] == [1]
+    mtb_daemon.request_response({'command': 'reset_my_outputs'})
+    assert addr not in owned_outputs()
+
+
 def test_reset_outputs_on_disconnect() -> None:
     set_uni_outputs_and_validate(common.TEST_MODULE_ADDR, {'1': {'type': 'plain', 'value': 1}})
     mtb_daemon.disconnect()